@@ -58,6 +58,8 @@ function(setup_shader_compilation)
         "${ASSET_SOURCE_DIR}/shaders/*.tesc"
         "${ASSET_SOURCE_DIR}/shaders/*.tese"
         "${ASSET_SOURCE_DIR}/shaders/*.geom"
+        "${ASSET_SOURCE_DIR}/shaders/*.task"
+        "${ASSET_SOURCE_DIR}/shaders/*.mesh"
     )
 
     set(SPIRV_BINARY_FILES)
@@ -69,20 +71,29 @@ function(setup_shader_compilation)
     # Compile shaders for each enabled backend
     foreach(GLSL ${GLSL_SOURCE_FILES})
         get_filename_component(FILE_NAME ${GLSL} NAME)
+        get_filename_component(FILE_EXT ${GLSL} LAST_EXT)
+
+        # Mesh shading is Vulkan only and needs SPIR-V 1.4
+        set(VK_TARGET_ENV)
+        set(IS_MESH_STAGE OFF)
+        if(FILE_EXT STREQUAL ".task" OR FILE_EXT STREQUAL ".mesh")
+            set(VK_TARGET_ENV --target-env vulkan1.3)
+            set(IS_MESH_STAGE ON)
+        endif()
 
         if(ENABLE_VK_BACKEND)
             # Vulkan SPIR-V
             set(SPIRV_VK "${SHADER_OUTPUT_DIR}/${FILE_NAME}.vk.spv")
             add_custom_command(
                 OUTPUT ${SPIRV_VK}
-                COMMAND ${GLSL_VALIDATOR} -V ${GLSL} -o ${SPIRV_VK}
+                COMMAND ${GLSL_VALIDATOR} -V ${VK_TARGET_ENV} ${GLSL} -o ${SPIRV_VK}
                 DEPENDS ${GLSL}
                 COMMENT "Compiling Vulkan SPIR-V: ${FILE_NAME}"
             )
             list(APPEND SPIRV_BINARY_FILES ${SPIRV_VK})
         endif()
 
-        if(ENABLE_GL_BACKEND)
+        if(ENABLE_GL_BACKEND AND NOT IS_MESH_STAGE)
             # OpenGL SPIR-V
             set(SPIRV_GL "${SHADER_OUTPUT_DIR}/${FILE_NAME}.gl.spv")
             add_custom_command(
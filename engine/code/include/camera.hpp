@@ -14,6 +14,10 @@ class Camera final : public hm::input::InputHandler, public hm::ecs::System
 
   glm::vec3 velocity;
   glm::vec3 position;
+  // position at the previous tick, the view is interpolated between the two
+  glm::vec3 previousPosition;
+  // units per second
+  float speed {30.f};
   // vertical rotation
   float pitch {0.f};
   // horizontal rotation
@@ -22,7 +26,7 @@ class Camera final : public hm::input::InputHandler, public hm::ecs::System
   glm::mat4 getViewMatrix() const;
   glm::mat4 getRotationMatrix() const;
 
-  void Update([[maybe_unused]] f32) override;
+  void Update(f32 dt) override;
   void Render() override;
   ~Camera() override;
   void HandleInput(SDL_Event* event) override;
@@ -0,0 +1,56 @@
+#pragma once
+#include "core/culling.hpp"
+
+#include <span>
+
+namespace hm::culling
+{
+struct Aabb
+{
+  glm::vec3 min {0.f};
+  glm::vec3 max {0.f};
+};
+
+// Bounding volume hierarchy over a fixed set of items, for culling scenes
+// that mostly stay where they are. Walking it against a frustum rejects or
+// accepts whole subtrees at once, so the cost follows what is visible rather
+// than the size of the scene. Moving items only needs a refit, which keeps
+// the tree and recomputes the bounds.
+class Bvh
+{
+ public:
+  Bvh() = default;
+
+  // Median split on the longest axis, items keep their index
+  void Build(std::span<const Aabb> items);
+  // Same items in the same order with new bounds
+  void Refit(std::span<const Aabb> items);
+  // Appends the index of every item that touches the frustum
+  void Query(const Frustum& frustum, std::vector<u32>& visible) const;
+
+  u32 GetItemCount() const { return static_cast<u32>(m_items.size()); }
+  u32 GetNodeCount() const { return static_cast<u32>(m_nodes.size()); }
+
+ private:
+  static constexpr u32 LeafSize {4};
+
+  // Nodes are stored parent first, the items of a subtree are one range of
+  // m_items, so a subtree inside the frustum is copied out in one go
+  struct Node
+  {
+    Aabb bounds {};
+    u32 firstItem {0};
+    u32 itemCount {0};
+    // children always come after their parent, 0 for leaves
+    u32 leftChild {0};
+    u32 rightChild {0};
+  };
+
+  u32 BuildNode(std::span<const Aabb> items, std::span<const glm::vec3> centers,
+                u32 firstItem, u32 itemCount);
+
+  std::vector<Node> m_nodes {};
+  // item indices in tree order
+  std::vector<u32> m_items {};
+};
+} // namespace hm::culling
@@ -0,0 +1,204 @@
+#pragma once
+#include "utility/macros.hpp"
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+
+namespace hm::ecs
+{
+using Entity = entt::entity;
+using Registry = entt::registry;
+
+class CommandBuffer;
+
+// Entity created through a command buffer, it only exists once the buffer is
+// played back and can only be used with the buffer that created it
+struct PendingEntity
+{
+  u32 index {0};
+  const CommandBuffer* owner {nullptr};
+};
+
+// Commands laid out back to back in blocks that never move, so recording is
+// a bump of the position and the blocks stay around for the next frame. A
+// command is a header with the functions that run and destroy it, then its
+// data.
+class CommandArena
+{
+ public:
+  CommandArena() = default;
+  ~CommandArena() { Reset(); }
+  HM_NON_COPYABLE_NON_MOVABLE(CommandArena);
+
+  // T has `void Execute(Registry&, std::span<const Entity>)`
+  template<typename T, typename... Args>
+  void Push(Args&&... args);
+  // Runs and destroys the commands in recording order
+  void Execute(Registry& registry, std::span<const Entity> created);
+  // Destroys the commands without running them, the blocks are kept
+  void Reset();
+  void Swap(CommandArena& other) noexcept;
+  bool IsEmpty() const { return m_first == nullptr; }
+  bool HasBlocks() const { return m_blocks.empty() == false; }
+
+ private:
+  static constexpr size_t BlockSize {16 * 1024};
+
+  struct Header
+  {
+    void (*execute)(void* command, Registry& registry,
+                    std::span<const Entity> created);
+    void (*destroy)(void* command);
+    void* command;
+    Header* next;
+  };
+  struct Block
+  {
+    std::unique_ptr<std::byte[]> data {};
+    size_t size {0};
+  };
+
+  void* Allocate(size_t size, size_t alignment);
+  void Append(Header* header);
+
+  std::vector<Block> m_blocks {};
+  // block and byte the next allocation goes to
+  size_t m_block {0};
+  size_t m_used {0};
+  Header* m_first {nullptr};
+  Header* m_last {nullptr};
+};
+
+// Records structural changes (create, emplace, remove, destroy) so they can be
+// made from worker or loader threads and applied to the registry later, in
+// one go, on the main thread. Every thread records into its own buffer, see
+// EntityComponentSystem::GetCommandBuffer.
+class CommandBuffer
+{
+ public:
+  CommandBuffer() = default;
+  ~CommandBuffer() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(CommandBuffer);
+
+  PendingEntity CreateEntity();
+  void DestroyEntity(Entity entity);
+
+  template<typename T, typename... Args>
+  void Emplace(Entity entity, Args&&... args);
+  template<typename T, typename... Args>
+  void Emplace(PendingEntity entity, Args&&... args);
+  template<typename T>
+  void Remove(Entity entity);
+
+  // Applies every recorded command in recording order and clears the buffer
+  void Playback(Registry& registry);
+  // Throws away everything recorded so far
+  void Clear();
+  bool IsEmpty() const;
+
+ private:
+  // either an existing entity or one created by this buffer
+  struct Target
+  {
+    Entity entity {entt::null};
+    u32 pendingIndex {~0u};
+
+    Entity Resolve(std::span<const Entity> created) const
+    {
+      if (pendingIndex == ~0u)
+      {
+        return entity;
+      }
+      SDL_assert(pendingIndex < created.size());
+      return created[pendingIndex];
+    }
+  };
+  template<typename T>
+  struct EmplaceCommand
+  {
+    template<typename... Args>
+    EmplaceCommand(Target target, Args&&... args)
+        : target(target), component {std::forward<Args>(args)...}
+    {
+    }
+    void Execute(Registry& registry, std::span<const Entity> created)
+    {
+      const Entity entity = target.Resolve(created);
+      if (registry.valid(entity))
+      {
+        registry.emplace_or_replace<T>(entity, std::move(component));
+      }
+    }
+
+    Target target;
+    T component;
+  };
+  template<typename T>
+  struct RemoveCommand
+  {
+    explicit RemoveCommand(Entity entity) : entity(entity) {}
+    void Execute(Registry& registry, std::span<const Entity>)
+    {
+      if (registry.valid(entity))
+      {
+        registry.remove<T>(entity);
+      }
+    }
+
+    Entity entity;
+  };
+
+  // recording is uncontended, the lock only matters while playing back
+  mutable std::mutex m_mutex {};
+  CommandArena m_commands {};
+  // entities that get destroyed are applied after all the other commands
+  std::vector<Entity> m_destroyed {};
+  u32 m_createdCount {0};
+};
+
+template<typename T, typename... Args>
+void CommandArena::Push(Args&&... args)
+{
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  Header* header =
+      static_cast<Header*>(Allocate(sizeof(Header), alignof(Header)));
+  T* command = new (Allocate(sizeof(T), alignof(T)))
+      T(std::forward<Args>(args)...);
+  header->execute = [](void* data, Registry& registry,
+                       std::span<const Entity> created)
+  {
+    static_cast<T*>(data)->Execute(registry, created);
+  };
+  header->destroy = [](void* data)
+  {
+    static_cast<T*>(data)->~T();
+  };
+  header->command = command;
+  header->next = nullptr;
+  Append(header);
+}
+
+template<typename T, typename... Args>
+void CommandBuffer::Emplace(Entity entity, Args&&... args)
+{
+  std::scoped_lock lock(m_mutex);
+  m_commands.Push<EmplaceCommand<T>>(Target {entity},
+                                     std::forward<Args>(args)...);
+}
+template<typename T, typename... Args>
+void CommandBuffer::Emplace(PendingEntity entity, Args&&... args)
+{
+  SDL_assert(entity.owner == this && "Pending entity of another buffer");
+  std::scoped_lock lock(m_mutex);
+  m_commands.Push<EmplaceCommand<T>>(Target {entt::null, entity.index},
+                                     std::forward<Args>(args)...);
+}
+template<typename T>
+void CommandBuffer::Remove(Entity entity)
+{
+  std::scoped_lock lock(m_mutex);
+  m_commands.Push<RemoveCommand<T>>(entity);
+}
+} // namespace hm::ecs
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <span>
+
+namespace hm::culling
+{
+// Six planes facing inwards, normalized so the plane equation gives the
+// signed distance. Order: left, right, bottom, top, near, far.
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes {};
+};
+
+// Extracts the planes of a view projection matrix with a 0..1 depth range,
+// works for reversed depth as well
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+struct WorldBounds
+{
+  glm::vec3 center {0.f};
+  f32 radius {0.f};
+  glm::vec3 extents {0.f};
+};
+
+// Moves local bounds into world space, the box stays axis aligned and grows
+// to fit the rotated one
+WorldBounds TransformBounds(const glm::mat4& transform, const glm::vec3& origin,
+                            f32 sphereRadius, const glm::vec3& extents);
+
+// World space bounds of many objects, one array per component so the culling
+// kernels can load a batch of objects with a single load per component
+struct BoundsSoA
+{
+  std::vector<f32> centerX {};
+  std::vector<f32> centerY {};
+  std::vector<f32> centerZ {};
+  std::vector<f32> radius {};
+  std::vector<f32> extentX {};
+  std::vector<f32> extentY {};
+  std::vector<f32> extentZ {};
+
+  u32 GetCount() const { return static_cast<u32>(centerX.size()); }
+  void Clear();
+  void Reserve(u32 count);
+  // Adds the bounds moved into world space, returns the index of the object
+  u32 Add(const glm::mat4& transform, const glm::vec3& origin, f32 sphereRadius,
+          const glm::vec3& extents);
+  // Same as Add, for an object that is already there
+  void Set(u32 index, const glm::mat4& transform, const glm::vec3& origin,
+           f32 sphereRadius, const glm::vec3& extents);
+  // Copies one object of `source`, as a new one or over an existing one
+  u32 Append(const BoundsSoA& source, u32 sourceIndex);
+  void Copy(u32 index, const BoundsSoA& source, u32 sourceIndex);
+  // Moves the last object into `index`
+  void SwapRemove(u32 index);
+};
+
+// Writes the index of every object in [first, first + count) whose sphere and
+// box are both at least partly inside the frustum, `visible` needs room for
+// `count` indices. Returns how many were written, in ascending order.
+u32 Cull(const Frustum& frustum, const BoundsSoA& bounds, u32 first, u32 count,
+         u32* visible);
+// Same test for the objects listed in `candidates`, the ones inside are
+// written in the order of the list. `visible` can point to the candidates.
+u32 Cull(const Frustum& frustum, const BoundsSoA& bounds,
+         std::span<const u32> candidates, u32* visible);
+
+// Name of the kernel Cull uses on this CPU: "AVX2", "SSE" or "Scalar"
+const char* GetKernelName();
+} // namespace hm::culling
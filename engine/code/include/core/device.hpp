@@ -67,8 +67,12 @@ class Device
 struct EngineStats
 {
   float frametime;
+  // simulation ticks run during the last frame
+  int tick_count;
   int triangle_count;
   int drawcall_count;
+  // render objects uploaded to the GPU during the last frame
+  int object_upload_count;
   float scene_update_time;
   float mesh_draw_time;
 };
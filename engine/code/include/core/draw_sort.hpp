@@ -0,0 +1,51 @@
+#pragma once
+
+#include <span>
+
+namespace hm::gpx
+{
+// Bits of a draw key, from the most significant end. Draws are grouped by
+// pipeline, then material, then mesh, and go front to back inside a group.
+constexpr u32 PipelineKeyBits {6};
+constexpr u32 MaterialKeyBits {18};
+constexpr u32 MeshKeyBits {16};
+constexpr u32 DepthKeyBits {24};
+
+// Ids wrap around when they do not fit, which only costs some state changes
+u64 MakeDrawKey(u32 pipeline, u32 material, u32 mesh, u32 depth);
+// Logarithmic, so close draws keep their order at any view distance
+u32 QuantizeDepth(f32 depth, f32 nearPlane, f32 farPlane);
+
+// LSD radix sort on 8 bit digits, stable. Passes where every key has the
+// same digit are skipped, which is most of them for typical draw keys.
+void RadixSort(std::span<u64> keys, std::span<u32> values,
+               std::vector<u64>& keyScratch, std::vector<u32>& valueScratch);
+
+// Sorts the draw list of a frame. With frame coherence on, a frame whose
+// visible list is the same as the one before starts from the order of that
+// frame and only fixes up what moved, which is linear when little changed.
+class DrawSorter
+{
+ public:
+  // Sorts `values` by `keys`, both end up in sorted order
+  void Sort(std::vector<u64>& keys, std::vector<u32>& values);
+
+  bool m_bFrameCoherent {true};
+  // Whether the last Sort could start from the order of the frame before
+  bool WasReused() const { return m_bReused; }
+
+ private:
+  // at most this many moves per draw before falling back to the radix sort
+  static constexpr u32 MoveBudgetDivisor {8};
+
+  bool TryReuse(const std::vector<u64>& keys);
+
+  std::vector<u32> m_previousInput {};
+  // position in the input of every sorted draw, last frame and this one
+  std::vector<u32> m_order {};
+  std::vector<u64> m_sortedKeys {};
+  std::vector<u64> m_keyScratch {};
+  std::vector<u32> m_valueScratch {};
+  bool m_bReused {false};
+};
+} // namespace hm::gpx
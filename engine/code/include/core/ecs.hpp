@@ -1,5 +1,8 @@
 ﻿#pragma once
 #include "utility/macros.hpp"
+#include "core/commands.hpp"
+#include "core/scheduler.hpp"
+#include "core/snapshot.hpp"
 
 namespace hm
 {
@@ -7,11 +10,37 @@ class Engine;
 }
 namespace hm::ecs
 {
-using Entity = entt::entity;
-using Registry = entt::registry;
 struct DeleteFlag
 {
 };
+template<typename T>
+constexpr ComponentId GetComponentId()
+{
+  return entt::type_hash<T>::value();
+}
+using SystemTypeIndex = u32;
+namespace internal
+{
+SystemTypeIndex NextSystemTypeIndex();
+}
+// Dense index per system type, handed out the first time a type is used
+template<typename T>
+SystemTypeIndex GetSystemTypeIndex()
+{
+  static const SystemTypeIndex index = internal::NextSystemTypeIndex();
+  return index;
+}
+// Components a system touches during Update, used by the scheduler to find
+// out which systems can run at the same time
+struct SystemAccess
+{
+  std::vector<ComponentId> reads {};
+  std::vector<ComponentId> writes {};
+  // Systems that never declared their access are assumed to touch everything
+  bool bExclusive {true};
+
+  bool ConflictsWith(const SystemAccess& other) const;
+};
 struct System
 
 {
@@ -19,12 +48,111 @@ struct System
   virtual ~System() = default;
   HM_NON_COPYABLE_NON_MOVABLE(System);
 
+  // Can be called from any worker thread, only touch the components declared
+  // with Reads/Writes and the state owned by the system
   virtual void Update(f32) = 0;
+  // Always called from the main thread, in registration order
   virtual void Render() = 0;
+  // Called after a snapshot replaced the registry. The destroy signals of the
+  // old entities already ran, drop whatever still refers to them.
+  virtual void OnSnapshotLoaded() {}
+
+  // Declares the components read during Update, call from the constructor
+  template<typename... T>
+  void Reads();
+  // Declares the components written during Update, call from the constructor
+  template<typename... T>
+  void Writes();
+  // The system updates and renders after the given systems, call from the
+  // constructor
+  template<typename... T>
+  void RunAfter();
+  // The system updates and renders before the given systems, call from the
+  // constructor
+  template<typename... T>
+  void RunBefore();
 
   std::string m_name {};
-  // Used to sort the systems
+  // Used to sort the systems, lower runs first, ties keep registration order
   u32 m_priority {};
+  SystemAccess m_access {};
+  std::vector<SystemTypeIndex> m_runAfter {};
+  std::vector<SystemTypeIndex> m_runBefore {};
+  // Set by EntityComponentSystem::CreateSystem
+  SystemTypeIndex m_typeIndex {~0u};
+
+  // True when this system has to finish before `other` starts
+  bool IsOrderedBefore(const System& other) const;
+};
+template<typename... T>
+void System::Reads()
+{
+  (m_access.reads.push_back(GetComponentId<T>()), ...);
+  m_access.bExclusive = false;
+}
+template<typename... T>
+void System::Writes()
+{
+  (m_access.writes.push_back(GetComponentId<T>()), ...);
+  m_access.bExclusive = false;
+}
+template<typename... T>
+void System::RunAfter()
+{
+  (m_runAfter.push_back(GetSystemTypeIndex<T>()), ...);
+}
+template<typename... T>
+void System::RunBefore()
+{
+  (m_runBefore.push_back(GetSystemTypeIndex<T>()), ...);
+}
+// Systems known at compile time, updated and rendered in the listed order
+// with direct calls instead of going through the vtable. They are not part
+// of the scheduler, so they run on the calling thread.
+template<typename... Ts>
+class StaticSystemList
+{
+ public:
+  template<typename T, typename... Args>
+  T& Create(Args&&... args)
+  {
+    auto& system = std::get<std::unique_ptr<T>>(m_systems);
+    system = std::make_unique<T>(std::forward<Args>(args)...);
+    return *system;
+  }
+  template<typename T>
+  T& Get()
+  {
+    return *std::get<std::unique_ptr<T>>(m_systems);
+  }
+
+  void Update(f32 dt)
+  {
+    (
+        [&](Ts* system)
+        {
+          if (system != nullptr)
+          {
+            system->Ts::Update(dt);
+          }
+        }(std::get<std::unique_ptr<Ts>>(m_systems).get()),
+        ...);
+  }
+  void Render()
+  {
+    (
+        [](Ts* system)
+        {
+          if (system != nullptr)
+          {
+            system->Ts::Render();
+          }
+        }(std::get<std::unique_ptr<Ts>>(m_systems).get()),
+        ...);
+  }
+
+ private:
+  std::tuple<std::unique_ptr<Ts>...> m_systems {};
 };
 class EntityComponentSystem
 {
@@ -51,40 +179,97 @@ class EntityComponentSystem
   bool HasComponent(Entity entity);
   //  Creates and returns the entity id
   Entity CreateEntity();
-  // Adds a DeleteFlag component to the specified entity
+  // Adds a DeleteFlag component to the specified entity once the commands are
+  // flushed, safe to call from any thread
   void QueueEntityDeletion(Entity entity);
   void DeleteEntity(Entity entity);
   // This will get all entities that have a  DeleteFlag component and
   // delete them
   void DeleteEntities();
 
+  // Commands
+  // Buffer owned by the calling thread, use it for structural changes made
+  // outside of the main thread
+  CommandBuffer& GetCommandBuffer();
+  // Plays back the command buffers of every thread and deletes the flagged
+  // entities, the only place where deferred changes reach the registry
+  void FlushCommands();
+
+  // Direct access for bulk work, like batched emplaces of whole component
+  // arrays. Only from the main thread and outside of system updates.
+  Registry& GetRegistry() { return m_registry; }
+
+  // Snapshots
+  // Makes T part of saved snapshots, see SnapshotSerializer::Register
+  template<typename T>
+  void RegisterSnapshotComponent(ComponentId id = GetComponentId<T>());
+  std::vector<std::byte> SaveSnapshot() const;
+  bool SaveSnapshot(const std::filesystem::path& path) const;
+  // Replaces every entity and component, pending commands are dropped and
+  // every system is told through System::OnSnapshotLoaded
+  bool LoadSnapshot(std::span<const std::byte> snapshot);
+  // Maps the file and restores it
+  bool LoadSnapshot(const std::filesystem::path& path);
+
   // Components
  private:
   Registry m_registry {};
   EntityComponentSystem() = default;
   ~EntityComponentSystem() = default;
+  // Sorts the systems by priority and before/after constraints
+  void SortSystems();
+  // Clears the command buffers of every thread without playing them back
+  void DropCommands();
+  void NotifySnapshotLoaded();
+
+  // in registration order
   std::vector<std::unique_ptr<System>> m_systems {};
+  // in execution order
+  std::vector<System*> m_sortedSystems {};
+  // indexed by SystemTypeIndex
+  std::vector<System*> m_systemsByType {};
+  bool m_bSystemsDirty {false};
+  SystemScheduler m_scheduler {};
+
+  // one per thread that recorded something, played back in creation order
+  std::mutex m_commandBufferMutex {};
+  std::vector<std::unique_ptr<CommandBuffer>> m_commandBuffers {};
+
+  SnapshotSerializer m_snapshotSerializer {};
   friend class hm::Engine;
 };
 template<typename T, typename... Args>
 T& EntityComponentSystem::CreateSystem(Args&&... args)
 {
+  static_assert(std::is_base_of_v<System, T>);
+  const SystemTypeIndex index = GetSystemTypeIndex<T>();
+  if (index >= m_systemsByType.size())
+  {
+    m_systemsByType.resize(index + 1, nullptr);
+  }
+  SDL_assert(m_systemsByType[index] == nullptr);
+
   T* system = new T(std::forward<Args>(args)...);
+  system->m_typeIndex = index;
   m_systems.emplace_back(std::unique_ptr<System>(system));
-  // sort based on priority?
+  m_systemsByType[index] = system;
+  m_bSystemsDirty = true;
   return *system;
 }
 template<typename T>
 T& EntityComponentSystem::GetSystem()
 {
-  auto it = std::find_if(m_systems.begin(), m_systems.end(),
-                         [](const auto& system)
-                         {
-                           return dynamic_cast<T*>(system.get()) != nullptr;
-                         });
+  static_assert(std::is_base_of_v<System, T>);
+  const SystemTypeIndex index = GetSystemTypeIndex<T>();
+  SDL_assert(index < m_systemsByType.size() &&
+             m_systemsByType[index] != nullptr);
+  return *static_cast<T*>(m_systemsByType[index]);
+}
 
-  SDL_assert(it != m_systems.end());
-  return *dynamic_cast<T*>(it->get());
+template<typename T>
+void EntityComponentSystem::RegisterSnapshotComponent(ComponentId id)
+{
+  m_snapshotSerializer.Register<T>(id);
 }
 
 template<typename T>
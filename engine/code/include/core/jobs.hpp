@@ -0,0 +1,128 @@
+#pragma once
+#include "utility/macros.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace hm::jobs
+{
+using Job = std::function<void()>;
+
+// Tracks a group of jobs, it reaches zero once every job scheduled with it
+// has finished. Jobs scheduled with ScheduleAfter are started at that point.
+// Only destroy a counter after JobSystem::Wait returned for it.
+class Counter
+{
+ public:
+  Counter() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(Counter);
+
+  bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+ private:
+  std::atomic<u32> m_count {0};
+  // guards the continuations and the final decrement
+  mutable std::mutex m_mutex {};
+  std::vector<Job> m_continuations {};
+
+  friend class JobSystem;
+};
+
+struct JobSystemDesc
+{
+  // 0 picks one worker per hardware thread, minus the main thread
+  u32 workerCount {0};
+  // pins every worker to its own core, the main thread keeps the first one
+  bool bPinWorkers {false};
+  // when pinning, skip the SMT siblings of cores that already have a worker
+  bool bPhysicalCoresOnly {true};
+  // explicit list of logical processors to pin the workers to, overrides the
+  // detected topology when not empty
+  std::vector<u32> affinity {};
+};
+
+// Work-stealing job system shared by the whole engine. Every worker owns a
+// deque, it pops its own jobs from the back and steals from the front of the
+// other deques when it runs dry. The main thread is worker 0 and helps out
+// while waiting on a counter.
+class JobSystem
+{
+ public:
+  explicit JobSystem(const JobSystemDesc& desc = {});
+  ~JobSystem();
+  HM_NON_COPYABLE_NON_MOVABLE(JobSystem);
+
+  void Schedule(Job&& job, Counter* counter = nullptr);
+  // Starts the job once `dependency` reaches zero, right away if it already is
+  void ScheduleAfter(Counter& dependency, Job&& job,
+                     Counter* counter = nullptr);
+  // Runs other jobs on the calling thread until the counter reaches zero
+  void Wait(const Counter& counter);
+
+  // Splits [0, count) into chunks of at most grainSize and calls
+  // func(begin, end) for each of them, returns once all chunks are done
+  template<typename Func>
+  void ParallelFor(u32 count, u32 grainSize, Func&& func);
+
+  // Worker threads plus the main thread
+  u32 GetThreadCount() const { return static_cast<u32>(m_queues.size()); }
+  // Index of the calling thread in [0, GetThreadCount()), 0 for the main
+  // thread and for threads that are not owned by the job system
+  static u32 GetThreadIndex();
+
+  // One logical processor per physical core, ordered by core
+  static std::vector<u32> QueryPhysicalCores();
+
+ private:
+  struct alignas(64) WorkQueue
+  {
+    std::mutex mutex {};
+    std::deque<Job> jobs {};
+  };
+
+  void WorkerLoop(u32 threadIndex);
+  bool TryRunJob(u32 threadIndex);
+  bool PopJob(u32 threadIndex, Job& job);
+  void Finish(Counter* counter);
+  void PinThread(std::thread& thread, u32 logicalProcessor) const;
+
+  std::vector<std::unique_ptr<WorkQueue>> m_queues {};
+  std::vector<std::thread> m_workers {};
+  // number of queued jobs, workers sleep on it while it is zero
+  std::atomic<u32> m_queuedJobs {0};
+  std::atomic<bool> m_bStop {false};
+};
+
+template<typename Func>
+void JobSystem::ParallelFor(u32 count, u32 grainSize, Func&& func)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  grainSize = std::max(grainSize, 1u);
+  // not worth the scheduling overhead
+  if (count <= grainSize || GetThreadCount() == 1)
+  {
+    func(0u, count);
+    return;
+  }
+
+  Counter counter;
+  for (u32 begin = grainSize; begin < count; begin += grainSize)
+  {
+    const u32 end = std::min(begin + grainSize, count);
+    Schedule(
+        [&func, begin, end]()
+        {
+          func(begin, end);
+        },
+        &counter);
+  }
+  // the calling thread takes the first chunk itself
+  func(0u, std::min(grainSize, count));
+  Wait(counter);
+}
+} // namespace hm::jobs
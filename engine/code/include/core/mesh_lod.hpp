@@ -0,0 +1,48 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+namespace hm::gpx
+{
+// Levels of detail of a surface at most, the full one included. Every level
+// has about half the triangles of the one before.
+constexpr u32 MeshLodMaxCount {8};
+// Returned by SelectLod for objects too small to draw
+constexpr u32 CulledLod {~0u};
+
+// One level of detail, a range of the same index buffer
+struct MeshLod
+{
+  u32 firstIndex {0};
+  u32 indexCount {0};
+  // how far the triangles can be from the full surface, in mesh space
+  f32 error {0.f};
+};
+
+struct LodSettings
+{
+  // pixels one unit covers one unit in front of the camera,
+  // projection[1][1] * height / 2
+  f32 pixelsPerUnit {0.f};
+  // the coarsest level whose error stays under this many pixels is drawn
+  f32 errorPixels {1.f};
+  // objects whose sphere covers fewer pixels across are not drawn
+  f32 minPixelSize {1.f};
+};
+
+// Appends coarser versions of the surface in [firstIndex, firstIndex +
+// indexCount) to `indices` and the chain of levels, the full one first, to
+// `lods`. The vertices are clustered on a grid and every cluster keeps one of
+// its vertices, so the levels use the same vertex buffer. Returns how many
+// levels were added.
+u32 BuildLods(std::vector<u32>& indices, u32 firstIndex, u32 indexCount,
+              std::span<const glm::vec3> positions, std::vector<MeshLod>& lods);
+
+// Picks the level of an object with a world bounding sphere, `errorScale`
+// takes the errors from mesh to world space. CulledLod when it is smaller than
+// the minimum size, 0 without levels.
+u32 SelectLod(std::span<const MeshLod> lods, const glm::vec3& center,
+              f32 radius, f32 errorScale, const glm::vec3& cameraPosition,
+              const LodSettings& settings);
+} // namespace hm::gpx
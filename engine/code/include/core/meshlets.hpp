@@ -0,0 +1,51 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+namespace hm::gpx
+{
+// Sizes of a meshlet. 64 vertices and 124 triangles fill one mesh shader
+// workgroup and keep the triangles of a meshlet in under 512 bytes.
+constexpr u32 MeshletMaxVertices {64};
+constexpr u32 MeshletMaxTriangles {124};
+
+// A few neighbouring triangles of a mesh, culled on their own
+struct Meshlet
+{
+  // bounding sphere, in the space of the mesh
+  glm::vec3 center {0.f};
+  f32 radius {0.f};
+  // the triangles all face away from a camera at p when
+  // dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius,
+  // a cutoff of 1 never culls
+  glm::vec3 coneAxis {0.f, 0.f, 1.f};
+  f32 coneCutoff {1.f};
+  // triangles of the meshlet in the index buffer
+  u32 firstIndex {0};
+  u32 triangleCount {0};
+  // ranges of MeshletSet::vertices and MeshletSet::triangles
+  u32 vertexOffset {0};
+  u32 vertexCount {0};
+  u32 triangleOffset {0};
+};
+
+// Meshlets of a mesh, with the vertices and triangles a mesh shader reads
+struct MeshletSet
+{
+  std::vector<Meshlet> meshlets {};
+  // vertex of the mesh behind every meshlet vertex
+  std::vector<u32> vertices {};
+  // a byte per corner, meshlet vertex indices
+  std::vector<u32> triangles {};
+};
+
+// Splits the triangles of `indices` into meshlets appended to `set`. A
+// meshlet grows over the triangles that share its vertices, the ones that
+// add the fewest new vertices first. The triangles are reordered so every
+// meshlet is a run of the range, which draws the same as before.
+// `firstIndex` is where the range starts in the index buffer. Returns how
+// many meshlets were added.
+u32 BuildMeshlets(std::span<u32> indices, u32 firstIndex,
+                  std::span<const glm::vec3> positions, MeshletSet& set);
+} // namespace hm::gpx
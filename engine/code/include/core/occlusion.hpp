@@ -0,0 +1,103 @@
+#pragma once
+#include "core/culling.hpp"
+#include "utility/macros.hpp"
+
+#include <array>
+#include <vector>
+
+namespace hm::jobs
+{
+class JobSystem;
+}
+
+namespace hm::culling
+{
+// Triangles of an occluder in its local space
+struct OccluderMesh
+{
+  std::vector<glm::vec3> positions {};
+  std::vector<u32> indices {};
+};
+
+// Low resolution depth buffer the occluders are rasterized into on the CPU,
+// for when the GPU does not cull by itself. Pixels sit in tiles of 4x4 with
+// a row of a tile in one SSE register, and every tile keeps its farthest
+// depth so most tests are decided per tile. Depth is reversed like the
+// renderer's: bigger is nearer, 0 is nothing.
+class OcclusionBuffer
+{
+ public:
+  static constexpr u32 TileSize {4};
+
+  OcclusionBuffer() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(OcclusionBuffer);
+
+  // Rounded up to whole tiles
+  void Resize(u32 width, u32 height);
+  // Starts a frame seen through `viewProj` and forgets the occluders
+  void Begin(const glm::mat4& viewProj);
+  // The mesh has to live until Rasterize returned
+  void AddOccluder(const OccluderMesh& mesh, const glm::mat4& transform);
+  // Sets up the triangles of every occluder, then fills the buffer one row
+  // of tiles per job
+  void Rasterize(jobs::JobSystem& jobSystem);
+
+  // Whether the world box is behind the occluders. Boxes that reach past
+  // the near plane never are. Safe from many threads after Rasterize.
+  bool IsOccluded(const glm::vec3& center, const glm::vec3& extents) const;
+  // Keeps the indices into `bounds` that are not occluded, in order, and
+  // returns how many are left
+  u32 RemoveOccluded(const BoundsSoA& bounds, u32* indices, u32 count) const;
+
+  u32 GetWidth() const { return m_width; }
+  u32 GetHeight() const { return m_height; }
+  // occluder triangles rasterized by the last Rasterize
+  u32 GetTriangleCount() const { return m_triangleCount; }
+
+ private:
+  struct Occluder
+  {
+    const OccluderMesh* mesh {nullptr};
+    glm::mat4 transform {1.f};
+  };
+
+  // Screen space triangle, an edge function is edgeX * x + edgeY * y +
+  // edgeC and the pixel centers where all three are >= 0 are inside
+  struct Triangle
+  {
+    std::array<f32, 3> edgeX {};
+    std::array<f32, 3> edgeY {};
+    std::array<f32, 3> edgeC {};
+    // depth plane, moved to the farthest corner of the pixel
+    f32 depthX {0.f};
+    f32 depthY {0.f};
+    f32 depthC {0.f};
+    f32 minDepth {0.f};
+    // pixels, inclusive
+    i32 minX {0};
+    i32 minY {0};
+    i32 maxX {0};
+    i32 maxY {0};
+  };
+
+  void SetupTriangles(const Occluder& occluder,
+                      std::vector<Triangle>& triangles) const;
+  // the corners are clip space positions in front of the near plane
+  void AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c,
+                   std::vector<Triangle>& triangles) const;
+  void RasterizeTileRow(u32 tileRow);
+
+  u32 m_width {0};
+  u32 m_height {0};
+  u32 m_tilesX {0};
+  u32 m_tilesY {0};
+  glm::mat4 m_viewProj {1.f};
+  std::vector<Occluder> m_occluders {};
+  // per occluder
+  std::vector<std::vector<Triangle>> m_triangles {};
+  u32 m_triangleCount {0};
+  // tile after tile, rows of a tile one after the other
+  std::vector<f32> m_depth {};
+  std::vector<f32> m_tileFarthest {};
+};
+} // namespace hm::culling
@@ -12,5 +12,11 @@ class Renderer : public ecs::System
   void Update(f32) override;
 
   void Render() override;
+  void OnSnapshotLoaded() override;
+
+  // Records and submits frames on a dedicated thread while the main thread
+  // moves on to the next frame, not supported by every backend
+  void SetThreadedRendering(bool enabled);
+  bool IsThreadedRendering() const;
 };
 } // namespace hm::gpx
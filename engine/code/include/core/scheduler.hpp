@@ -0,0 +1,56 @@
+#pragma once
+#include "utility/macros.hpp"
+
+#include <atomic>
+#include <span>
+
+namespace hm::jobs
+{
+class Counter;
+class JobSystem;
+} // namespace hm::jobs
+namespace hm::ecs
+{
+struct System;
+
+// Runs System::Update for every registered system, in parallel where the
+// declared component access allows it. Two systems are ordered (in the
+// given order) only if one of them writes a component the other one reads or
+// writes, or if they have an explicit before/after constraint. Every other
+// pair is free to run at the same time. The systems run as jobs on the engine
+// job system.
+class SystemScheduler
+{
+ public:
+  SystemScheduler() = default;
+  ~SystemScheduler() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(SystemScheduler);
+
+  // Forces the dependency graph to be rebuilt before the next update
+  void Invalidate() { m_bDirty = true; }
+  void Update(std::span<System* const> systems, f32 dt);
+
+  // Number of dependency levels of the current graph, 1 means everything runs
+  // in parallel and the system count means everything runs serially
+  u32 GetCriticalPathLength() const { return m_criticalPathLength; }
+
+ private:
+  struct Node
+  {
+    System* system {nullptr};
+    // systems that have to wait for this one to finish
+    std::vector<u32> dependents {};
+    u32 dependencyCount {0};
+  };
+
+  void Build(std::span<System* const> systems);
+  void Execute(u32 nodeIndex, jobs::JobSystem& jobSystem,
+               jobs::Counter& counter);
+
+  std::vector<Node> m_nodes {};
+  std::unique_ptr<std::atomic<u32>[]> m_pendingDependencies {};
+  u32 m_criticalPathLength {0};
+  bool m_bDirty {true};
+  f32 m_deltaTime {0.f};
+};
+} // namespace hm::ecs
@@ -0,0 +1,150 @@
+#pragma once
+#include "core/commands.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <span>
+
+namespace hm::ecs
+{
+using ComponentId = entt::id_type;
+
+// Binary layout of a snapshot, everything is stored in native byte order:
+//   SnapshotHeader
+//   SnapshotColumn for every component type
+//   entity column, the whole entity storage including released entities
+//   per component type: entity column, then the packed component values
+// Every column starts on a SnapshotAlignment boundary, so a mapped file can
+// be read in place and copied into the registry with bulk inserts.
+constexpr u32 SnapshotMagic {0x4e534d48}; // "HMSN"
+// Bump whenever the layout above changes, older snapshots are rejected
+constexpr u32 SnapshotVersion {1};
+constexpr u64 SnapshotAlignment {64};
+
+struct SnapshotHeader
+{
+  u32 magic {SnapshotMagic};
+  u32 version {SnapshotVersion};
+  u32 entityCount {0};
+  // entities in [0, aliveCount) of the entity column are alive
+  u32 aliveCount {0};
+  u32 columnCount {0};
+  u32 entitySize {sizeof(Entity)};
+  u64 entitiesOffset {0};
+  u64 totalSize {0};
+};
+
+struct SnapshotColumn
+{
+  ComponentId id {0};
+  // 0 for empty (tag) components, they only store their entities
+  u32 componentSize {0};
+  u32 count {0};
+  u64 entitiesOffset {0};
+  u64 componentsOffset {0};
+};
+
+// Saves registries to the snapshot format and restores them. Only the entity
+// storage and the registered components are part of a snapshot, components
+// have to be trivially copyable since they are written and read as raw bytes.
+// State owned by systems is not included, they drop it when a snapshot is
+// loaded, see System::OnSnapshotLoaded.
+class SnapshotSerializer
+{
+ public:
+  SnapshotSerializer() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(SnapshotSerializer);
+
+  // `id` identifies the column in the file, the default is derived from the
+  // type name, which can differ between compilers
+  template<typename T>
+  void Register(ComponentId id = entt::type_hash<T>::value());
+
+  u64 ComputeSize(const Registry& registry) const;
+  // `out` has to be ComputeSize bytes
+  void Write(const Registry& registry, std::span<std::byte> out) const;
+  std::vector<std::byte> Save(const Registry& registry) const;
+  bool Save(const Registry& registry, const std::filesystem::path& path) const;
+
+  // Replaces everything in the registry with the snapshot, entities keep
+  // their identifiers. Columns of unregistered types are skipped.
+  bool Load(Registry& registry, std::span<const std::byte> snapshot) const;
+  // Maps the file instead of reading it
+  bool Load(Registry& registry, const std::filesystem::path& path) const;
+
+ private:
+  struct ComponentType
+  {
+    ComponentId id {0};
+    u32 componentSize {0};
+    u32 (*count)(const Registry&, ComponentId) {nullptr};
+    // writes the entities and the packed values, in storage order
+    void (*write)(const Registry&, ComponentId, Entity*, std::byte*) {nullptr};
+    // emplaces `count` values for the given entities
+    void (*read)(Registry&, ComponentId, const Entity*, const std::byte*,
+                 u32) {nullptr};
+  };
+
+  const ComponentType* Find(ComponentId id) const;
+
+  std::vector<ComponentType> m_types {};
+};
+
+template<typename T>
+void SnapshotSerializer::Register(ComponentId id)
+{
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Snapshot components are copied as raw bytes");
+  static_assert(alignof(T) <= SnapshotAlignment);
+  static_assert(entt::component_traits<T>::in_place_delete == false,
+                "Storages with tombstones are not packed");
+  SDL_assert(Find(id) == nullptr && "Component registered twice");
+
+  constexpr bool bEmpty = std::is_empty_v<T>;
+  ComponentType type;
+  type.id = id;
+  type.componentSize = bEmpty ? 0 : static_cast<u32>(sizeof(T));
+  type.count = [](const Registry& registry, ComponentId storageId)
+  {
+    const auto* storage = registry.storage<T>(storageId);
+    return storage == nullptr ? 0u : static_cast<u32>(storage->size());
+  };
+  type.write = [](const Registry& registry, ComponentId storageId,
+                  Entity* entities, std::byte* components)
+  {
+    const auto& storage = *registry.storage<T>(storageId);
+    const size_t count = storage.size();
+    std::memcpy(entities, storage.data(), count * sizeof(Entity));
+    if constexpr (bEmpty == false)
+    {
+      // the values live in pages, copy them one page at a time
+      constexpr size_t pageSize = entt::component_traits<T>::page_size;
+      const auto* pages = storage.raw();
+      for (size_t first = 0, page = 0; first < count;
+           first += pageSize, page++)
+      {
+        const size_t length = std::min(pageSize, count - first);
+        std::memcpy(components + first * sizeof(T), pages[page],
+                    length * sizeof(T));
+      }
+    }
+  };
+  type.read = [](Registry& registry, ComponentId storageId,
+                 const Entity* entities, const std::byte* components,
+                 u32 count)
+  {
+    auto& storage = registry.storage<T>(storageId);
+    if constexpr (bEmpty)
+    {
+      storage.insert(entities, entities + count);
+    }
+    else
+    {
+      // the column is aligned for T and T is trivially copyable
+      const T* values = reinterpret_cast<const T*>(components);
+      storage.insert(entities, entities + count, values);
+    }
+  };
+  m_types.push_back(type);
+}
+} // namespace hm::ecs
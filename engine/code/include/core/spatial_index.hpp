@@ -0,0 +1,123 @@
+#pragma once
+#include "core/bvh.hpp"
+#include "core/transform.hpp"
+
+#include <optional>
+#include <unordered_map>
+
+namespace hm::ecs
+{
+using ProxyId = u32;
+constexpr ProxyId InvalidProxy = ~0u;
+
+// Links an entity to its proxy in the SpatialIndex
+struct SpatialProxy
+{
+  ProxyId id {InvalidProxy};
+};
+
+struct RayHit
+{
+  Entity entity {entt::null};
+  f32 distance {0.f};
+};
+
+// Hierarchical loose grid over the world bounds of moving entities. Every
+// level doubles the cell size, a proxy goes into the level whose cells are at
+// least as big as the proxy, in the cell holding its center. Cells are looked
+// up through a hash, so the world has no fixed size, and a proxy reaches at
+// most half a cell past its cell, which keeps moving one O(1): update the
+// bounds, and swap it into another cell when the center crossed over.
+//
+// Proxies linked to a transform follow it during Update, and go away with the
+// SpatialProxy component of their entity. Queries read the index, so they run
+// outside of system updates or from systems ordered after this one.
+class SpatialIndex final : public System
+{
+ public:
+  SpatialIndex(const std::string& name, const TransformSystem& transforms,
+               f32 smallestCellSize = 1.f);
+  ~SpatialIndex() override;
+
+  // `bounds` are in the space of `transform`, or in world space without one
+  ProxyId Insert(Entity entity, const culling::Aabb& bounds,
+                 TransformId transform = InvalidTransform);
+  void Remove(ProxyId id);
+  // New world bounds, for proxies that are not linked to a transform
+  void Move(ProxyId id, const culling::Aabb& bounds);
+  const culling::Aabb& GetBounds(ProxyId id) const
+  {
+    return m_proxies[id].bounds;
+  }
+  Entity GetEntity(ProxyId id) const { return m_proxies[id].entity; }
+  u32 GetCount() const { return m_proxyCount; }
+
+  // The queries append every entity whose bounds touch the shape
+  void QueryFrustum(const culling::Frustum& frustum,
+                    std::vector<Entity>& entities) const;
+  void QueryAabb(const culling::Aabb& box, std::vector<Entity>& entities) const;
+  void QuerySphere(const glm::vec3& center, f32 radius,
+                   std::vector<Entity>& entities) const;
+  // Closest bounds hit by the ray within `maxDistance`, `direction` has to be
+  // normalized
+  std::optional<RayHit> Raycast(const glm::vec3& origin,
+                                const glm::vec3& direction,
+                                f32 maxDistance) const;
+
+  void Update(f32) override;
+  void Render() override {}
+  // Drops every proxy, the ids in restored SpatialProxy components are stale
+  void OnSnapshotLoaded() override;
+
+ private:
+  static constexpr u32 LevelCount {20};
+
+  struct Proxy
+  {
+    Entity entity {entt::null};
+    culling::Aabb bounds {};
+    culling::Aabb localBounds {};
+    TransformId transform {InvalidTransform};
+    u32 level {0};
+    u32 cell {0};
+    // position in the proxy list of the cell
+    u32 slot {0};
+  };
+
+  struct Cell
+  {
+    glm::ivec3 coord {0};
+    std::vector<ProxyId> proxies {};
+  };
+
+  struct Level
+  {
+    f32 cellSize {0.f};
+    std::unordered_map<u64, u32> cellOfKey {};
+    // empty cells are recycled through the free list
+    std::vector<Cell> cells {};
+    std::vector<u32> freeCells {};
+    u32 occupiedCount {0};
+  };
+
+  void OnProxyDestroyed(Registry& registry, Entity entity);
+  u32 LevelOf(const culling::Aabb& bounds) const;
+  glm::ivec3 CoordOf(const culling::Aabb& bounds, u32 level) const;
+  // Cell grown by half a cell on every side, everything inside lies in it
+  culling::Aabb LooseBounds(const Level& level, const Cell& cell) const;
+  void AddToCell(ProxyId id);
+  void RemoveFromCell(ProxyId id);
+  // Calls visit(bounds, entity) for every proxy in a cell whose loose bounds
+  // overlap `range` and pass `overlaps`
+  template<typename Overlaps, typename Visit>
+  void ForEachCandidate(const culling::Aabb& range, Overlaps&& overlaps,
+                        Visit&& visit) const;
+
+  Registry& m_registry;
+  const TransformSystem& m_transforms;
+  std::array<Level, LevelCount> m_levels {};
+  std::vector<Proxy> m_proxies {};
+  std::vector<ProxyId> m_freeProxies {};
+  u32 m_proxyCount {0};
+};
+} // namespace hm::ecs
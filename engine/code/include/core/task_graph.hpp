@@ -0,0 +1,54 @@
+#pragma once
+#include "core/jobs.hpp"
+
+#include <chrono>
+#include <initializer_list>
+
+namespace hm::jobs
+{
+using TaskId = u32;
+
+// One-shot graph of named jobs, meant for work like engine startup where a
+// handful of big steps depend on each other. Every task is started as soon as
+// all the tasks it depends on have finished, everything else overlaps on the
+// job system. The graph records when, where and for how long every task ran.
+class TaskGraph
+{
+ public:
+  explicit TaskGraph(std::string name) : m_name(std::move(name)) {}
+  HM_NON_COPYABLE_NON_MOVABLE(TaskGraph);
+
+  // Dependencies have to be added before the tasks that need them, which
+  // rules out cycles
+  TaskId Add(std::string name, Job&& job,
+             std::initializer_list<TaskId> dependencies = {});
+  // Runs every task once, the calling thread helps out until all are done
+  void Run(JobSystem& jobSystem);
+
+  // Logs every task in start order, the wall time next to the summed task
+  // time and the chain of tasks that decided the wall time
+  void LogReport() const;
+
+ private:
+  struct Task
+  {
+    std::string name {};
+    Job job {};
+    std::vector<TaskId> dependencies {};
+    std::vector<TaskId> dependents {};
+
+    // filled in by Run, in milliseconds since the graph started
+    f64 start {0.0};
+    f64 duration {0.0};
+    u32 threadIndex {0};
+  };
+
+  void Execute(TaskId id, JobSystem& jobSystem, Counter& counter);
+
+  std::string m_name {};
+  std::vector<Task> m_tasks {};
+  std::unique_ptr<std::atomic<u32>[]> m_pendingDependencies {};
+  std::chrono::steady_clock::time_point m_startTime {};
+  f64 m_wallTime {0.0};
+};
+} // namespace hm::jobs
@@ -0,0 +1,159 @@
+#pragma once
+#include "core/ecs.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <span>
+#include <unordered_map>
+
+namespace hm::ecs
+{
+using TransformId = u32;
+constexpr TransformId InvalidTransform = ~0u;
+
+// Splits a translation/rotation/scale matrix into its parts. A mirroring
+// matrix gets a negative x scale, so the rotation stays a proper one. An axis
+// scaled to zero keeps a scale of 0 and gets its direction from the other
+// axes, the parts never hold NaN. Returns false for matrices with shear or
+// projection, the parts only come close to those.
+bool Decompose(const glm::mat4& matrix, glm::vec3& translation,
+               glm::quat& rotation, glm::vec3& scale);
+
+// Links an entity to its node in the TransformSystem
+struct Transform
+{
+  TransformId id {InvalidTransform};
+};
+
+// Transform hierarchy stored as flat arrays. The nodes are kept sorted by
+// depth, breadth first, so that parents are always updated before their
+// children and every subtree is one contiguous range per level. Only the
+// ranges below the nodes whose local transform changed are recomputed.
+class TransformSystem final : public System
+{
+ public:
+  explicit TransformSystem(const std::string& name);
+  ~TransformSystem() override;
+
+  // Creates a node under `parent`, InvalidTransform makes it a root
+  TransformId Create(TransformId parent = InvalidTransform,
+                     const glm::vec3& translation = glm::vec3(0.f),
+                     const glm::quat& rotation = glm::quat(1.f, 0.f, 0.f, 0.f),
+                     const glm::vec3& scale = glm::vec3(1.f));
+  // Removes the node, its children move up to its parent. Called when the
+  // Transform component of an entity is destroyed.
+  void Destroy(TransformId id);
+  // Makes room for `count` more nodes, for spawning many at once
+  void Reserve(u32 count);
+  void SetParent(TransformId id, TransformId parent);
+  TransformId GetParent(TransformId id) const { return m_parentOfId[id]; }
+
+  void SetLocal(TransformId id, const glm::vec3& translation,
+                const glm::quat& rotation, const glm::vec3& scale);
+  // Keeps the parts of a local matrix, or the matrix itself when Decompose
+  // cannot split it. Setting any of the parts drops the matrix again.
+  void SetLocal(TransformId id, const glm::mat4& local);
+  void SetTranslation(TransformId id, const glm::vec3& translation);
+  void SetRotation(TransformId id, const glm::quat& rotation);
+  void SetScale(TransformId id, const glm::vec3& scale);
+
+  const glm::vec3& GetTranslation(TransformId id) const;
+  const glm::quat& GetRotation(TransformId id) const;
+  const glm::vec3& GetScale(TransformId id) const;
+  // Valid after the system updated, stale for nodes changed since then
+  const glm::mat4& GetWorld(TransformId id) const;
+  // World matrix between the previous tick and the last one, for rendering
+  // with Engine::GetInterpolationAlpha. Nodes that got or lost a mirror
+  // during the tick jump to the last one.
+  glm::mat4 GetInterpolatedWorld(TransformId id, f32 alpha) const;
+  // Moved or created during the last tick
+  bool HasChanged(TransformId id) const
+  {
+    return m_changed[m_slotOfId[id]] != Unchanged;
+  }
+  // Nodes whose world matrix, or what it interpolates between, changed since
+  // the last ClearChangedIds: created, moved, or come to rest. Ids can have
+  // been destroyed since.
+  std::span<const TransformId> GetChangedIds() const { return m_changedIds; }
+  void ClearChangedIds();
+
+  u32 GetCount() const { return static_cast<u32>(m_idOfSlot.size()); }
+
+  void Update(f32) override;
+  void Render() override {}
+  // Drops every node, the ids in restored Transform components are stale
+  void OnSnapshotLoaded() override;
+
+ private:
+  enum ChangeState : u8
+  {
+    Unchanged,
+    // moved during the last tick
+    Moved,
+    // created during the last tick, nothing to interpolate from
+    Created
+  };
+
+  struct SlotRange
+  {
+    u32 begin {};
+    u32 end {};
+  };
+
+  void OnTransformDestroyed(Registry& registry, Entity entity);
+  // Rebuilds the depth order after nodes were added, removed or reparented
+  void SortByDepth();
+  // Computes the world matrices of [begin, end), all on the same level
+  void UpdateRange(u32 begin, u32 end);
+  glm::mat4 ComputeLocal(u32 slot) const;
+  void MarkDirty(TransformId id);
+  void ListChanged(TransformId id);
+  void LinkChild(TransformId id, TransformId parent);
+  void UnlinkChild(TransformId id);
+  void DropLocalMatrix(TransformId id);
+
+  Registry& m_registry;
+
+  // indexed by TransformId
+  std::vector<u32> m_slotOfId {};
+  std::vector<TransformId> m_parentOfId {};
+  std::vector<TransformId> m_firstChild {};
+  std::vector<TransformId> m_nextSibling {};
+  std::vector<TransformId> m_previousSibling {};
+  std::vector<TransformId> m_freeIds {};
+  // locals that do not split into parts, few enough to be kept aside
+  std::unordered_map<TransformId, glm::mat4> m_localMatrices {};
+
+  // indexed by slot, sorted by depth once the structure is clean
+  std::vector<TransformId> m_idOfSlot {};
+  std::vector<u32> m_parentSlot {};
+  std::vector<glm::vec3> m_translations {};
+  std::vector<glm::quat> m_rotations {};
+  std::vector<glm::vec3> m_scales {};
+  // set for the nodes whose local is a matrix of m_localMatrices
+  std::vector<u8> m_matrixLocal {};
+  std::vector<glm::mat4> m_worlds {};
+  // world matrices of the tick before, only differ for moving nodes
+  std::vector<glm::mat4> m_previousWorlds {};
+  // set for the nodes in m_dirtyRoots
+  std::vector<u8> m_dirty {};
+  // ChangeState of every slot
+  std::vector<u8> m_changed {};
+  // range of the children of every slot on the next level, empty for leaves
+  std::vector<u32> m_childBegin {};
+  std::vector<u32> m_childEnd {};
+
+  // nodes whose local transform changed, their subtrees are recomputed
+  std::vector<TransformId> m_dirtyRoots {};
+  // nodes that moved during the last tick
+  std::vector<TransformId> m_movedIds {};
+
+  // indexed by TransformId, whether it is in m_changedIds
+  std::vector<u8> m_listed {};
+  std::vector<TransformId> m_changedIds {};
+
+  // first slot of every depth level, plus one past the end
+  std::vector<u32> m_levelStarts {};
+  bool m_bStructureDirty {false};
+};
+} // namespace hm::ecs
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 namespace hm
 {
 namespace ecs
@@ -11,6 +13,10 @@ namespace input
 {
 class Input;
 }
+namespace jobs
+{
+class JobSystem;
+}
 
 class Device;
 
@@ -36,10 +42,38 @@ class Engine
   Device& GetDevice() const { return *m_pDevice; }
   ecs::EntityComponentSystem& GetECS() { return *m_pEntityComponentSystem; };
   input::Input& GetInput() { return *m_pInput; };
+  jobs::JobSystem& GetJobs() { return *m_pJobSystem; };
+
+  /// <summary>
+  /// Sets how many times per second the systems are updated, every update
+  /// gets the same fixed delta time regardless of the frame rate
+  /// </summary>
+  void SetTickRate(f32 ticksPerSecond);
+  /// <summary>
+  /// Caps the updates run in a single frame, the remaining time is dropped so
+  /// a slow frame cannot make the simulation spiral. At least one update runs
+  /// per frame, zero would stop the simulation.
+  /// </summary>
+  void SetMaxTicksPerFrame(u32 maxTicks)
+  {
+    m_maxTicksPerFrame = std::max(maxTicks, 1u);
+  }
+  f32 GetFixedDeltaTime() const { return m_fixedDeltaTime; }
+  // How far the frame is between the last tick and the next one, in [0, 1),
+  // used to interpolate while rendering
+  f32 GetInterpolationAlpha() const { return m_interpolationAlpha; }
 
  private:
+  jobs::JobSystem* m_pJobSystem {nullptr};
   Device* m_pDevice {nullptr};
   ecs::EntityComponentSystem* m_pEntityComponentSystem {nullptr};
   input::Input* m_pInput {nullptr};
+
+  f32 m_fixedDeltaTime {1.f / 60.f};
+  u32 m_maxTicksPerFrame {5};
+  // time that still has to be simulated
+  f64 m_accumulator {0.0};
+  f32 m_interpolationAlpha {0.f};
+  std::chrono::steady_clock::time_point m_lastFrameTime {};
 };
 } // namespace hm
@@ -0,0 +1,52 @@
+#pragma once
+#include "platform/vulkan/device_vk.hpp"
+#include "utility/macros.hpp"
+
+namespace vkutil
+{
+VkDeviceAddress get_buffer_address(VkDevice device, VkBuffer buffer);
+
+// global memory barrier, enough for buffers shared between passes
+void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage,
+                    VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage,
+                    VkAccessFlags2 dstAccess);
+// stages the draws read buffers from, the mesh shaders included when there
+// are any
+VkPipelineStageFlags2 draw_shader_stages();
+} // namespace vkutil
+
+namespace hm
+{
+// Host visible buffer the CPU fills every frame. There is one per frame in
+// flight, so the one written was last used by the frame whose fence was just
+// waited on. They grow to fit and are never shrunk.
+class PerFrameBuffer
+{
+ public:
+  explicit PerFrameBuffer(VkBufferUsageFlags usage) : m_usage(usage) {}
+  HM_NON_COPYABLE_NON_MOVABLE(PerFrameBuffer);
+
+  struct Mapping
+  {
+    VkBuffer buffer {VK_NULL_HANDLE};
+    // 0 unless created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    VkDeviceAddress address {0};
+    std::byte* data {nullptr};
+  };
+
+  // Buffer of the current frame with room for `size` bytes, once per frame
+  Mapping Map(size_t size);
+  void Destroy();
+
+ private:
+  struct Frame
+  {
+    AllocatedBuffer buffer {};
+    VkDeviceAddress address {0};
+    size_t size {0};
+  };
+
+  std::array<Frame, internal::FRAME_OVERLAP> m_frames {};
+  VkBufferUsageFlags m_usage {0};
+};
+} // namespace hm
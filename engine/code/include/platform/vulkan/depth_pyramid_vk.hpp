@@ -0,0 +1,55 @@
+#pragma once
+#include "platform/vulkan/device_vk.hpp"
+#include "utility/macros.hpp"
+
+#include <vector>
+
+namespace hm
+{
+// Hi-Z pyramid of the depth image. Every texel holds the farthest depth
+// under it, with reversed depth that is the smallest value, so anything
+// nearer than a texel of the level its screen rectangle fits in can still
+// be seen. Level 0 is the largest power of two size that fits in the depth
+// image, each level after it halves exactly.
+class DepthPyramid
+{
+ public:
+  DepthPyramid() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(DepthPyramid);
+
+  // Creates the pyramid for the depth image and the reduce pipeline,
+  // everything is freed by the main deletion queue
+  void Init();
+  // Records the reduction of the depth of `viewport`, of which only `drawn`
+  // was rendered to. The depth image has to be readable by the compute
+  // shader, the pyramid is ready for the compute passes after it.
+  void Build(VkCommandBuffer cmd, VkExtent2D viewport, VkExtent2D drawn);
+
+  // every level, for sampling
+  VkImageView GetView() const { return m_image.imageView; }
+  VkExtent2D GetExtent() const
+  {
+    return {m_image.imageExtent.width, m_image.imageExtent.height};
+  }
+  u32 GetLevelCount() const { return m_levelCount; }
+
+ private:
+  static constexpr u32 ReduceGroupSize {8};
+
+  struct ReducePushConstants
+  {
+    glm::ivec2 sourceSize;
+    glm::ivec2 targetSize;
+    // source texels outside of it were not drawn to
+    glm::ivec2 validSize;
+  };
+
+  AllocatedImage m_image {};
+  std::vector<VkImageView> m_levelViews {};
+  u32 m_levelCount {0};
+
+  VkDescriptorSetLayout m_reduceSetLayout {VK_NULL_HANDLE};
+  VkPipelineLayout m_reduceLayout {VK_NULL_HANDLE};
+  VkPipeline m_reducePipeline {VK_NULL_HANDLE};
+};
+} // namespace hm
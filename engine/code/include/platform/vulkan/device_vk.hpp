@@ -9,9 +9,12 @@ namespace internal
 struct DeletionQueue
 {
   std::deque<std::function<void()>> deletors;
+  // startup tasks push their deletors from worker threads
+  std::mutex mutex;
 
   void push_function(std::function<void()>&& function)
   {
+    std::scoped_lock lock(mutex);
     deletors.push_back(std::move(function));
   }
 
@@ -71,8 +74,11 @@ FrameData& get_current_frame();
 void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
 
 } // namespace internal
+// Meshlets and levels of detail are uploaded with the mesh when there are any
 GPUMeshBuffers UploadMesh(std::span<uint32_t> indicies,
-                          std::span<Vertex> vertices);
+                          std::span<Vertex> vertices,
+                          const gpx::MeshletSet& meshlets = {},
+                          std::span<const gpx::MeshLod> lods = {});
 
 inline AllocatedImage _whiteImage;
 inline AllocatedImage _blackImage;
@@ -89,6 +95,9 @@ struct GLTFMetallic_Roughness
 {
   MaterialPipeline opaquePipeline;
   MaterialPipeline transparentPipeline;
+  // the opaque pipeline with a mesh shader drawing meshlets, only built when
+  // the device supports them
+  MaterialPipeline meshletPipeline {};
 
   VkDescriptorSetLayout materialLayout;
 
@@ -110,8 +119,6 @@ struct GLTFMetallic_Roughness
     uint32_t dataBufferOffset;
   };
 
-  DescriptorWriter writer;
-
   void build_pipelines();
   void clear_resources(VkDevice device);
 
@@ -125,10 +132,14 @@ inline GLTFMetallic_Roughness metalRoughMaterial;
 inline internal::DeletionQueue _mainDeletionQueue;
 inline VkFormat _swapchainImageFormat;
 inline VkQueue _graphicsQueue;
+// submits can come from the render thread and from loading code
+inline std::mutex _graphicsQueueMutex;
 inline uint32_t _graphicsQueueFamily;
 inline VkInstance _instance;                      // Vulkan library handle
 inline VkDebugUtilsMessengerEXT _debug_messenger; // Vulkan debug output handle
 inline VkPhysicalDevice _chosenGPU; // GPU chosen as the default device
+// VK_EXT_mesh_shader is enabled, the meshlets can be drawn by mesh shaders
+inline bool _bMeshShaders {false};
 inline VkDevice _device;            // Vulkan device for commands
 inline VkSurfaceKHR _surface;       // Vulkan window surface
 inline VkExtent2D _swapchainExtent;
@@ -0,0 +1,178 @@
+#pragma once
+#include "platform/vulkan/depth_pyramid_vk.hpp"
+#include "platform/vulkan/object_buffer_vk.hpp"
+
+namespace hm
+{
+// Frustum culling of the GPUObjectBuffer in a compute pass, over the
+// candidates the CPU found near the frustum. Every draw
+// bucket gets a range of indexed indirect commands, the visible objects of
+// the bucket are packed at its front and their number goes into the count
+// buffer, ready for vkCmdDrawIndexedIndirectCount. The CPU only goes through
+// the buckets. The test is the same as the one of the CPU culling, sphere
+// and box against every plane.
+//
+// With occlusion culling the frame is culled twice. The early pass keeps the
+// objects that were visible last frame, the depth pyramid is built once they
+// are drawn. The late pass tests everything against it, remembers what is
+// visible for the next frame and keeps what the early pass did not draw.
+// Objects left out of the candidates keep the flag of the last pass that
+// tested them, at worst the early pass draws them once for nothing.
+//
+// Visible objects with meshlets can be handed to a second dispatch, one
+// workgroup per object, which culls their meshlets against the frustum, the
+// normal cone and in the late pass the pyramid. The meshlets left are either
+// indexed commands of the bucket or, with mesh shaders, entries of the
+// bucket's meshlet list that one mesh task draw goes through.
+//
+// The level of detail of every object is picked like gpx::SelectLod does,
+// objects too small on screen count as hidden and the coarser levels are
+// drawn as a whole, without their meshlets.
+class GPUCulling
+{
+ public:
+  GPUCulling() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(GPUCulling);
+
+  enum class Pass : u32
+  {
+    // frustum only, everything in one go
+    All,
+    Early,
+    Late
+  };
+
+  // How the objects with meshlets are drawn
+  enum class MeshletMode : u32
+  {
+    // whole, like the objects without
+    Off,
+    // an indexed indirect command per visible meshlet
+    Indexed,
+    // the visible meshlets go to the mesh shader pipelines
+    MeshShader
+  };
+
+  // Draws of one bucket, in the order they should be recorded
+  struct BucketDraw
+  {
+    u32 bucket {0};
+    // first command of the range, the count is at index `bucket`
+    u32 firstCommand {0};
+    u32 maxCount {0};
+    // range of the meshlet list, with mesh shaders
+    u32 firstMeshletDraw {0};
+    u32 maxMeshletDraws {0};
+  };
+
+  // Builds the cull pipeline, everything is freed by the main deletion queue
+  void Init();
+  // Lays out the draws of the frame after the objects were updated, once
+  // before the passes
+  void Prepare(VkCommandBuffer cmd, const GPUObjectBuffer& objects,
+               std::span<const RenderObjectId> candidates,
+               const culling::Frustum& frustum, const glm::mat4& viewProj,
+               const glm::vec3& cameraPosition, const DepthPyramid& pyramid,
+               MeshletMode meshletMode, const gpx::LodSettings& lodSettings);
+  // Records one cull pass outside of a render pass, after the draws of the
+  // pass before it. Only the late pass reads the pyramid.
+  void Cull(VkCommandBuffer cmd, Pass pass, const DepthPyramid& pyramid);
+
+  std::span<const BucketDraw> GetDraws() const { return m_draws; }
+  VkBuffer GetCommands() const { return m_commands.buffer; }
+  VkBuffer GetCounts() const { return m_counts.buffer; }
+  // object id of every command, for GPUObjectPushConstants
+  VkDeviceAddress GetInstances() const { return m_instancesAddress; }
+  // object id and meshlet index of every meshlet draw
+  VkDeviceAddress GetMeshletDraws() const { return m_meshletDrawsAddress; }
+  // VkDrawMeshTasksIndirectCommandEXT of every bucket
+  VkBuffer GetMeshTasks() const { return m_meshTasks.buffer; }
+  MeshletMode GetMeshletMode() const { return m_meshletMode; }
+
+ private:
+  static constexpr u32 CullGroupSize {64};
+
+  // start of the per frame data, the first command of every bucket follows,
+  // then the first meshlet draw of every bucket, then the candidates
+  struct CullData
+  {
+    std::array<glm::vec4, 6> planes;
+    glm::mat4 viewProj;
+    glm::vec4 cameraPosition;
+    // size of level 0 of the depth pyramid
+    glm::vec2 pyramidSize;
+    u32 candidateCount;
+    u32 pyramidLevels;
+    u32 bucketCount;
+    MeshletMode meshletMode;
+    // gpx::LodSettings, pixelsPerUnit is 0 with the levels off
+    f32 pixelsPerUnit;
+    f32 lodErrorPixels;
+    f32 minPixelSize;
+    u32 pad[3];
+  };
+
+  struct CullPushConstants
+  {
+    VkDeviceAddress objects;
+    VkDeviceAddress cullData;
+    VkDeviceAddress commands;
+    VkDeviceAddress counts;
+    VkDeviceAddress instances;
+    VkDeviceAddress visibility;
+    VkDeviceAddress tasks;
+    VkDeviceAddress meshletDraws;
+    VkDeviceAddress meshTasks;
+    Pass pass;
+    u32 pad;
+  };
+
+  // Grows the output buffers, what is in them is rebuilt every frame
+  void Reserve(u32 commandCount, u32 bucketCount);
+  // Grows the visibility flags, new objects count as hidden
+  void ReserveVisibility(VkCommandBuffer cmd, u32 objectCount);
+  // Grows the meshlet task list and the meshlet draws
+  void ReserveMeshlets(u32 objectCount, u32 meshletDrawCount);
+
+  std::vector<BucketDraw> m_draws {};
+  // first command of every bucket, then its first meshlet draw
+  std::vector<u32> m_firstDraws {};
+  u32 m_objectCount {0};
+  u32 m_candidateCount {0};
+  u32 m_commandCount {0};
+  u32 m_meshletDrawCount {0};
+  MeshletMode m_meshletMode {MeshletMode::Off};
+  VkDeviceAddress m_objectsAddress {0};
+
+  AllocatedBuffer m_commands {};
+  AllocatedBuffer m_instances {};
+  AllocatedBuffer m_counts {};
+  AllocatedBuffer m_meshTasks {};
+  VkDeviceAddress m_commandsAddress {0};
+  VkDeviceAddress m_instancesAddress {0};
+  VkDeviceAddress m_countsAddress {0};
+  VkDeviceAddress m_meshTasksAddress {0};
+  u32 m_commandCapacity {0};
+  u32 m_bucketCapacity {0};
+  // dispatch of the meshlet cull, then the objects it goes through
+  AllocatedBuffer m_tasks {};
+  VkDeviceAddress m_tasksAddress {0};
+  u32 m_taskCapacity {0};
+  AllocatedBuffer m_meshletDraws {};
+  VkDeviceAddress m_meshletDrawsAddress {0};
+  u32 m_meshletDrawCapacity {0};
+  // indexed by RenderObjectId, whether the late pass saw it last frame
+  AllocatedBuffer m_visibility {};
+  VkDeviceAddress m_visibilityAddress {0};
+  u32 m_visibilityCapacity {0};
+  PerFrameBuffer m_cullData {VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT};
+  VkDeviceAddress m_cullDataAddress {0};
+
+  VkPipeline m_cullPipeline {VK_NULL_HANDLE};
+  VkPipeline m_meshletCullPipeline {VK_NULL_HANDLE};
+  VkPipelineLayout m_cullLayout {VK_NULL_HANDLE};
+  // the depth pyramid, for the late pass
+  VkDescriptorSetLayout m_cullSetLayout {VK_NULL_HANDLE};
+};
+} // namespace hm
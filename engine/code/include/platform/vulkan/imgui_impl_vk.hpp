@@ -1,6 +1,15 @@
 ﻿#pragma once
+
+#include <volk.h>
+
 namespace hm::external
 {
 void ImGuiInitializeVulkan(SDL_Window* window);
 
 }
+namespace hm::internal
+{
+// Records the given draw data, does not have to be the current ImGui frame
+void RenderVulkanImGui(VkCommandBuffer cmd, VkImageView targetImageView,
+                       ImDrawData* drawData);
+} // namespace hm::internal
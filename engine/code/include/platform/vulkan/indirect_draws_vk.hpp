@@ -0,0 +1,77 @@
+#pragma once
+#include "platform/vulkan/buffers_vk.hpp"
+#include "platform/vulkan/render_objects_vk.hpp"
+
+#include <span>
+
+namespace hm
+{
+// Commands that share a material and an index buffer, drawn by one call
+struct IndirectBatch
+{
+  MaterialInstance* material {nullptr};
+  VkBuffer indexBuffer {VK_NULL_HANDLE};
+  // range of the commands
+  u32 first {0};
+  u32 count {0};
+};
+
+// Indexed indirect draw commands of one frame. Next to the commands goes the
+// instance buffer, the object id of every instance, which the shaders look
+// up by gl_InstanceIndex to find the object in the GPUObjectBuffer. Objects
+// added back to back with the same state share a batch, so a sorted draw list
+// ends up as a few calls.
+//
+// With instancing on, objects of a batch that draw the same index range are
+// merged into one instanced command, repeated props cost one draw per mesh.
+class IndirectDrawList
+{
+ public:
+  IndirectDrawList() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(IndirectDrawList);
+
+  struct Buffers
+  {
+    VkBuffer commands {VK_NULL_HANDLE};
+    VkDeviceAddress instances {0};
+  };
+
+  void Clear();
+  // Draws the object at one of its levels of detail, the full surface by
+  // default
+  void Add(const RenderObject& object, RenderObjectId id, u32 lod = 0);
+  // Turns what was added into commands and copies them and the instances
+  // into this frame's buffer, once per frame
+  Buffers Upload();
+  void Destroy() { m_buffer.Destroy(); }
+
+  bool m_bInstancing {true};
+
+  std::span<const IndirectBatch> GetBatches() const { return m_batches; }
+  std::span<const VkDrawIndexedIndirectCommand> GetCommands() const
+  {
+    return m_commands;
+  }
+  u32 GetTriangleCount() const { return m_triangleCount; }
+
+ private:
+  struct Draw
+  {
+    u32 firstIndex {0};
+    u32 indexCount {0};
+    RenderObjectId id {InvalidRenderObject};
+  };
+
+  void BuildCommands();
+
+  // what was added, the batches index into it until BuildCommands
+  std::vector<Draw> m_draws {};
+  std::vector<IndirectBatch> m_batches {};
+  std::vector<VkDrawIndexedIndirectCommand> m_commands {};
+  std::vector<RenderObjectId> m_instances {};
+  u32 m_triangleCount {0};
+  PerFrameBuffer m_buffer {VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT};
+};
+} // namespace hm
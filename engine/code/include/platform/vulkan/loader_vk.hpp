@@ -21,6 +21,16 @@ struct GeoSurface
   uint32_t count;
   Bounds bounds;
   std::shared_ptr<GLTFMaterial> material;
+  // copy of the triangles on the CPU, only for surfaces loaded as occluders
+  std::shared_ptr<const culling::OccluderMesh> occluder;
+  // range of the mesh's meshlets covering the surface's triangles
+  uint32_t firstMeshlet {0};
+  uint32_t meshletCount {0};
+  // range of the mesh's levels of detail, the full surface first
+  uint32_t firstLod {0};
+  uint32_t lodCount {0};
+  // the material is seen from both sides, its meshlets never cone cull
+  bool bDoubleSided {false};
 };
 
 struct MeshAsset
@@ -28,9 +38,27 @@ struct MeshAsset
   std::string name;
 
   std::vector<GeoSurface> surfaces;
+  // levels of detail of every surface, their indices sit behind the full
+  // surfaces in the index buffer
+  std::vector<gpx::MeshLod> lods;
   GPUMeshBuffers meshBuffers;
 };
 
+// Hands out the ids the draws are sorted by to the mesh and its materials,
+// what already has an id keeps it. Runs in a fixed order while the scene is
+// placed, so the ids, and with them the draw order, are the same every run.
+void assignSortIds(MeshAsset& mesh);
+void assignSortId(MaterialInstance& material);
+
+RenderObject makeRenderObject(const MeshAsset& mesh, const GeoSurface& surface,
+                              const glm::mat4& transform);
+// Adds a render object for the surface
+void drawSurface(const MeshAsset& mesh, const GeoSurface& surface,
+                 const glm::mat4& transform, DrawContext& ctx);
+// Adds a render object for every surface of the mesh
+void drawMesh(const MeshAsset& mesh, const glm::mat4& transform,
+              DrawContext& ctx);
+
 std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(
     const std::filesystem::path& filePath);
 // forward declaration
@@ -60,7 +88,47 @@ struct LoadedGLTF : public IRenderable
 
  private:
 };
+
+// RGBA8 pixels of a glTF image, decoded on the CPU
+struct DecodedImage
+{
+  std::unique_ptr<stbi_uc, void (*)(void*)> pixels {nullptr, stbi_image_free};
+  u32 width {0};
+  u32 height {0};
+};
+
+// A glTF file read from disk with its images decoded, nothing is on the GPU
+// yet, so it can be produced on any thread while the device is busy
+struct ParsedGLTF
+{
+  std::filesystem::path path;
+  tinygltf::Model model;
+  // one per model image, without pixels when decoding failed
+  std::vector<DecodedImage> images;
+};
+
+struct LoadOptions
+{
+  // Treats the whole file as static scenery. The meshes are merged per
+  // material into one mesh with the node transforms baked into the vertices,
+  // split into clusters of nearby surfaces that keep their own bounds for
+  // culling. The node graph is replaced by one node drawing that mesh.
+  bool bStaticBatching {false};
+  // a cluster takes surfaces until it holds this many triangles
+  u32 clusterTriangles {4096};
+  // Keeps the triangles of the opaque surfaces on the CPU so they hide what
+  // is behind them in the CPU occlusion culling. Meant for a few big, simple
+  // meshes like walls and floors.
+  bool bOccluders {false};
+};
+
+std::optional<ParsedGLTF> parseGltf(const std::filesystem::path& filePath);
+// Uploads a parsed file, needs the material pipelines and default textures
+std::optional<std::shared_ptr<hm::LoadedGLTF>> loadGltf(
+    VkDevice _device, const ParsedGLTF& parsed,
+    const LoadOptions& options = {});
 // forward declaration
 std::optional<std::shared_ptr<hm::LoadedGLTF>> loadGltf(
-    VkDevice _device, const std::filesystem::path& filePath);
+    VkDevice _device, const std::filesystem::path& filePath,
+    const LoadOptions& options = {});
 } // namespace hm
@@ -0,0 +1,93 @@
+#pragma once
+#include "platform/vulkan/buffers_vk.hpp"
+#include "platform/vulkan/render_objects_vk.hpp"
+#include "utility/macros.hpp"
+
+#include <map>
+
+namespace hm
+{
+// GPUObjectData of every render object, indexed by RenderObjectId. The buffer
+// stays on the GPU from one frame to the next and only objects that changed
+// are uploaded: they are written into this frame's staging buffer together
+// with their ids, then a compute shader scatters them to their spots. Static
+// geometry costs nothing once it is in.
+//
+// Opaque objects are also sorted into draw buckets, one per material and index
+// buffer, so the GPU can build the draws of a bucket without the CPU going
+// through the objects. The counts are kept up to date with the uploads.
+class GPUObjectBuffer
+{
+ public:
+  static constexpr u32 NoDrawBucket {~0u};
+
+  struct DrawBucket
+  {
+    MaterialInstance* material {nullptr};
+    VkBuffer indexBuffer {VK_NULL_HANDLE};
+    u32 objectCount {0};
+    // meshlets of all its objects
+    u32 meshletCount {0};
+  };
+
+  GPUObjectBuffer() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(GPUObjectBuffer);
+
+  // Builds the scatter pipeline, everything is freed by the main deletion
+  // queue
+  void Init();
+  // Records the upload of what the last Sync into `objects` touched. Has to
+  // be outside of a render pass, the draws after it can read the buffer.
+  void Update(VkCommandBuffer cmd, const RenderObjectStore& objects);
+  // Uploads everything next time, for when a synced frame was not drawn
+  void Invalidate() { m_bUploadAll = true; }
+
+  VkDeviceAddress GetAddress() const { return m_address; }
+  // every id in use is below this
+  u32 GetObjectLimit() const { return m_objectLimit; }
+  std::span<const DrawBucket> GetDrawBuckets() const { return m_buckets; }
+  // objects uploaded by the last Update
+  u32 GetUploadCount() const { return m_uploadCount; }
+
+ private:
+  static constexpr u32 InitialCapacity {1024};
+  static constexpr u32 ScatterGroupSize {64};
+
+  struct ScatterPushConstants
+  {
+    VkDeviceAddress ids;
+    VkDeviceAddress source;
+    VkDeviceAddress target;
+    u32 count;
+    u32 pad;
+  };
+
+  // Grows the buffer to fit `count` objects, keeping what is in it
+  void Reserve(VkCommandBuffer cmd, u32 count);
+  // Moves the object over to its new bucket, nullptr once it is removed
+  u32 UpdateBucket(RenderObjectId id, const RenderObject* object);
+  // `object` is nullptr for removed objects, which are never drawn
+  static void Write(const RenderObject* object, u32 drawBucket,
+                    GPUObjectData& data);
+
+  AllocatedBuffer m_buffer {};
+  VkDeviceAddress m_address {0};
+  u32 m_capacity {0};
+  u32 m_objectLimit {0};
+  // changed objects after their ids
+  PerFrameBuffer m_staging {VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT};
+  std::vector<RenderObjectId> m_uploadIds {};
+  bool m_bUploadAll {true};
+
+  std::vector<DrawBucket> m_buckets {};
+  std::map<std::pair<MaterialInstance*, VkBuffer>, u32> m_bucketIndices {};
+  // indexed by RenderObjectId, the bucket and the meshlets counted in it
+  std::vector<u32> m_objectBuckets {};
+  std::vector<u32> m_objectMeshlets {};
+  u32 m_uploadCount {0};
+
+  VkPipeline m_scatterPipeline {VK_NULL_HANDLE};
+  VkPipelineLayout m_scatterLayout {VK_NULL_HANDLE};
+};
+} // namespace hm
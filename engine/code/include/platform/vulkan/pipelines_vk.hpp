@@ -43,6 +43,9 @@ class PipelineBuilder
 
   VkPipeline build_pipeline(VkDevice device);
   void set_shaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+  // the vertex input and input assembly are unused with a mesh shader
+  void set_mesh_shaders(VkShaderModule meshShader,
+                        VkShaderModule fragmentShader);
   void set_input_topology(VkPrimitiveTopology topology);
   void set_polygon_mode(VkPolygonMode mode);
   void set_cull_mode(VkCullModeFlags cullMode, VkFrontFace frontFace);
@@ -0,0 +1,70 @@
+#pragma once
+#include "core/spatial_index.hpp"
+#include "platform/vulkan/render_objects_vk.hpp"
+
+#include <span>
+
+namespace hm
+{
+// Draws every surface of the mesh at the world transform of the entity. The
+// renderer registers the render objects once the component is added, and
+// removes them with it.
+struct RenderMesh
+{
+  const MeshAsset* mesh {nullptr};
+  RenderObjectRange objects {};
+};
+
+// Marks a RenderMesh that is expected to stay put, it stays out of the
+// SpatialIndex
+struct StaticMesh
+{
+};
+
+// Flat template of a loaded glTF, built once and then stamped into the
+// registry as many times as needed. The node graph is stored as arrays in
+// depth-first order, so parents always come before their children. Meshes
+// and materials are shared by every instance, the file is kept alive for as
+// long as the prefab exists.
+class Prefab
+{
+ public:
+  Prefab() = default;
+  explicit Prefab(std::shared_ptr<LoadedGLTF> file);
+
+  // Creates one copy per root transform with batched inserts, every copy gets
+  // a root entity carrying the given transform with the file's nodes under
+  // it. Returns the root entities. Only from the main thread and outside of
+  // system updates, since it changes the registry and the transforms.
+  // `bStatic` tags the meshes with StaticMesh, otherwise they are added to the
+  // SpatialIndex.
+  std::vector<ecs::Entity> Instantiate(
+      ecs::EntityComponentSystem& ecs,
+      std::span<const glm::mat4> rootTransforms, bool bStatic = false) const;
+
+  u32 GetNodeCount() const { return static_cast<u32>(m_parents.size()); }
+  u32 GetMeshNodeCount() const { return static_cast<u32>(m_meshNodes.size()); }
+
+ private:
+  static constexpr u32 NoParent = ~0u;
+  static constexpr u32 NoMatrix = ~0u;
+
+  void AddNode(const Node& node, u32 parent);
+
+  std::shared_ptr<LoadedGLTF> m_file {};
+
+  // per node, in depth-first order
+  std::vector<u32> m_parents {};
+  std::vector<glm::vec3> m_translations {};
+  std::vector<glm::quat> m_rotations {};
+  std::vector<glm::vec3> m_scales {};
+  // index into m_localMatrices for the locals that do not split into parts
+  std::vector<u32> m_matrixOfNode {};
+  std::vector<glm::mat4> m_localMatrices {};
+
+  // nodes with a mesh, their meshes and the bounds of all their surfaces
+  std::vector<u32> m_meshNodes {};
+  std::vector<const MeshAsset*> m_meshes {};
+  std::vector<culling::Aabb> m_meshBounds {};
+};
+} // namespace hm
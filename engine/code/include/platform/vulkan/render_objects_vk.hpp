@@ -0,0 +1,155 @@
+#pragma once
+#include "core/bvh.hpp"
+#include "platform/vulkan/loader_vk.hpp"
+#include "utility/macros.hpp"
+
+#include <array>
+#include <span>
+
+namespace hm
+{
+using RenderObjectId = u32;
+constexpr RenderObjectId InvalidRenderObject = ~0u;
+
+// Render objects of one mesh, one per surface with consecutive ids
+struct RenderObjectRange
+{
+  RenderObjectId first {InvalidRenderObject};
+  u32 count {0};
+
+  bool IsValid() const { return first != InvalidRenderObject; }
+};
+
+// Render objects that live from one frame to the next. They are added when
+// something starts being drawn, changed when its transform or material does
+// and removed explicitly, so nothing is rebuilt for what stayed the same.
+// The objects sit packed in a DrawContext, opaque and transparent apart, and
+// the ids go through a table to their spot.
+//
+// The store the main thread writes to remembers which ids changed during the
+// last few frames. Every frame snapshot holds a replica, Sync brings it up to
+// date by copying just those objects, or everything once it fell too far
+// behind.
+//
+// The static opaque objects also go into a Bvh, so culling can start from
+// the part of them near the frustum instead of going through all of them.
+class RenderObjectStore
+{
+ public:
+  RenderObjectStore() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(RenderObjectStore);
+
+  // `bStatic` objects are expected to stay mostly where they are. The rest
+  // is left out of QueryStatic and has to be found some other way, like
+  // through the SpatialIndex.
+  RenderObjectRange Add(const MeshAsset& mesh, const glm::mat4& transform,
+                        bool bStatic = true);
+  void SetTransform(RenderObjectRange range, const glm::mat4& transform);
+  // Moves the object over to the other list when the pass changes
+  void SetMaterial(RenderObjectId id, MaterialInstance* material);
+  void Remove(RenderObjectRange range);
+  void Clear();
+
+  // Copies what changed since `replica` was synced last
+  void Sync(RenderObjectStore& replica) const;
+  // Starts the next frame of the change history
+  void EndFrame();
+
+  const DrawContext& GetDrawContext() const { return m_context; }
+  u32 GetCount() const
+  {
+    return static_cast<u32>(m_opaqueIds.size() + m_transparentIds.size());
+  }
+  // One past the highest id handed out so far
+  u32 GetIdLimit() const { return static_cast<u32>(m_slots.size()); }
+  // Id of every object, in the order of the DrawContext lists
+  const std::vector<RenderObjectId>& GetOpaqueIds() const
+  {
+    return m_opaqueIds;
+  }
+  const std::vector<RenderObjectId>& GetTransparentIds() const
+  {
+    return m_transparentIds;
+  }
+  // nullptr for ids that are not in use
+  const RenderObject* Find(RenderObjectId id) const;
+  // Position in the opaque list, InvalidRenderObject for the other ids
+  u32 GetOpaqueIndex(RenderObjectId id) const
+  {
+    return id < m_slots.size() && m_slots[id].list == List::Opaque
+               ? m_slots[id].index
+               : InvalidRenderObject;
+  }
+
+  // Appends the id of every static opaque object whose box touches the
+  // frustum. The tree is built again when the static objects changed and
+  // refit when some of them moved. Only on the store the main thread writes
+  // to, replicas do not keep it.
+  void QueryStatic(const culling::Frustum& frustum,
+                   std::vector<RenderObjectId>& candidates);
+
+  // On a replica, the ids the last Sync added, changed or removed. After a
+  // full copy that is everything and the list stays empty.
+  std::span<const RenderObjectId> GetSyncedIds() const { return m_syncedIds; }
+  bool WasFullySynced() const { return m_bFullSync; }
+
+ private:
+  // frames of changes kept for the replicas
+  static constexpr u64 HistoryFrames {4};
+  static constexpr u64 NoFrame {~0ull};
+
+  enum class List : u8
+  {
+    None,
+    Opaque,
+    Transparent
+  };
+
+  struct Slot
+  {
+    List list {List::None};
+    // position in the list
+    u32 index {0};
+  };
+
+  RenderObjectId Allocate(u32 count);
+  RenderObject& GetObject(const Slot& slot);
+  void Insert(RenderObjectId id, const RenderObject& object);
+  void Erase(RenderObjectId id);
+  void MarkChanged(RenderObjectId id);
+  // World boxes of m_staticIds, from the opaque bounds
+  void GatherStaticBounds();
+  // Brings one object of `replica` to the state it has here
+  void CopyObject(RenderObjectId id, RenderObjectStore& replica) const;
+
+  DrawContext m_context {};
+  // id of every packed object
+  std::vector<RenderObjectId> m_opaqueIds {};
+  std::vector<RenderObjectId> m_transparentIds {};
+  // indexed by RenderObjectId
+  std::vector<Slot> m_slots {};
+  // freed ranges by size, meshes of one asset pick up each other's ids
+  std::unordered_map<u32, std::vector<RenderObjectId>> m_freeRanges {};
+
+  // indexed by RenderObjectId, 1 for the static objects
+  std::vector<u8> m_static {};
+  // the static opaque objects in the order of the tree items
+  std::vector<RenderObjectId> m_staticIds {};
+  std::vector<culling::Aabb> m_staticBounds {};
+  culling::Bvh m_staticTree {};
+  std::vector<u32> m_staticItems {};
+  // static objects were added or removed, or some of them moved
+  bool m_bStaticChanged {false};
+  bool m_bStaticMoved {false};
+
+  u64 m_frame {0};
+  // ids changed per frame, for the last HistoryFrames frames
+  std::array<std::vector<RenderObjectId>, HistoryFrames> m_history {};
+  // indexed by RenderObjectId, the last frame it changed in
+  std::vector<u64> m_changedFrame {};
+  // on a replica, the frame of the source it has seen the changes of
+  u64 m_syncedFrame {NoFrame};
+  std::vector<RenderObjectId> m_syncedIds {};
+  bool m_bFullSync {false};
+};
+} // namespace hm
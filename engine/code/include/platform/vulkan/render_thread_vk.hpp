@@ -0,0 +1,104 @@
+#pragma once
+
+#include "platform/vulkan/device_vk.hpp"
+#include "platform/vulkan/render_objects_vk.hpp"
+#include "utility/spsc_queue.hpp"
+
+namespace hm::internal
+{
+// Everything needed to record one frame. The main thread fills it in, after
+// that it is only read by whoever records the frame, apart from `results`.
+struct FrameSnapshot
+{
+  FrameSnapshot() = default;
+  ~FrameSnapshot() { ClearImGuiDrawData(); }
+  HM_NON_COPYABLE_NON_MOVABLE(FrameSnapshot);
+
+  GPUSceneData sceneData {};
+  // replica of the render objects, synced when the snapshot is filled
+  RenderObjectStore renderObjects {};
+  // ids of the render objects that can be in the frustum, found through the
+  // static tree and the SpatialIndex. Culling only goes through these.
+  std::vector<RenderObjectId> cullCandidates {};
+  glm::uvec2 windowSize {};
+  float renderScale {1.f};
+  // batches of draws go through vkCmdDrawIndexedIndirect
+  bool bIndirectDraws {true};
+  // draws of the same surface and material become one instanced draw
+  bool bInstancing {true};
+  // the opaque objects are culled and compacted by a compute pass
+  bool bGpuCulling {true};
+  // objects hidden behind others are skipped too, against the depth of the
+  // early pass with GPU culling and against the occluders rasterized on the
+  // CPU without
+  bool bOcclusionCulling {true};
+  // with GPU culling the meshlets of the visible objects are culled as well,
+  // drawn by a mesh shader when the device has them
+  bool bMeshlets {true};
+  bool bMeshShaders {true};
+  // every object draws the coarsest level of detail whose error stays under
+  // lodErrorPixels, the ones smaller than lodMinPixelSize are skipped
+  bool bMeshLods {true};
+  float lodErrorPixels {1.f};
+  float lodMinPixelSize {1.f};
+  ComputeEffect backgroundEffect {};
+
+  // ImGui output of the frame, the draw lists are cloned and owned here
+  ImDrawData imguiDrawData {};
+  std::vector<ImDrawList*> imguiDrawLists {};
+
+  // written while recording, read back by the main thread once the snapshot
+  // is returned to it
+  struct Results
+  {
+    int drawcallCount {0};
+    int triangleCount {0};
+    int objectUploadCount {0};
+    float meshDrawTime {0.f};
+    bool bSwapchainOutOfDate {false};
+  } results {};
+
+  void CopyImGuiDrawData(const ImDrawData& drawData);
+  void ClearImGuiDrawData();
+};
+
+// Records and submits frames on its own thread, so the main thread can
+// simulate and extract frame N + 1 while frame N is being recorded. There are
+// two snapshots, one being filled and one being rendered.
+class RenderThread
+{
+ public:
+  RenderThread() = default;
+  ~RenderThread();
+  HM_NON_COPYABLE_NON_MOVABLE(RenderThread);
+
+  void Start();
+  // Renders whatever was submitted and joins the thread
+  void Stop();
+  bool IsRunning() const { return m_thread.joinable(); }
+
+  // Waits for a snapshot the render thread is done with
+  FrameSnapshot& Acquire();
+  // Hands the acquired snapshot over to the render thread
+  void Submit(FrameSnapshot& snapshot);
+  // Waits until every submitted frame has been recorded and submitted
+  void Flush();
+
+ private:
+  static constexpr u32 SnapshotCount {2};
+  static constexpr u32 QuitIndex {~0u};
+
+  void Loop();
+
+  std::array<FrameSnapshot, SnapshotCount> m_snapshots {};
+  SpscQueue<u32, SnapshotCount> m_free {};
+  SpscQueue<u32, SnapshotCount * 2> m_submitted {};
+  std::atomic<u32> m_pendingFrames {0};
+  std::thread m_thread {};
+};
+
+// Records, submits and presents a frame, on the render thread when it runs
+void draw_frame(FrameSnapshot& snapshot);
+
+inline RenderThread _renderThread;
+} // namespace hm::internal
@@ -2,6 +2,11 @@
 
 #include <vk_mem_alloc.h>
 
+#include "core/culling.hpp"
+#include "core/mesh_lod.hpp"
+#include "core/meshlets.hpp"
+#include "core/occlusion.hpp"
+
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 #include <memory>
@@ -104,7 +109,42 @@ struct GPUMeshBuffers
   AllocatedBuffer indexBuffer;
   AllocatedBuffer vertexBuffer;
   VkDeviceAddress vertexBufferAddress;
+  // GPUMeshlets of every surface, the GPUMeshLods, then the meshlet
+  // vertices and triangles. Empty for meshes uploaded without either.
+  AllocatedBuffer meshletBuffer {};
+  VkDeviceAddress meshletBufferAddress {0};
+  // word of the meshlet buffer the first GPUMeshLod starts at
+  uint32_t lodOffset {0};
+  // id the draws are sorted by, 0 until assignSortIds hands one out
+  uint32_t sortId {0};
+};
+
+// one gpx::Meshlet as the shaders see it, the offsets count 32 bit words
+// from the start of the meshlet buffer
+struct GPUMeshlet
+{
+  // mesh space bounding sphere, center and radius
+  glm::vec4 sphere;
+  // normal cone, axis and cutoff
+  glm::vec4 cone;
+  uint32_t firstIndex;
+  uint32_t triangleCount;
+  uint32_t vertexOffset;
+  uint32_t vertexCount;
+  uint32_t triangleOffset;
+  uint32_t pad[3];
 };
+static_assert(sizeof(GPUMeshlet) == 64, "has to match object_data.glsl");
+
+// one gpx::MeshLod as the shaders see it
+struct GPUMeshLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+  uint32_t pad;
+};
+static_assert(sizeof(GPUMeshLod) == 16, "has to match object_data.glsl");
 
 // push constants for our mesh object draws
 struct GPUDrawPushConstants
@@ -112,6 +152,40 @@ struct GPUDrawPushConstants
   glm::mat4 worldMatrix;
   VkDeviceAddress vertexBuffer;
 };
+
+// one render object as the shaders see it, indexed by its RenderObjectId
+struct GPUObjectData
+{
+  glm::mat4 transform;
+  // world space bounding sphere, center and radius
+  glm::vec4 sphere;
+  // world space half extents of the box around the sphere center
+  glm::vec4 extents;
+  VkDeviceAddress vertexBuffer;
+  uint32_t materialIndex;
+  // index range of the surface
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // GPUObjectBuffer::DrawBucket of the object, NoDrawBucket once removed
+  uint32_t drawBucket;
+  VkDeviceAddress meshletBuffer;
+  // meshlets of the surface, none when the mesh has no meshlet buffer
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  // word of the meshlet buffer the levels of detail start at, the first one
+  // is the full surface
+  uint32_t firstLod;
+  uint32_t lodCount;
+};
+static_assert(sizeof(GPUObjectData) == 144, "has to match object_data.glsl");
+
+// push constants of the material pipelines, the instance index of a draw
+// points into the instance buffer, which holds the id of its object
+struct GPUObjectPushConstants
+{
+  VkDeviceAddress objectBuffer;
+  VkDeviceAddress instanceBuffer;
+};
 enum class MaterialPass : uint8_t
 {
   MainColor,
@@ -122,6 +196,7 @@ struct MaterialPipeline
 {
   VkPipeline pipeline;
   VkPipelineLayout layout;
+  uint32_t sortId {0};
 };
 
 struct MaterialInstance
@@ -129,6 +204,7 @@ struct MaterialInstance
   MaterialPipeline* pipeline;
   VkDescriptorSet materialSet;
   MaterialPass passType;
+  uint32_t sortId {0};
 };
 struct DrawContext;
 
@@ -157,7 +233,7 @@ struct Node : public IRenderable
   void refreshTransform(const glm::mat4& parentMatrix)
   {
     worldTransform = parentMatrix * localTransform;
-    for (auto c : children)
+    for (auto& c : children)
     {
       c->refreshTransform(worldTransform);
     }
@@ -185,13 +261,28 @@ struct RenderObject
   VkBuffer indexBuffer;
 
   MaterialInstance* material;
+  uint32_t meshId;
   Bounds bounds;
   glm::mat4 transform;
   VkDeviceAddress vertexBufferAddress;
+  // drawn into the CPU occlusion buffer, nullptr for most objects
+  const culling::OccluderMesh* occluder;
+  VkDeviceAddress meshletBuffer;
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  // levels of detail of the surface, owned by the mesh, and where they are
+  // in the meshlet buffer
+  const gpx::MeshLod* lods;
+  uint32_t lodCount;
+  uint32_t lodOffset;
+  // from the glTF material, the back faces are drawn too
+  bool bDoubleSided;
 };
 struct DrawContext
 {
   std::vector<RenderObject> OpaqueSurfaces {};
+  // world space bounds of OpaqueSurfaces, in the same order
+  culling::BoundsSoA OpaqueBounds {};
   std::vector<RenderObject> TransparentSurfaces;
 };
 struct MeshNode : public Node
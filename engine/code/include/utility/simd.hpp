@@ -0,0 +1,92 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HM_SIMD_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace hm::simd
+{
+// out = a * b for column major matrices, out may alias a or b
+inline void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b,
+                             glm::mat4& out)
+{
+#ifdef HM_SIMD_SSE
+  const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+  const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+  const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+  const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+  __m128 columns[4];
+  for (int i = 0; i < 4; i++)
+  {
+    // every column of the result is a linear combination of the columns of a
+    const __m128 column = _mm_loadu_ps(&b[i][0]);
+    __m128 result = _mm_mul_ps(
+        a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+    result = _mm_add_ps(
+        result,
+        _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+    result = _mm_add_ps(
+        result,
+        _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+    result = _mm_add_ps(
+        result,
+        _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+    columns[i] = result;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    _mm_storeu_ps(&out[i][0], columns[i]);
+  }
+#else
+  out = a * b;
+#endif
+}
+// out[i] = *a[i] * b[i] for four matrices at once, one matrix per SIMD lane.
+// b and out are four consecutive matrices, out may not alias a or b.
+inline void MultiplyMatrices4(const glm::mat4* const a[4], const glm::mat4* b,
+                              glm::mat4* out)
+{
+#ifdef HM_SIMD_SSE
+  // lhs[column][row] holds element [column][row] of the four matrices
+  __m128 lhs[4][4];
+  __m128 rhs[4][4];
+  for (int column = 0; column < 4; column++)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      lhs[column][i] = _mm_loadu_ps(&(*a[i])[column][0]);
+      rhs[column][i] = _mm_loadu_ps(&b[i][column][0]);
+    }
+    _MM_TRANSPOSE4_PS(lhs[column][0], lhs[column][1], lhs[column][2],
+                      lhs[column][3]);
+    _MM_TRANSPOSE4_PS(rhs[column][0], rhs[column][1], rhs[column][2],
+                      rhs[column][3]);
+  }
+  for (int column = 0; column < 4; column++)
+  {
+    __m128 result[4];
+    for (int row = 0; row < 4; row++)
+    {
+      __m128 sum = _mm_mul_ps(lhs[0][row], rhs[column][0]);
+      sum = _mm_add_ps(sum, _mm_mul_ps(lhs[1][row], rhs[column][1]));
+      sum = _mm_add_ps(sum, _mm_mul_ps(lhs[2][row], rhs[column][2]));
+      sum = _mm_add_ps(sum, _mm_mul_ps(lhs[3][row], rhs[column][3]));
+      result[row] = sum;
+    }
+    // back to one matrix per register
+    _MM_TRANSPOSE4_PS(result[0], result[1], result[2], result[3]);
+    for (int i = 0; i < 4; i++)
+    {
+      _mm_storeu_ps(&out[i][column][0], result[i]);
+    }
+  }
+#else
+  for (int i = 0; i < 4; i++)
+  {
+    out[i] = *a[i] * b[i];
+  }
+#endif
+}
+} // namespace hm::simd
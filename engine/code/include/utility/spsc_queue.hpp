@@ -0,0 +1,79 @@
+#pragma once
+#include "utility/macros.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace hm
+{
+// Lock-free queue for exactly one producer thread and one consumer thread.
+// Push and Pop block (without spinning) while the queue is full or empty.
+template<typename T, u32 Capacity>
+class SpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity has to be a power of two");
+
+ public:
+  SpscQueue() = default;
+  HM_NON_COPYABLE_NON_MOVABLE(SpscQueue);
+
+  bool TryPush(const T& value)
+  {
+    const u32 tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+    {
+      return false;
+    }
+    m_items[tail & (Capacity - 1)] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_tail.notify_one();
+    return true;
+  }
+  bool TryPop(T& value)
+  {
+    const u32 head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    value = m_items[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    m_head.notify_one();
+    return true;
+  }
+
+  void Push(const T& value)
+  {
+    while (TryPush(value) == false)
+    {
+      // only the consumer moves the head, wait for it to make room
+      const u32 head = m_head.load(std::memory_order_acquire);
+      if (m_tail.load(std::memory_order_relaxed) - head == Capacity)
+      {
+        m_head.wait(head, std::memory_order_acquire);
+      }
+    }
+  }
+  T Pop()
+  {
+    T value;
+    while (TryPop(value) == false)
+    {
+      // only the producer moves the tail, wait for something to arrive
+      const u32 tail = m_tail.load(std::memory_order_acquire);
+      if (m_head.load(std::memory_order_relaxed) == tail)
+      {
+        m_tail.wait(tail, std::memory_order_acquire);
+      }
+    }
+    return value;
+  }
+
+ private:
+  // on separate cache lines so the two threads do not fight over them
+  alignas(64) std::atomic<u32> m_head {0};
+  alignas(64) std::atomic<u32> m_tail {0};
+  std::array<T, Capacity> m_items {};
+};
+} // namespace hm
@@ -7,10 +7,12 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
-void Camera::Update(f32)
+void Camera::Update(f32 dt)
 {
   glm::mat4 cameraRotation = getRotationMatrix();
-  position += glm::vec3(cameraRotation * glm::vec4(velocity * 0.5f, 0.f));
+  previousPosition = position;
+  position +=
+      glm::vec3(cameraRotation * glm::vec4(velocity * speed * dt, 0.f));
 }
 void Camera::Render() {}
 Camera::~Camera() {}
@@ -73,13 +75,19 @@ void Camera::HandleInput(SDL_Event* event)
   }
 }
 
-Camera::Camera(const std::string& name) : System(name) {}
+Camera::Camera(const std::string& name) : System(name)
+{
+  // the camera only moves itself, it can run next to any other system
+  m_access.bExclusive = false;
+}
 glm::mat4 Camera::getViewMatrix() const
 {
   // to create a correct model view, we need to move the world in opposite
   // direction to the camera
   //  so we will create the camera model matrix and invert
-  glm::mat4 cameraTranslation = glm::translate(glm::mat4(1.f), position);
+  const float alpha = hm::Engine::Instance().GetInterpolationAlpha();
+  glm::mat4 cameraTranslation = glm::translate(
+      glm::mat4(1.f), glm::mix(previousPosition, position, alpha));
   glm::mat4 cameraRotation = getRotationMatrix();
   return glm::inverse(cameraTranslation * cameraRotation);
 }
@@ -0,0 +1,177 @@
+#include "core/bvh.hpp"
+
+#include "external/tracy_impl.hpp"
+
+using namespace hm::culling;
+
+namespace
+{
+Aabb Merge(const Aabb& a, const Aabb& b)
+{
+  return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+glm::vec3 Center(const Aabb& box)
+{
+  return (box.min + box.max) * 0.5f;
+}
+} // namespace
+
+void Bvh::Build(std::span<const Aabb> items)
+{
+  HM_ZONE_SCOPED_N("Bvh::Build");
+  m_nodes.clear();
+  m_items.resize(items.size());
+  for (u32 i = 0; i < m_items.size(); i++)
+  {
+    m_items[i] = i;
+  }
+  if (items.empty())
+  {
+    return;
+  }
+  // a binary tree with full leaves has about 2n / LeafSize nodes
+  m_nodes.reserve(2 * items.size() / LeafSize + 1);
+  // the splits compare centers over and over
+  std::vector<glm::vec3> centers(items.size());
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    centers[i] = Center(items[i]);
+  }
+  BuildNode(items, centers, 0, static_cast<u32>(items.size()));
+}
+
+u32 Bvh::BuildNode(std::span<const Aabb> items,
+                   std::span<const glm::vec3> centers, u32 firstItem,
+                   u32 itemCount)
+{
+  const u32 index = static_cast<u32>(m_nodes.size());
+  m_nodes.emplace_back();
+
+  Aabb bounds = items[m_items[firstItem]];
+  glm::vec3 centerMin = centers[m_items[firstItem]];
+  glm::vec3 centerMax = centerMin;
+  for (u32 i = firstItem + 1; i < firstItem + itemCount; i++)
+  {
+    bounds = Merge(bounds, items[m_items[i]]);
+    centerMin = glm::min(centerMin, centers[m_items[i]]);
+    centerMax = glm::max(centerMax, centers[m_items[i]]);
+  }
+
+  Node node;
+  node.bounds = bounds;
+  node.firstItem = firstItem;
+  node.itemCount = itemCount;
+  if (itemCount > LeafSize)
+  {
+    // split the centers in half along the axis they are spread the most
+    const glm::vec3 spread = centerMax - centerMin;
+    const int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2)
+                                         : (spread.y > spread.z ? 1 : 2);
+    const u32 half = itemCount / 2;
+    auto first = m_items.begin() + firstItem;
+    std::nth_element(first, first + half, first + itemCount,
+                     [&centers, axis](u32 a, u32 b)
+                     {
+                       return centers[a][axis] < centers[b][axis];
+                     });
+    node.leftChild = BuildNode(items, centers, firstItem, half);
+    node.rightChild =
+        BuildNode(items, centers, firstItem + half, itemCount - half);
+  }
+  // the vector may have grown while building the children
+  m_nodes[index] = node;
+  return index;
+}
+
+void Bvh::Refit(std::span<const Aabb> items)
+{
+  HM_ZONE_SCOPED_N("Bvh::Refit");
+  SDL_assert(items.size() == m_items.size());
+  // children come after their parent, so walking backwards visits them first
+  for (u32 index = GetNodeCount(); index-- > 0;)
+  {
+    Node& node = m_nodes[index];
+    if (node.leftChild == 0)
+    {
+      node.bounds = items[m_items[node.firstItem]];
+      for (u32 i = node.firstItem + 1; i < node.firstItem + node.itemCount;
+           i++)
+      {
+        node.bounds = Merge(node.bounds, items[m_items[i]]);
+      }
+    }
+    else
+    {
+      node.bounds = Merge(m_nodes[node.leftChild].bounds,
+                          m_nodes[node.rightChild].bounds);
+    }
+  }
+}
+
+void Bvh::Query(const Frustum& frustum, std::vector<u32>& visible) const
+{
+  HM_ZONE_SCOPED_N("Bvh::Query");
+  if (m_nodes.empty())
+  {
+    return;
+  }
+
+  // every entry carries the planes its parent still crossed, a box inside a
+  // plane has all of its children inside it too
+  constexpr u32 AllPlanes = (1u << 6) - 1;
+  struct Entry
+  {
+    u32 node;
+    u32 planeMask;
+  };
+  // the median split keeps the tree balanced, one entry per level is plenty
+  std::array<Entry, 64> stack;
+  u32 stackSize = 0;
+  stack[stackSize++] = {0, AllPlanes};
+
+  while (stackSize > 0)
+  {
+    const Entry entry = stack[--stackSize];
+    const Node& node = m_nodes[entry.node];
+    const glm::vec3 center = Center(node.bounds);
+    const glm::vec3 extents = node.bounds.max - center;
+
+    u32 planeMask = 0;
+    bool bOutside = false;
+    for (u32 plane = 0; plane < 6; plane++)
+    {
+      if ((entry.planeMask & (1u << plane)) == 0)
+      {
+        continue;
+      }
+      const glm::vec4& p = frustum.planes[plane];
+      const f32 distance = glm::dot(glm::vec3(p), center) + p.w;
+      const f32 radius = glm::dot(glm::abs(glm::vec3(p)), extents);
+      if (distance + radius < 0.f)
+      {
+        bOutside = true;
+        break;
+      }
+      if (distance - radius < 0.f)
+      {
+        planeMask |= 1u << plane;
+      }
+    }
+    if (bOutside)
+    {
+      continue;
+    }
+
+    if (planeMask == 0 || node.leftChild == 0)
+    {
+      // fully inside, or a leaf that the item tests would barely improve on
+      visible.insert(visible.end(), m_items.begin() + node.firstItem,
+                     m_items.begin() + node.firstItem + node.itemCount);
+      continue;
+    }
+    SDL_assert(stackSize + 2 <= stack.size());
+    stack[stackSize++] = {node.rightChild, planeMask};
+    stack[stackSize++] = {node.leftChild, planeMask};
+  }
+}
@@ -0,0 +1,139 @@
+#include "core/commands.hpp"
+
+#include "external/tracy_impl.hpp"
+
+using namespace hm::ecs;
+
+void* CommandArena::Allocate(size_t size, size_t alignment)
+{
+  while (true)
+  {
+    if (m_block < m_blocks.size())
+    {
+      Block& block = m_blocks[m_block];
+      const uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get());
+      const uintptr_t aligned =
+          (start + m_used + alignment - 1) & ~(uintptr_t {alignment} - 1);
+      if (aligned + size <= start + block.size)
+      {
+        m_used = aligned + size - start;
+        return reinterpret_cast<void*>(aligned);
+      }
+      m_block++;
+      m_used = 0;
+      continue;
+    }
+    // commands bigger than a block get one of their own
+    const size_t blockSize = std::max(BlockSize, size + alignment);
+    m_blocks.push_back({std::make_unique<std::byte[]>(blockSize), blockSize});
+  }
+}
+
+void CommandArena::Append(Header* header)
+{
+  if (m_last == nullptr)
+  {
+    m_first = header;
+  }
+  else
+  {
+    m_last->next = header;
+  }
+  m_last = header;
+}
+
+void CommandArena::Execute(Registry& registry,
+                           std::span<const Entity> created)
+{
+  for (Header* header = m_first; header != nullptr; header = header->next)
+  {
+    header->execute(header->command, registry, created);
+  }
+  Reset();
+}
+
+void CommandArena::Reset()
+{
+  for (Header* header = m_first; header != nullptr; header = header->next)
+  {
+    header->destroy(header->command);
+  }
+  m_first = nullptr;
+  m_last = nullptr;
+  m_block = 0;
+  m_used = 0;
+}
+
+void CommandArena::Swap(CommandArena& other) noexcept
+{
+  std::swap(m_blocks, other.m_blocks);
+  std::swap(m_block, other.m_block);
+  std::swap(m_used, other.m_used);
+  std::swap(m_first, other.m_first);
+  std::swap(m_last, other.m_last);
+}
+
+PendingEntity CommandBuffer::CreateEntity()
+{
+  std::scoped_lock lock(m_mutex);
+  return PendingEntity {m_createdCount++, this};
+}
+
+void CommandBuffer::DestroyEntity(Entity entity)
+{
+  std::scoped_lock lock(m_mutex);
+  m_destroyed.push_back(entity);
+}
+
+bool CommandBuffer::IsEmpty() const
+{
+  std::scoped_lock lock(m_mutex);
+  return m_commands.IsEmpty() && m_destroyed.empty() && m_createdCount == 0;
+}
+
+void CommandBuffer::Clear()
+{
+  std::scoped_lock lock(m_mutex);
+  m_commands.Reset();
+  m_destroyed.clear();
+  m_createdCount = 0;
+}
+
+void CommandBuffer::Playback(Registry& registry)
+{
+  HM_ZONE_SCOPED_N("CommandBuffer::Playback");
+  CommandArena commands;
+  std::vector<Entity> destroyed;
+  u32 createdCount = 0;
+  {
+    // take everything out so the owner can keep recording in the meantime
+    std::scoped_lock lock(m_mutex);
+    commands.Swap(m_commands);
+    destroyed.swap(m_destroyed);
+    std::swap(createdCount, m_createdCount);
+  }
+
+  // all the entities of the buffer are created in a single batch
+  std::vector<Entity> created(createdCount);
+  registry.create(created.begin(), created.end());
+
+  commands.Execute(registry, created);
+  {
+    // the blocks go back for the next frame, unless the owner had to start
+    // new ones meanwhile
+    std::scoped_lock lock(m_mutex);
+    if (m_commands.HasBlocks() == false)
+    {
+      m_commands.Swap(commands);
+    }
+  }
+
+  for (const Entity entity : destroyed)
+  {
+    // the same entity may have been queued by more than one thread
+    if (registry.valid(entity))
+    {
+      registry.destroy(entity);
+    }
+  }
+}
@@ -0,0 +1,408 @@
+#include "core/culling.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define HM_CULLING_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without extra flags
+#define HM_TARGET_AVX2
+#else
+#define HM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define HM_CULLING_X86 0
+#endif
+
+using namespace hm::culling;
+
+namespace
+{
+// objects [first, first + count)
+struct RangeIndices
+{
+  u32 first {0};
+
+  u32 operator[](u32 i) const { return first + i; }
+};
+// objects listed by index
+struct ListIndices
+{
+  const u32* indices {nullptr};
+
+  u32 operator[](u32 i) const { return indices[i]; }
+};
+
+// Per plane: distance of the center, plus whichever of the sphere radius and
+// the box projected onto the normal is smaller. Rejecting on either shape is
+// the same as taking the smaller of the two, one plane at a time.
+template<typename Indices>
+u32 CullScalar(const Frustum& frustum, const BoundsSoA& bounds,
+               const Indices& indices, u32 begin, u32 end, u32* visible)
+{
+  u32 visibleCount = 0;
+  for (u32 n = begin; n < end; n++)
+  {
+    const u32 i = indices[n];
+    bool bInside = true;
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      const f32 distance = plane.x * bounds.centerX[i] +
+                           plane.y * bounds.centerY[i] +
+                           plane.z * bounds.centerZ[i] + plane.w;
+      const f32 boxRadius = std::abs(plane.x) * bounds.extentX[i] +
+                            std::abs(plane.y) * bounds.extentY[i] +
+                            std::abs(plane.z) * bounds.extentZ[i];
+      bInside &= distance + std::min(bounds.radius[i], boxRadius) >= 0.f;
+    }
+    // written either way, only kept when inside
+    visible[visibleCount] = i;
+    visibleCount += bInside ? 1 : 0;
+  }
+  return visibleCount;
+}
+
+#if HM_CULLING_X86
+// turns the lanes set in `mask` into the indices of the batch at `n`
+template<typename Indices>
+u32 WriteVisible(u32 mask, const Indices& indices, u32 n, u32* visible)
+{
+  u32 visibleCount = 0;
+  while (mask != 0)
+  {
+    visible[visibleCount++] = indices[n + std::countr_zero(mask)];
+    mask &= mask - 1;
+  }
+  return visibleCount;
+}
+
+__m128 Load4(const std::vector<f32>& values, const RangeIndices& indices,
+             u32 n)
+{
+  return _mm_loadu_ps(&values[indices[n]]);
+}
+__m128 Load4(const std::vector<f32>& values, const ListIndices& indices,
+             u32 n)
+{
+  const u32* i = indices.indices + n;
+  return _mm_setr_ps(values[i[0]], values[i[1]], values[i[2]], values[i[3]]);
+}
+HM_TARGET_AVX2 __m256 Load8(const std::vector<f32>& values,
+                            const RangeIndices& indices, u32 n)
+{
+  return _mm256_loadu_ps(&values[indices[n]]);
+}
+HM_TARGET_AVX2 __m256 Load8(const std::vector<f32>& values,
+                            const ListIndices& indices, u32 n)
+{
+  const __m256i offsets = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(indices.indices + n));
+  return _mm256_i32gather_ps(values.data(), offsets, sizeof(f32));
+}
+
+template<typename Indices>
+u32 CullSse(const Frustum& frustum, const BoundsSoA& bounds,
+            const Indices& indices, u32 begin, u32 end, u32* visible)
+{
+  constexpr u32 Width = 4;
+  const __m128 signMask = _mm_set1_ps(-0.f);
+  const __m128 zero = _mm_setzero_ps();
+
+  u32 visibleCount = 0;
+  u32 n = begin;
+  for (; n + Width <= end; n += Width)
+  {
+    const __m128 centerX = Load4(bounds.centerX, indices, n);
+    const __m128 centerY = Load4(bounds.centerY, indices, n);
+    const __m128 centerZ = Load4(bounds.centerZ, indices, n);
+    const __m128 radius = Load4(bounds.radius, indices, n);
+    const __m128 extentX = Load4(bounds.extentX, indices, n);
+    const __m128 extentY = Load4(bounds.extentY, indices, n);
+    const __m128 extentZ = Load4(bounds.extentZ, indices, n);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      const __m128 normalX = _mm_set1_ps(plane.x);
+      const __m128 normalY = _mm_set1_ps(plane.y);
+      const __m128 normalZ = _mm_set1_ps(plane.z);
+      __m128 distance = _mm_add_ps(_mm_mul_ps(normalX, centerX),
+                                   _mm_set1_ps(plane.w));
+      distance = _mm_add_ps(distance, _mm_mul_ps(normalY, centerY));
+      distance = _mm_add_ps(distance, _mm_mul_ps(normalZ, centerZ));
+
+      __m128 boxRadius =
+          _mm_mul_ps(_mm_andnot_ps(signMask, normalX), extentX);
+      boxRadius = _mm_add_ps(
+          boxRadius, _mm_mul_ps(_mm_andnot_ps(signMask, normalY), extentY));
+      boxRadius = _mm_add_ps(
+          boxRadius, _mm_mul_ps(_mm_andnot_ps(signMask, normalZ), extentZ));
+
+      const __m128 reach = _mm_add_ps(distance, _mm_min_ps(radius, boxRadius));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(reach, zero));
+    }
+    visibleCount += WriteVisible(static_cast<u32>(_mm_movemask_ps(inside)),
+                                 indices, n, visible + visibleCount);
+  }
+  return visibleCount + CullScalar(frustum, bounds, indices, n, end,
+                                   visible + visibleCount);
+}
+
+template<typename Indices>
+HM_TARGET_AVX2 u32 CullAvx2(const Frustum& frustum, const BoundsSoA& bounds,
+                            const Indices& indices, u32 begin, u32 end,
+                            u32* visible)
+{
+  constexpr u32 Width = 8;
+  const __m256 signMask = _mm256_set1_ps(-0.f);
+  const __m256 zero = _mm256_setzero_ps();
+
+  u32 visibleCount = 0;
+  u32 n = begin;
+  for (; n + Width <= end; n += Width)
+  {
+    const __m256 centerX = Load8(bounds.centerX, indices, n);
+    const __m256 centerY = Load8(bounds.centerY, indices, n);
+    const __m256 centerZ = Load8(bounds.centerZ, indices, n);
+    const __m256 radius = Load8(bounds.radius, indices, n);
+    const __m256 extentX = Load8(bounds.extentX, indices, n);
+    const __m256 extentY = Load8(bounds.extentY, indices, n);
+    const __m256 extentZ = Load8(bounds.extentZ, indices, n);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      const __m256 normalX = _mm256_set1_ps(plane.x);
+      const __m256 normalY = _mm256_set1_ps(plane.y);
+      const __m256 normalZ = _mm256_set1_ps(plane.z);
+      __m256 distance = _mm256_add_ps(_mm256_mul_ps(normalX, centerX),
+                                      _mm256_set1_ps(plane.w));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(normalY, centerY));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(normalZ, centerZ));
+
+      __m256 boxRadius =
+          _mm256_mul_ps(_mm256_andnot_ps(signMask, normalX), extentX);
+      boxRadius = _mm256_add_ps(
+          boxRadius,
+          _mm256_mul_ps(_mm256_andnot_ps(signMask, normalY), extentY));
+      boxRadius = _mm256_add_ps(
+          boxRadius,
+          _mm256_mul_ps(_mm256_andnot_ps(signMask, normalZ), extentZ));
+
+      const __m256 reach =
+          _mm256_add_ps(distance, _mm256_min_ps(radius, boxRadius));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(reach, zero, _CMP_GE_OQ));
+    }
+    visibleCount +=
+        WriteVisible(static_cast<u32>(_mm256_movemask_ps(inside)), indices, n,
+                     visible + visibleCount);
+  }
+  return visibleCount + CullScalar(frustum, bounds, indices, n, end,
+                                   visible + visibleCount);
+}
+
+bool HasAvx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+  {
+    return false;
+  }
+  // the OS has to save the ymm registers as well
+  __cpuid(info, 1);
+  const bool bOsSaves = (info[2] & (1 << 27)) != 0;
+  const bool bAvx = (info[2] & (1 << 28)) != 0;
+  if (bOsSaves == false || bAvx == false || (_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+template<typename Indices>
+using Kernel = u32 (*)(const Frustum&, const BoundsSoA&, const Indices&, u32,
+                       u32, u32*);
+struct KernelChoice
+{
+  Kernel<RangeIndices> range {nullptr};
+  Kernel<ListIndices> list {nullptr};
+  const char* name {nullptr};
+};
+
+const KernelChoice& GetKernel()
+{
+  static const KernelChoice choice = []() -> KernelChoice
+  {
+#if HM_CULLING_X86
+    if (HasAvx2())
+    {
+      return {CullAvx2<RangeIndices>, CullAvx2<ListIndices>, "AVX2"};
+    }
+    // part of every x86-64 CPU
+    return {CullSse<RangeIndices>, CullSse<ListIndices>, "SSE"};
+#else
+    return {CullScalar<RangeIndices>, CullScalar<ListIndices>, "Scalar"};
+#endif
+  }();
+  return choice;
+}
+} // namespace
+
+Frustum hm::culling::ExtractFrustum(const glm::mat4& viewProjection)
+{
+  // rows of the matrix, glm stores columns
+  const glm::mat4 rows = glm::transpose(viewProjection);
+  Frustum frustum;
+  frustum.planes[0] = rows[3] + rows[0];
+  frustum.planes[1] = rows[3] - rows[0];
+  frustum.planes[2] = rows[3] + rows[1];
+  frustum.planes[3] = rows[3] - rows[1];
+  // 0 <= z <= w, with reversed depth these two swap meaning
+  frustum.planes[4] = rows[2];
+  frustum.planes[5] = rows[3] - rows[2];
+  for (glm::vec4& plane : frustum.planes)
+  {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+void BoundsSoA::Clear()
+{
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  radius.clear();
+  extentX.clear();
+  extentY.clear();
+  extentZ.clear();
+}
+
+void BoundsSoA::Reserve(u32 count)
+{
+  centerX.reserve(count);
+  centerY.reserve(count);
+  centerZ.reserve(count);
+  radius.reserve(count);
+  extentX.reserve(count);
+  extentY.reserve(count);
+  extentZ.reserve(count);
+}
+
+u32 BoundsSoA::Add(const glm::mat4& transform, const glm::vec3& origin,
+                   f32 sphereRadius, const glm::vec3& extents)
+{
+  const u32 index = GetCount();
+  centerX.push_back(0.f);
+  centerY.push_back(0.f);
+  centerZ.push_back(0.f);
+  radius.push_back(0.f);
+  extentX.push_back(0.f);
+  extentY.push_back(0.f);
+  extentZ.push_back(0.f);
+  Set(index, transform, origin, sphereRadius, extents);
+  return index;
+}
+
+void BoundsSoA::Set(u32 index, const glm::mat4& transform,
+                    const glm::vec3& origin, f32 sphereRadius,
+                    const glm::vec3& extents)
+{
+  const WorldBounds world =
+      TransformBounds(transform, origin, sphereRadius, extents);
+  centerX[index] = world.center.x;
+  centerY[index] = world.center.y;
+  centerZ[index] = world.center.z;
+  radius[index] = world.radius;
+  extentX[index] = world.extents.x;
+  extentY[index] = world.extents.y;
+  extentZ[index] = world.extents.z;
+}
+
+WorldBounds hm::culling::TransformBounds(const glm::mat4& transform,
+                                         const glm::vec3& origin,
+                                         f32 sphereRadius,
+                                         const glm::vec3& extents)
+{
+  const glm::vec3 center = glm::vec3(transform * glm::vec4(origin, 1.f));
+  const glm::mat3 linear(transform);
+  // every world axis gets the projections of all three local half extents
+  const glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]),
+                           glm::abs(linear[2]));
+  const glm::vec3 worldExtents = absolute * extents;
+  const f32 scale = std::max({glm::length(linear[0]), glm::length(linear[1]),
+                              glm::length(linear[2])});
+
+  return {center, sphereRadius * scale, worldExtents};
+}
+
+u32 BoundsSoA::Append(const BoundsSoA& source, u32 sourceIndex)
+{
+  const u32 index = GetCount();
+  centerX.push_back(source.centerX[sourceIndex]);
+  centerY.push_back(source.centerY[sourceIndex]);
+  centerZ.push_back(source.centerZ[sourceIndex]);
+  radius.push_back(source.radius[sourceIndex]);
+  extentX.push_back(source.extentX[sourceIndex]);
+  extentY.push_back(source.extentY[sourceIndex]);
+  extentZ.push_back(source.extentZ[sourceIndex]);
+  return index;
+}
+
+void BoundsSoA::Copy(u32 index, const BoundsSoA& source, u32 sourceIndex)
+{
+  centerX[index] = source.centerX[sourceIndex];
+  centerY[index] = source.centerY[sourceIndex];
+  centerZ[index] = source.centerZ[sourceIndex];
+  radius[index] = source.radius[sourceIndex];
+  extentX[index] = source.extentX[sourceIndex];
+  extentY[index] = source.extentY[sourceIndex];
+  extentZ[index] = source.extentZ[sourceIndex];
+}
+
+void BoundsSoA::SwapRemove(u32 index)
+{
+  const u32 last = GetCount() - 1;
+  Copy(index, *this, last);
+  centerX.pop_back();
+  centerY.pop_back();
+  centerZ.pop_back();
+  radius.pop_back();
+  extentX.pop_back();
+  extentY.pop_back();
+  extentZ.pop_back();
+}
+
+u32 hm::culling::Cull(const Frustum& frustum, const BoundsSoA& bounds,
+                      u32 first, u32 count, u32* visible)
+{
+  HM_ZONE_SCOPED_N("culling::Cull");
+  SDL_assert(first + count <= bounds.GetCount());
+  return GetKernel().range(frustum, bounds, RangeIndices {first}, 0, count,
+                           visible);
+}
+
+u32 hm::culling::Cull(const Frustum& frustum, const BoundsSoA& bounds,
+                      std::span<const u32> candidates, u32* visible)
+{
+  HM_ZONE_SCOPED_N("culling::Cull");
+  return GetKernel().list(frustum, bounds, ListIndices {candidates.data()}, 0,
+                          static_cast<u32>(candidates.size()), visible);
+}
+
+const char* hm::culling::GetKernelName()
+{
+  return GetKernel().name;
+}
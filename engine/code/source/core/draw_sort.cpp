@@ -0,0 +1,156 @@
+#include "core/draw_sort.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+using namespace hm::gpx;
+
+u64 hm::gpx::MakeDrawKey(u32 pipeline, u32 material, u32 mesh, u32 depth)
+{
+  constexpr u64 PipelineMask = (1ull << PipelineKeyBits) - 1;
+  constexpr u64 MaterialMask = (1ull << MaterialKeyBits) - 1;
+  constexpr u64 MeshMask = (1ull << MeshKeyBits) - 1;
+  constexpr u64 DepthMask = (1ull << DepthKeyBits) - 1;
+  static_assert(PipelineKeyBits + MaterialKeyBits + MeshKeyBits +
+                    DepthKeyBits ==
+                64);
+  return ((pipeline & PipelineMask)
+          << (MaterialKeyBits + MeshKeyBits + DepthKeyBits)) |
+         ((material & MaterialMask) << (MeshKeyBits + DepthKeyBits)) |
+         ((mesh & MeshMask) << DepthKeyBits) | (depth & DepthMask);
+}
+
+u32 hm::gpx::QuantizeDepth(f32 depth, f32 nearPlane, f32 farPlane)
+{
+  constexpr f32 Steps = static_cast<f32>((1u << DepthKeyBits) - 1);
+  const f32 clamped = std::clamp(depth, nearPlane, farPlane);
+  const f32 t =
+      std::log2(clamped / nearPlane) / std::log2(farPlane / nearPlane);
+  return static_cast<u32>(t * Steps);
+}
+
+void hm::gpx::RadixSort(std::span<u64> keys, std::span<u32> values,
+                        std::vector<u64>& keyScratch,
+                        std::vector<u32>& valueScratch)
+{
+  HM_ZONE_SCOPED_N("RadixSort");
+  SDL_assert(keys.size() == values.size());
+  const size_t count = keys.size();
+  if (count < 2)
+  {
+    return;
+  }
+  keyScratch.resize(count);
+  valueScratch.resize(count);
+
+  // every digit's histogram in a single read of the keys
+  constexpr u32 Passes = 8;
+  std::array<std::array<u32, 256>, Passes> histograms {};
+  for (const u64 key : keys)
+  {
+    for (u32 pass = 0; pass < Passes; pass++)
+    {
+      histograms[pass][(key >> (pass * 8)) & 0xff]++;
+    }
+  }
+
+  u64* sourceKeys = keys.data();
+  u32* sourceValues = values.data();
+  u64* targetKeys = keyScratch.data();
+  u32* targetValues = valueScratch.data();
+  for (u32 pass = 0; pass < Passes; pass++)
+  {
+    std::array<u32, 256>& histogram = histograms[pass];
+    const u32 shift = pass * 8;
+    if (histogram[(sourceKeys[0] >> shift) & 0xff] == count)
+    {
+      continue;
+    }
+
+    u32 offset = 0;
+    for (u32& bucket : histogram)
+    {
+      const u32 size = bucket;
+      bucket = offset;
+      offset += size;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+      const u32 target = histogram[(sourceKeys[i] >> shift) & 0xff]++;
+      targetKeys[target] = sourceKeys[i];
+      targetValues[target] = sourceValues[i];
+    }
+    std::swap(sourceKeys, targetKeys);
+    std::swap(sourceValues, targetValues);
+  }
+
+  if (sourceKeys != keys.data())
+  {
+    std::copy_n(sourceKeys, count, keys.data());
+    std::copy_n(sourceValues, count, values.data());
+  }
+}
+
+bool DrawSorter::TryReuse(const std::vector<u64>& keys)
+{
+  // last frame's order applied to this frame's keys
+  const size_t count = keys.size();
+  m_sortedKeys.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    m_sortedKeys[i] = keys[m_order[i]];
+  }
+
+  // insertion sort, cheap while the draws only moved a little
+  size_t budget = count / MoveBudgetDivisor + 16;
+  for (size_t i = 1; i < count; i++)
+  {
+    const u64 key = m_sortedKeys[i];
+    const u32 position = m_order[i];
+    size_t j = i;
+    // equal keys stay in input order, like they do in the radix sort
+    for (; j > 0 && (m_sortedKeys[j - 1] > key ||
+                     (m_sortedKeys[j - 1] == key &&
+                      m_order[j - 1] > position));
+         j--)
+    {
+      if (budget-- == 0)
+      {
+        return false;
+      }
+      m_sortedKeys[j] = m_sortedKeys[j - 1];
+      m_order[j] = m_order[j - 1];
+    }
+    m_sortedKeys[j] = key;
+    m_order[j] = position;
+  }
+  return true;
+}
+
+void DrawSorter::Sort(std::vector<u64>& keys, std::vector<u32>& values)
+{
+  HM_ZONE_SCOPED_N("DrawSorter::Sort");
+  SDL_assert(keys.size() == values.size());
+  const size_t count = keys.size();
+
+  m_bReused = m_bFrameCoherent && m_order.size() == count &&
+              m_previousInput == values && TryReuse(keys);
+  if (m_bReused == false)
+  {
+    m_sortedKeys = keys;
+    m_order.resize(count);
+    std::iota(m_order.begin(), m_order.end(), 0u);
+    RadixSort(m_sortedKeys, m_order, m_keyScratch, m_valueScratch);
+  }
+
+  m_previousInput = values;
+  for (size_t i = 0; i < count; i++)
+  {
+    values[i] = m_previousInput[m_order[i]];
+  }
+  keys.swap(m_sortedKeys);
+}
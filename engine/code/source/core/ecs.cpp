@@ -1,12 +1,55 @@
 ﻿#include "core/ecs.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+hm::ecs::SystemTypeIndex hm::ecs::internal::NextSystemTypeIndex()
+{
+  static std::atomic<SystemTypeIndex> next {0};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
 hm::ecs::System::System(const std::string& name) : m_name(name) {}
+bool hm::ecs::System::IsOrderedBefore(const System& other) const
+{
+  return std::ranges::find(m_runBefore, other.m_typeIndex) !=
+             m_runBefore.end() ||
+         std::ranges::find(other.m_runAfter, m_typeIndex) !=
+             other.m_runAfter.end();
+}
+bool hm::ecs::SystemAccess::ConflictsWith(const SystemAccess& other) const
+{
+  if (bExclusive || other.bExclusive)
+  {
+    return true;
+  }
+  auto touches = [](const SystemAccess& access, ComponentId id)
+  {
+    return std::ranges::find(access.reads, id) != access.reads.end() ||
+           std::ranges::find(access.writes, id) != access.writes.end();
+  };
+  // write/write and read/write pairs have to be ordered, read/read is fine
+  for (const ComponentId id : writes)
+  {
+    if (touches(other, id))
+    {
+      return true;
+    }
+  }
+  for (const ComponentId id : other.writes)
+  {
+    if (touches(*this, id))
+    {
+      return true;
+    }
+  }
+  return false;
+}
 hm::ecs::Entity hm::ecs::EntityComponentSystem::CreateEntity()
 {
   return m_registry.create();
 }
 void hm::ecs::EntityComponentSystem::QueueEntityDeletion(const Entity entity)
 {
-  m_registry.emplace<DeleteFlag>(entity);
+  GetCommandBuffer().Emplace<DeleteFlag>(entity);
 }
 void hm::ecs::EntityComponentSystem::DeleteEntity(Entity entity)
 {
@@ -17,16 +60,161 @@ void hm::ecs::EntityComponentSystem::DeleteEntities()
   const auto deleteView = m_registry.view<DeleteFlag>();
   m_registry.destroy(deleteView.begin(), deleteView.end());
 }
-void hm::ecs::EntityComponentSystem::UpdateSystems(f32 dt)
+hm::ecs::CommandBuffer& hm::ecs::EntityComponentSystem::GetCommandBuffer()
 {
+  thread_local CommandBuffer* buffer = nullptr;
+  thread_local const EntityComponentSystem* owner = nullptr;
+  if (owner != this)
+  {
+    std::scoped_lock lock(m_commandBufferMutex);
+    buffer = m_commandBuffers.emplace_back(std::make_unique<CommandBuffer>())
+                 .get();
+    owner = this;
+  }
+  return *buffer;
+}
+void hm::ecs::EntityComponentSystem::FlushCommands()
+{
+  HM_ZONE_SCOPED_N("EntityComponentSystem::FlushCommands");
+  {
+    std::scoped_lock lock(m_commandBufferMutex);
+    for (const auto& buffer : m_commandBuffers)
+    {
+      buffer->Playback(m_registry);
+    }
+  }
+  DeleteEntities();
+}
+void hm::ecs::EntityComponentSystem::DropCommands()
+{
+  // the recorded entities belong to the registry that is being replaced
+  std::scoped_lock lock(m_commandBufferMutex);
+  for (const auto& buffer : m_commandBuffers)
+  {
+    buffer->Clear();
+  }
+}
+std::vector<std::byte> hm::ecs::EntityComponentSystem::SaveSnapshot() const
+{
+  return m_snapshotSerializer.Save(m_registry);
+}
+bool hm::ecs::EntityComponentSystem::SaveSnapshot(
+    const std::filesystem::path& path) const
+{
+  return m_snapshotSerializer.Save(m_registry, path);
+}
+bool hm::ecs::EntityComponentSystem::LoadSnapshot(
+    std::span<const std::byte> snapshot)
+{
+  DropCommands();
+  if (m_snapshotSerializer.Load(m_registry, snapshot) == false)
+  {
+    return false;
+  }
+  NotifySnapshotLoaded();
+  return true;
+}
+bool hm::ecs::EntityComponentSystem::LoadSnapshot(
+    const std::filesystem::path& path)
+{
+  DropCommands();
+  if (m_snapshotSerializer.Load(m_registry, path) == false)
+  {
+    return false;
+  }
+  NotifySnapshotLoaded();
+  return true;
+}
+void hm::ecs::EntityComponentSystem::NotifySnapshotLoaded()
+{
+  // a failed load leaves the registry alone, so this only runs on success
   for (const auto& system : m_systems)
   {
-    system->Update(dt);
+    system->OnSnapshotLoaded();
+  }
+}
+void hm::ecs::EntityComponentSystem::SortSystems()
+{
+  const u32 count = static_cast<u32>(m_systems.size());
+  std::vector<u32> incoming(count, 0);
+  std::vector<std::vector<u32>> outgoing(count);
+  for (u32 i = 0; i < count; i++)
+  {
+    for (u32 j = 0; j < count; j++)
+    {
+      if (i != j && m_systems[i]->IsOrderedBefore(*m_systems[j]))
+      {
+        outgoing[i].push_back(j);
+        incoming[j]++;
+      }
+    }
+  }
+
+  // Kahn's algorithm, always picking the lowest priority among the systems
+  // that are ready so the result is stable for equal priorities
+  auto comes_first = [this](u32 a, u32 b)
+  {
+    if (m_systems[a]->m_priority != m_systems[b]->m_priority)
+    {
+      return m_systems[a]->m_priority < m_systems[b]->m_priority;
+    }
+    return a < b;
+  };
+  std::vector<u32> ready;
+  for (u32 i = 0; i < count; i++)
+  {
+    if (incoming[i] == 0)
+    {
+      ready.push_back(i);
+    }
+  }
+
+  m_sortedSystems.clear();
+  while (ready.empty() == false)
+  {
+    auto next = std::ranges::min_element(ready, comes_first);
+    const u32 index = *next;
+    ready.erase(next);
+    m_sortedSystems.push_back(m_systems[index].get());
+    for (const u32 dependent : outgoing[index])
+    {
+      if (--incoming[dependent] == 0)
+      {
+        ready.push_back(dependent);
+      }
+    }
+  }
+
+  if (m_sortedSystems.size() != count)
+  {
+    log::Error("Systems have cyclic before/after constraints, falling back to "
+               "priority order");
+    m_sortedSystems.clear();
+    for (const auto& system : m_systems)
+    {
+      m_sortedSystems.push_back(system.get());
+    }
+    std::ranges::stable_sort(m_sortedSystems, {}, &System::m_priority);
+  }
+
+  m_scheduler.Invalidate();
+  m_bSystemsDirty = false;
+}
+void hm::ecs::EntityComponentSystem::UpdateSystems(f32 dt)
+{
+  if (m_bSystemsDirty)
+  {
+    SortSystems();
   }
+  m_scheduler.Update(m_sortedSystems, dt);
 }
 void hm::ecs::EntityComponentSystem::RenderSystems()
 {
-  for (const auto& system : m_systems)
+  if (m_bSystemsDirty)
+  {
+    SortSystems();
+  }
+  for (System* system : m_sortedSystems)
   {
     system->Render();
   }
@@ -0,0 +1,319 @@
+#include "core/jobs.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+
+#include <set>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace hm::jobs;
+
+namespace
+{
+// index of the worker that owns the calling thread, 0 for the main thread
+thread_local u32 threadIndex {0};
+} // namespace
+
+JobSystem::JobSystem(const JobSystemDesc& desc)
+{
+  const u32 hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+  const u32 workerCount =
+      desc.workerCount != 0 ? desc.workerCount : hardwareThreads - 1;
+
+  // queue 0 belongs to the main thread
+  m_queues.reserve(workerCount + 1);
+  for (u32 i = 0; i < workerCount + 1; i++)
+  {
+    m_queues.emplace_back(std::make_unique<WorkQueue>());
+  }
+
+  std::vector<u32> cores = desc.affinity;
+  if (desc.bPinWorkers && cores.empty())
+  {
+    if (desc.bPhysicalCoresOnly)
+    {
+      cores = QueryPhysicalCores();
+    }
+    for (u32 i = 0; cores.size() < workerCount + 1 && i < hardwareThreads; i++)
+    {
+      if (std::ranges::find(cores, i) == cores.end())
+      {
+        cores.push_back(i);
+      }
+    }
+  }
+
+  m_workers.reserve(workerCount);
+  for (u32 i = 1; i <= workerCount; i++)
+  {
+    m_workers.emplace_back(
+        [this, i]()
+        {
+          threadIndex = i;
+          WorkerLoop(i);
+        });
+    if (desc.bPinWorkers && cores.empty() == false)
+    {
+      PinThread(m_workers.back(), cores[i % cores.size()]);
+    }
+  }
+
+  log::Info("Job system started with {} worker(s){}", workerCount,
+            desc.bPinWorkers ? ", pinned" : "");
+}
+
+JobSystem::~JobSystem()
+{
+  m_bStop.store(true, std::memory_order_release);
+  // wake everyone up so they can see the stop flag
+  m_queuedJobs.fetch_add(1, std::memory_order_release);
+  m_queuedJobs.notify_all();
+  for (auto& worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+u32 JobSystem::GetThreadIndex()
+{
+  return threadIndex;
+}
+
+void JobSystem::Schedule(Job&& job, Counter* counter)
+{
+  if (counter != nullptr)
+  {
+    counter->m_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Job wrapped =
+      [this, job = std::move(job), counter]()
+  {
+    job();
+    Finish(counter);
+  };
+
+  // threads the job system does not know about share the main queue
+  WorkQueue& queue = *m_queues[threadIndex < m_queues.size() ? threadIndex : 0];
+  {
+    std::scoped_lock lock(queue.mutex);
+    queue.jobs.push_back(std::move(wrapped));
+  }
+  m_queuedJobs.fetch_add(1, std::memory_order_release);
+  m_queuedJobs.notify_one();
+}
+
+void JobSystem::ScheduleAfter(Counter& dependency, Job&& job, Counter* counter)
+{
+  {
+    std::scoped_lock lock(dependency.m_mutex);
+    if (dependency.IsDone() == false)
+    {
+      // keep the counter of the continuation busy until it actually starts
+      if (counter != nullptr)
+      {
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+      }
+      dependency.m_continuations.push_back(
+          [this, job = std::move(job), counter]() mutable
+          {
+            Schedule(std::move(job), counter);
+            Finish(counter);
+          });
+      return;
+    }
+  }
+  Schedule(std::move(job), counter);
+}
+
+void JobSystem::Finish(Counter* counter)
+{
+  if (counter == nullptr)
+  {
+    return;
+  }
+  // lock free while other jobs are still pending on the counter
+  u32 count = counter->m_count.load(std::memory_order_relaxed);
+  while (count > 1)
+  {
+    if (counter->m_count.compare_exchange_weak(count, count - 1,
+                                               std::memory_order_acq_rel))
+    {
+      return;
+    }
+  }
+
+  // possibly the last one, the waiter cannot leave Wait while this is locked
+  std::vector<Job> continuations;
+  {
+    std::scoped_lock lock(counter->m_mutex);
+    if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+      return;
+    }
+    continuations.swap(counter->m_continuations);
+  }
+  for (Job& continuation : continuations)
+  {
+    continuation();
+  }
+}
+
+void JobSystem::Wait(const Counter& counter)
+{
+  HM_ZONE_SCOPED_N("JobSystem::Wait");
+  const u32 index = threadIndex < m_queues.size() ? threadIndex : 0;
+  while (counter.IsDone() == false)
+  {
+    if (TryRunJob(index) == false)
+    {
+      std::this_thread::yield();
+    }
+  }
+  // the last job may still be inside Finish, wait for it to let go
+  std::scoped_lock lock(counter.m_mutex);
+}
+
+bool JobSystem::PopJob(u32 index, Job& job)
+{
+  // own queue first, newest job is the one most likely still in cache
+  {
+    WorkQueue& queue = *m_queues[index];
+    std::scoped_lock lock(queue.mutex);
+    if (queue.jobs.empty() == false)
+    {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      return true;
+    }
+  }
+
+  // steal the oldest job of somebody else
+  const u32 queueCount = static_cast<u32>(m_queues.size());
+  for (u32 offset = 1; offset < queueCount; offset++)
+  {
+    WorkQueue& victim = *m_queues[(index + offset) % queueCount];
+    std::scoped_lock lock(victim.mutex);
+    if (victim.jobs.empty() == false)
+    {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JobSystem::TryRunJob(u32 index)
+{
+  Job job;
+  if (PopJob(index, job) == false)
+  {
+    return false;
+  }
+  m_queuedJobs.fetch_sub(1, std::memory_order_acq_rel);
+  job();
+  return true;
+}
+
+void JobSystem::WorkerLoop(u32 index)
+{
+  while (m_bStop.load(std::memory_order_acquire) == false)
+  {
+    if (TryRunJob(index))
+    {
+      continue;
+    }
+    // sleep until something gets scheduled
+    m_queuedJobs.wait(0, std::memory_order_acquire);
+    // another worker may have taken the job, do not spin on a stale count
+    if (m_queuedJobs.load(std::memory_order_acquire) != 0 &&
+        TryRunJob(index) == false)
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::PinThread(std::thread& thread, u32 logicalProcessor) const
+{
+#ifdef _WIN32
+  const DWORD_PTR mask = DWORD_PTR {1} << logicalProcessor;
+  if (SetThreadAffinityMask(static_cast<HANDLE>(thread.native_handle()),
+                            mask) == 0)
+  {
+    log::Warning("Could not pin worker to core {}", logicalProcessor);
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(logicalProcessor, &set);
+  if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t),
+                             &set) != 0)
+  {
+    log::Warning("Could not pin worker to core {}", logicalProcessor);
+  }
+#else
+  (void)thread;
+  log::Warning("Thread pinning is not supported on this platform, core {}",
+               logicalProcessor);
+#endif
+}
+
+std::vector<u32> JobSystem::QueryPhysicalCores()
+{
+  std::vector<u32> cores;
+#ifdef _WIN32
+  DWORD length = 0;
+  GetLogicalProcessorInformation(nullptr, &length);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(
+      length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if (GetLogicalProcessorInformation(infos.data(), &length))
+  {
+    for (const auto& info : infos)
+    {
+      if (info.Relationship != RelationProcessorCore || info.ProcessorMask == 0)
+      {
+        continue;
+      }
+      // first logical processor of the core
+      u32 bit = 0;
+      while (((info.ProcessorMask >> bit) & 1) == 0)
+      {
+        bit++;
+      }
+      cores.push_back(bit);
+    }
+  }
+#elif defined(__linux__)
+  std::set<u32> firstSiblings;
+  const u32 hardwareThreads = std::thread::hardware_concurrency();
+  for (u32 cpu = 0; cpu < hardwareThreads; cpu++)
+  {
+    std::ifstream siblings(
+        "/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+        "/topology/thread_siblings_list");
+    u32 first = cpu;
+    // the list starts with the lowest sibling, "0-1" or "0,8"
+    if (siblings >> first)
+    {
+      firstSiblings.insert(first);
+    }
+  }
+  cores.assign(firstSiblings.begin(), firstSiblings.end());
+#endif
+  if (cores.empty())
+  {
+    for (u32 cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++)
+    {
+      cores.push_back(cpu);
+    }
+  }
+  return cores;
+}
@@ -0,0 +1,199 @@
+#include "core/mesh_lod.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+
+using namespace hm::gpx;
+
+namespace
+{
+// a level has to drop this much of the one before to be kept
+constexpr f32 MinReduction {0.8f};
+// surfaces this small are not simplified any further
+constexpr u32 MinTriangles {16};
+// tries at a coarser grid when a level keeps too many triangles
+constexpr u32 MaxGridTries {8};
+
+// Clusters the vertices of the triangles on a grid of `cellSize` and writes
+// the triangles that keep three different clusters, once each
+void Simplify(std::span<const u32> source, std::span<const glm::vec3> positions,
+              const glm::vec3& boundsMin, f32 cellSize,
+              std::vector<u32>& result)
+{
+  // every cluster is drawn by the vertex nearest to the average of its own
+  struct Cluster
+  {
+    glm::vec3 sum {0.f};
+    u32 count {0};
+    u32 vertex {~0u};
+    f32 distance {0.f};
+  };
+  std::unordered_map<u64, u32> cellClusters;
+  std::unordered_map<u32, u32> vertexClusters;
+  std::vector<Cluster> clusters;
+  for (const u32 vertex : source)
+  {
+    if (vertexClusters.contains(vertex))
+    {
+      continue;
+    }
+    const glm::vec3 cell = (positions[vertex] - boundsMin) / cellSize;
+    const u64 key = static_cast<u64>(cell.x) |
+                    static_cast<u64>(cell.y) << 21 |
+                    static_cast<u64>(cell.z) << 42;
+    const auto [found, bInserted] =
+        cellClusters.try_emplace(key, static_cast<u32>(clusters.size()));
+    if (bInserted)
+    {
+      clusters.push_back({});
+    }
+    Cluster& cluster = clusters[found->second];
+    cluster.sum += positions[vertex];
+    cluster.count++;
+    vertexClusters.emplace(vertex, found->second);
+  }
+  for (const auto& [vertex, index] : vertexClusters)
+  {
+    Cluster& cluster = clusters[index];
+    const f32 distance = glm::length(
+        positions[vertex] - cluster.sum / static_cast<f32>(cluster.count));
+    if (cluster.vertex == ~0u || distance < cluster.distance ||
+        (distance == cluster.distance && vertex < cluster.vertex))
+    {
+      cluster.vertex = vertex;
+      cluster.distance = distance;
+    }
+  }
+
+  // the triangles start at their smallest cluster, the same winding then
+  // gives the same triple
+  std::vector<std::array<u32, 3>> triangles;
+  triangles.reserve(source.size() / 3);
+  for (size_t i = 0; i + 2 < source.size(); i += 3)
+  {
+    std::array<u32, 3> triangle {vertexClusters[source[i]],
+                                 vertexClusters[source[i + 1]],
+                                 vertexClusters[source[i + 2]]};
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+        triangle[0] == triangle[2])
+    {
+      continue;
+    }
+    std::ranges::rotate(triangle, std::ranges::min_element(triangle));
+    triangles.push_back(triangle);
+  }
+  std::ranges::sort(triangles);
+  const auto duplicates = std::ranges::unique(triangles);
+  triangles.erase(duplicates.begin(), duplicates.end());
+
+  result.clear();
+  for (const std::array<u32, 3>& triangle : triangles)
+  {
+    for (const u32 cluster : triangle)
+    {
+      result.push_back(clusters[cluster].vertex);
+    }
+  }
+}
+} // namespace
+
+u32 hm::gpx::BuildLods(std::vector<u32>& indices, u32 firstIndex,
+                       u32 indexCount, std::span<const glm::vec3> positions,
+                       std::vector<MeshLod>& lods)
+{
+  HM_ZONE_SCOPED;
+  lods.push_back({firstIndex, indexCount, 0.f});
+  if (indexCount / 3 < MinTriangles * 2)
+  {
+    return 1;
+  }
+
+  const std::vector<u32> source(indices.begin() + firstIndex,
+                                indices.begin() + firstIndex + indexCount);
+  glm::vec3 boundsMin = positions[source.front()];
+  glm::vec3 boundsMax = boundsMin;
+  for (const u32 vertex : source)
+  {
+    boundsMin = glm::min(boundsMin, positions[vertex]);
+    boundsMax = glm::max(boundsMax, positions[vertex]);
+  }
+  const glm::vec3 size = boundsMax - boundsMin;
+  const f32 longest = std::max({size.x, size.y, size.z});
+  if (longest <= 0.f)
+  {
+    return 1;
+  }
+
+  // the triangles of a surface spread over about an area, the grid starts
+  // near the spacing of its vertices and every level halves the cells count
+  u32 triangleCount = indexCount / 3;
+  f32 cellSize = longest / std::sqrt(static_cast<f32>(triangleCount));
+  std::vector<u32> simplified;
+  u32 added = 1;
+  while (added < MeshLodMaxCount && triangleCount >= MinTriangles * 2)
+  {
+    const u32 target = triangleCount / 2;
+    cellSize *= std::sqrt(2.f);
+    u32 resultCount = triangleCount;
+    for (u32 i = 0; i < MaxGridTries; i++)
+    {
+      Simplify(source, positions, boundsMin, cellSize, simplified);
+      resultCount = static_cast<u32>(simplified.size() / 3);
+      if (resultCount <= target + target / 4)
+      {
+        break;
+      }
+      cellSize *= 1.25f;
+    }
+    if (resultCount == 0 ||
+        static_cast<f32>(resultCount) >
+            static_cast<f32>(triangleCount) * MinReduction)
+    {
+      break;
+    }
+
+    // a vertex moves at most to the other corner of its cell
+    const u32 first = static_cast<u32>(indices.size());
+    indices.insert(indices.end(), simplified.begin(), simplified.end());
+    lods.push_back({first, static_cast<u32>(simplified.size()),
+                    cellSize * std::sqrt(3.f)});
+    triangleCount = resultCount;
+    added++;
+  }
+  return added;
+}
+
+u32 hm::gpx::SelectLod(std::span<const MeshLod> lods, const glm::vec3& center,
+                       f32 radius, f32 errorScale,
+                       const glm::vec3& cameraPosition,
+                       const LodSettings& settings)
+{
+  if (settings.pixelsPerUnit <= 0.f)
+  {
+    return 0;
+  }
+  const f32 distance = glm::length(center - cameraPosition);
+  if (distance > radius &&
+      2.f * radius * settings.pixelsPerUnit <
+          settings.minPixelSize * distance)
+  {
+    return CulledLod;
+  }
+
+  // the nearest point of the sphere, the camera can be inside of it
+  const f32 nearest = std::max(distance - radius, 1e-3f);
+  const f32 maxError = settings.errorPixels * nearest /
+                       (settings.pixelsPerUnit * errorScale);
+  for (u32 lod = static_cast<u32>(lods.size()); lod > 1; lod--)
+  {
+    if (lods[lod - 1].error <= maxError)
+    {
+      return lod - 1;
+    }
+  }
+  return 0;
+}
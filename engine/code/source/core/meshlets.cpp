@@ -0,0 +1,298 @@
+#include "core/meshlets.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace hm::gpx;
+
+namespace
+{
+constexpr u8 NotInMeshlet {0xff};
+// below this the normals spread over more than a half sphere, the cone of
+// such a meshlet would never cull
+constexpr f32 MinConeSpread {0.1f};
+
+// Triangles being gathered into one meshlet, in the local vertex numbers of
+// the range
+struct MeshletBuilder
+{
+  std::span<const u32> corners;
+  std::span<const u32> vertexIds;
+  std::span<const glm::vec3> positions;
+
+  // position of every local vertex in the meshlet
+  std::vector<u8> slots {};
+  std::vector<u32> vertices {};
+  std::vector<u32> triangles {};
+  glm::vec3 boundsMin {0.f};
+  glm::vec3 boundsMax {0.f};
+
+  const glm::vec3& Position(u32 vertex) const
+  {
+    return positions[vertexIds[vertex]];
+  }
+
+  u32 NewVertices(u32 triangle) const
+  {
+    u32 count = 0;
+    for (u32 corner = 0; corner < 3; corner++)
+    {
+      count += slots[corners[triangle * 3 + corner]] == NotInMeshlet ? 1 : 0;
+    }
+    return count;
+  }
+
+  bool Fits(u32 triangle) const
+  {
+    return vertices.size() + NewVertices(triangle) <= MeshletMaxVertices;
+  }
+
+  // Whether the triangle is close enough to the meshlet to share its bounds
+  bool IsNear(u32 triangle) const
+  {
+    const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    const f32 reach = std::max(glm::length(boundsMax - boundsMin), 1e-6f);
+    for (u32 corner = 0; corner < 3; corner++)
+    {
+      if (glm::length(Position(corners[triangle * 3 + corner]) - center) >
+          reach)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Bounding sphere around the vertices and cone around the triangle normals
+void SetBounds(const MeshletBuilder& builder, Meshlet& meshlet)
+{
+  meshlet.center = (builder.boundsMin + builder.boundsMax) * 0.5f;
+  meshlet.radius = 0.f;
+  for (const u32 vertex : builder.vertices)
+  {
+    meshlet.radius = std::max(
+        meshlet.radius, glm::length(builder.Position(vertex) - meshlet.center));
+  }
+
+  glm::vec3 normalSum {0.f};
+  for (const u32 triangle : builder.triangles)
+  {
+    const glm::vec3& a = builder.Position(builder.corners[triangle * 3]);
+    const glm::vec3& b = builder.Position(builder.corners[triangle * 3 + 1]);
+    const glm::vec3& c = builder.Position(builder.corners[triangle * 3 + 2]);
+    const glm::vec3 normal = glm::cross(b - a, c - a);
+    const f32 length = glm::length(normal);
+    if (length > 0.f)
+    {
+      normalSum += normal / length;
+    }
+  }
+  const f32 sumLength = glm::length(normalSum);
+  if (sumLength <= 0.f)
+  {
+    return;
+  }
+  meshlet.coneAxis = normalSum / sumLength;
+
+  // cosine of the widest angle between the axis and a normal
+  f32 spread = 1.f;
+  for (const u32 triangle : builder.triangles)
+  {
+    const glm::vec3& a = builder.Position(builder.corners[triangle * 3]);
+    const glm::vec3& b = builder.Position(builder.corners[triangle * 3 + 1]);
+    const glm::vec3& c = builder.Position(builder.corners[triangle * 3 + 2]);
+    const glm::vec3 normal = glm::cross(b - a, c - a);
+    const f32 length = glm::length(normal);
+    if (length > 0.f)
+    {
+      spread = std::min(spread, glm::dot(meshlet.coneAxis, normal / length));
+    }
+  }
+  meshlet.coneCutoff =
+      spread <= MinConeSpread ? 1.f : std::sqrt(1.f - spread * spread);
+}
+} // namespace
+
+u32 hm::gpx::BuildMeshlets(std::span<u32> indices, u32 firstIndex,
+                           std::span<const glm::vec3> positions,
+                           MeshletSet& set)
+{
+  HM_ZONE_SCOPED;
+  const u32 triangleCount = static_cast<u32>(indices.size() / 3);
+  if (triangleCount == 0)
+  {
+    return 0;
+  }
+
+  // the range uses a part of the vertices, they are numbered locally
+  std::vector<u32> vertexIds(indices.begin(), indices.end());
+  std::ranges::sort(vertexIds);
+  const auto duplicates = std::ranges::unique(vertexIds);
+  vertexIds.erase(duplicates.begin(), duplicates.end());
+  const u32 vertexCount = static_cast<u32>(vertexIds.size());
+  std::vector<u32> corners(triangleCount * 3);
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    corners[i] = static_cast<u32>(
+        std::ranges::lower_bound(vertexIds, indices[i]) - vertexIds.begin());
+  }
+
+  // triangles around every vertex
+  std::vector<u32> adjacencyStarts(vertexCount + 1, 0);
+  for (const u32 vertex : corners)
+  {
+    adjacencyStarts[vertex + 1]++;
+  }
+  for (u32 vertex = 0; vertex < vertexCount; vertex++)
+  {
+    adjacencyStarts[vertex + 1] += adjacencyStarts[vertex];
+  }
+  std::vector<u32> adjacency(corners.size());
+  std::vector<u32> adjacencyEnds(adjacencyStarts.begin(),
+                                 adjacencyStarts.end() - 1);
+  for (u32 triangle = 0; triangle < triangleCount; triangle++)
+  {
+    for (u32 corner = 0; corner < 3; corner++)
+    {
+      adjacency[adjacencyEnds[corners[triangle * 3 + corner]]++] = triangle;
+    }
+  }
+
+  MeshletBuilder builder {corners, vertexIds, positions};
+  builder.slots.assign(vertexCount, NotInMeshlet);
+  std::vector<bool> emitted(triangleCount, false);
+  // triangles touching the meshlet, some of them emitted since
+  std::vector<u32> candidates;
+  std::vector<u32> reordered;
+  reordered.reserve(indices.size());
+  const size_t firstMeshlet = set.meshlets.size();
+  // triangles before it are all emitted
+  u32 nextSeed = 0;
+
+  auto add = [&](u32 triangle)
+  {
+    emitted[triangle] = true;
+    builder.triangles.push_back(triangle);
+    for (u32 corner = 0; corner < 3; corner++)
+    {
+      const u32 vertex = corners[triangle * 3 + corner];
+      if (builder.slots[vertex] != NotInMeshlet)
+      {
+        continue;
+      }
+      const glm::vec3& position = builder.Position(vertex);
+      if (builder.vertices.empty())
+      {
+        builder.boundsMin = position;
+        builder.boundsMax = position;
+      }
+      builder.boundsMin = glm::min(builder.boundsMin, position);
+      builder.boundsMax = glm::max(builder.boundsMax, position);
+      builder.slots[vertex] = static_cast<u8>(builder.vertices.size());
+      builder.vertices.push_back(vertex);
+      for (u32 i = adjacencyStarts[vertex]; i < adjacencyStarts[vertex + 1];
+           i++)
+      {
+        if (emitted[adjacency[i]] == false)
+        {
+          candidates.push_back(adjacency[i]);
+        }
+      }
+    }
+  };
+
+  auto close = [&]()
+  {
+    Meshlet meshlet {};
+    meshlet.firstIndex = firstIndex + static_cast<u32>(reordered.size());
+    meshlet.triangleCount = static_cast<u32>(builder.triangles.size());
+    meshlet.vertexOffset = static_cast<u32>(set.vertices.size());
+    meshlet.vertexCount = static_cast<u32>(builder.vertices.size());
+    meshlet.triangleOffset = static_cast<u32>(set.triangles.size());
+    SetBounds(builder, meshlet);
+    set.meshlets.push_back(meshlet);
+
+    for (const u32 triangle : builder.triangles)
+    {
+      u32 packed = 0;
+      for (u32 corner = 0; corner < 3; corner++)
+      {
+        reordered.push_back(indices[triangle * 3 + corner]);
+        const u32 slot = builder.slots[corners[triangle * 3 + corner]];
+        packed |= slot << (corner * 8);
+      }
+      set.triangles.push_back(packed);
+    }
+    for (const u32 vertex : builder.vertices)
+    {
+      set.vertices.push_back(vertexIds[vertex]);
+      builder.slots[vertex] = NotInMeshlet;
+    }
+    builder.vertices.clear();
+    builder.triangles.clear();
+    candidates.clear();
+  };
+
+  while (true)
+  {
+    while (nextSeed < triangleCount && emitted[nextSeed])
+    {
+      nextSeed++;
+    }
+    if (builder.triangles.empty())
+    {
+      if (nextSeed == triangleCount)
+      {
+        break;
+      }
+      add(nextSeed);
+      continue;
+    }
+
+    // the connected triangle adding the fewest vertices, dropping the
+    // candidates that were emitted meanwhile
+    u32 best = ~0u;
+    u32 bestNewVertices = 4;
+    size_t kept = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+      const u32 triangle = candidates[i];
+      if (emitted[triangle])
+      {
+        continue;
+      }
+      candidates[kept++] = triangle;
+      const u32 newVertices = builder.NewVertices(triangle);
+      if (newVertices < bestNewVertices && builder.Fits(triangle))
+      {
+        best = triangle;
+        bestNewVertices = newVertices;
+      }
+    }
+    candidates.resize(kept);
+
+    // nothing connected fits, meshes made of many small pieces still fill
+    // their meshlets with the pieces next to each other
+    if (best == ~0u && nextSeed < triangleCount && builder.Fits(nextSeed) &&
+        builder.IsNear(nextSeed))
+    {
+      best = nextSeed;
+    }
+    if (best == ~0u)
+    {
+      close();
+      continue;
+    }
+    add(best);
+    if (builder.triangles.size() == MeshletMaxTriangles)
+    {
+      close();
+    }
+  }
+
+  std::ranges::copy(reordered, indices.begin());
+  return static_cast<u32>(set.meshlets.size() - firstMeshlet);
+}
@@ -0,0 +1,359 @@
+#include "core/occlusion.hpp"
+
+#include "core/jobs.hpp"
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define HM_OCCLUSION_SSE 1
+#include <immintrin.h>
+#else
+#define HM_OCCLUSION_SSE 0
+#endif
+
+using namespace hm::culling;
+
+namespace
+{
+constexpr u32 TileSize = OcclusionBuffer::TileSize;
+constexpr u32 TilePixels = TileSize * TileSize;
+
+// Clips the triangle against the near plane, z <= w with reversed depth.
+// Returns the corners of what is left, 0, 3 or 4 of them.
+u32 ClipNear(const std::array<glm::vec4, 3>& triangle,
+             std::array<glm::vec4, 4>& polygon)
+{
+  u32 count = 0;
+  for (u32 i = 0; i < 3; i++)
+  {
+    const glm::vec4& current = triangle[i];
+    const glm::vec4& next = triangle[(i + 1) % 3];
+    const f32 currentDistance = current.w - current.z;
+    const f32 nextDistance = next.w - next.z;
+    if (currentDistance >= 0.f)
+    {
+      polygon[count++] = current;
+    }
+    if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+    {
+      const f32 t = currentDistance / (currentDistance - nextDistance);
+      polygon[count++] = current + (next - current) * t;
+    }
+  }
+  return count;
+}
+} // namespace
+
+void OcclusionBuffer::Resize(u32 width, u32 height)
+{
+  m_tilesX = (width + TileSize - 1) / TileSize;
+  m_tilesY = (height + TileSize - 1) / TileSize;
+  m_width = m_tilesX * TileSize;
+  m_height = m_tilesY * TileSize;
+  m_depth.assign(m_tilesX * m_tilesY * TilePixels, 0.f);
+  m_tileFarthest.assign(m_tilesX * m_tilesY, 0.f);
+}
+
+void OcclusionBuffer::Begin(const glm::mat4& viewProj)
+{
+  m_viewProj = viewProj;
+  m_occluders.clear();
+}
+
+void OcclusionBuffer::AddOccluder(const OccluderMesh& mesh,
+                                  const glm::mat4& transform)
+{
+  m_occluders.push_back({&mesh, transform});
+}
+
+void OcclusionBuffer::Rasterize(jobs::JobSystem& jobSystem)
+{
+  HM_ZONE_SCOPED_N("OcclusionBuffer::Rasterize");
+  const u32 occluderCount = static_cast<u32>(m_occluders.size());
+  m_triangles.resize(occluderCount);
+  jobSystem.ParallelFor(occluderCount, 4,
+                        [&](u32 first, u32 last)
+                        {
+                          for (u32 i = first; i < last; i++)
+                          {
+                            m_triangles[i].clear();
+                            SetupTriangles(m_occluders[i], m_triangles[i]);
+                          }
+                        });
+  m_triangleCount = 0;
+  for (const std::vector<Triangle>& triangles : m_triangles)
+  {
+    m_triangleCount += static_cast<u32>(triangles.size());
+  }
+  HM_ZONE_VALUE(static_cast<int64_t>(m_triangleCount));
+
+  // a row of tiles is only written by its own job
+  jobSystem.ParallelFor(m_tilesY, 1,
+                        [&](u32 first, u32 last)
+                        {
+                          for (u32 row = first; row < last; row++)
+                          {
+                            RasterizeTileRow(row);
+                          }
+                        });
+}
+
+void OcclusionBuffer::SetupTriangles(const Occluder& occluder,
+                                     std::vector<Triangle>& triangles) const
+{
+  const OccluderMesh& mesh = *occluder.mesh;
+  const glm::mat4 toClip = m_viewProj * occluder.transform;
+  thread_local std::vector<glm::vec4> clip;
+  clip.resize(mesh.positions.size());
+  for (size_t i = 0; i < mesh.positions.size(); i++)
+  {
+    clip[i] = toClip * glm::vec4(mesh.positions[i], 1.f);
+  }
+
+  std::array<glm::vec4, 4> polygon;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+  {
+    const std::array<glm::vec4, 3> triangle {clip[mesh.indices[i]],
+                                             clip[mesh.indices[i + 1]],
+                                             clip[mesh.indices[i + 2]]};
+    const u32 count = ClipNear(triangle, polygon);
+    for (u32 corner = 1; corner + 1 < count; corner++)
+    {
+      AddTriangle(polygon[0], polygon[corner], polygon[corner + 1],
+                  triangles);
+    }
+  }
+}
+
+void OcclusionBuffer::AddTriangle(const glm::vec4& a, const glm::vec4& b,
+                                  const glm::vec4& c,
+                                  std::vector<Triangle>& triangles) const
+{
+  // both faces are kept, thin walls occlude from either side
+  std::array<glm::vec3, 3> points;
+  const std::array<const glm::vec4*, 3> corners {&a, &b, &c};
+  for (u32 i = 0; i < 3; i++)
+  {
+    const glm::vec4& corner = *corners[i];
+    const glm::vec3 ndc = glm::vec3(corner) / corner.w;
+    points[i] = {(ndc.x * 0.5f + 0.5f) * static_cast<f32>(m_width),
+                 (ndc.y * 0.5f + 0.5f) * static_cast<f32>(m_height), ndc.z};
+  }
+  f32 area = (points[1].x - points[0].x) * (points[2].y - points[0].y) -
+             (points[2].x - points[0].x) * (points[1].y - points[0].y);
+  if (std::abs(area) < 1e-6f)
+  {
+    return;
+  }
+  if (area < 0.f)
+  {
+    std::swap(points[1], points[2]);
+    area = -area;
+  }
+
+  // pixel centers sit at +0.5
+  Triangle triangle;
+  const glm::vec3 low = glm::min(points[0], glm::min(points[1], points[2]));
+  const glm::vec3 high = glm::max(points[0], glm::max(points[1], points[2]));
+  triangle.minX = std::max(static_cast<i32>(std::ceil(low.x - 0.5f)), 0);
+  triangle.minY = std::max(static_cast<i32>(std::ceil(low.y - 0.5f)), 0);
+  triangle.maxX = std::min(static_cast<i32>(std::floor(high.x - 0.5f)),
+                           static_cast<i32>(m_width) - 1);
+  triangle.maxY = std::min(static_cast<i32>(std::floor(high.y - 0.5f)),
+                           static_cast<i32>(m_height) - 1);
+  if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+  {
+    return;
+  }
+
+  for (u32 i = 0; i < 3; i++)
+  {
+    const glm::vec3& from = points[i];
+    const glm::vec3& to = points[(i + 1) % 3];
+    triangle.edgeX[i] = from.y - to.y;
+    triangle.edgeY[i] = to.x - from.x;
+    triangle.edgeC[i] =
+        -(triangle.edgeX[i] * from.x + triangle.edgeY[i] * from.y);
+  }
+
+  const glm::vec3 first = points[1] - points[0];
+  const glm::vec3 second = points[2] - points[0];
+  triangle.depthX = (first.z * second.y - second.z * first.y) / area;
+  triangle.depthY = (second.z * first.x - first.z * second.x) / area;
+  triangle.depthC = points[0].z - triangle.depthX * points[0].x -
+                    triangle.depthY * points[0].y -
+                    0.5f * (std::abs(triangle.depthX) +
+                            std::abs(triangle.depthY));
+  triangle.minDepth = low.z;
+  triangles.push_back(triangle);
+}
+
+void OcclusionBuffer::RasterizeTileRow(u32 tileRow)
+{
+  f32* row = &m_depth[tileRow * m_tilesX * TilePixels];
+  std::fill_n(row, m_tilesX * TilePixels, 0.f);
+  const i32 rowMinY = static_cast<i32>(tileRow * TileSize);
+  const i32 rowMaxY = rowMinY + static_cast<i32>(TileSize) - 1;
+
+  for (const std::vector<Triangle>& triangles : m_triangles)
+  {
+    for (const Triangle& triangle : triangles)
+    {
+      if (triangle.maxY < rowMinY || triangle.minY > rowMaxY)
+      {
+        continue;
+      }
+      const i32 firstY = std::max(triangle.minY, rowMinY);
+      const i32 lastY = std::min(triangle.maxY, rowMaxY);
+      for (i32 tileX = triangle.minX / static_cast<i32>(TileSize);
+           tileX <= triangle.maxX / static_cast<i32>(TileSize); tileX++)
+      {
+        f32* tile = row + tileX * TilePixels;
+        const f32 x = static_cast<f32>(tileX * TileSize) + 0.5f;
+        for (i32 y = firstY; y <= lastY; y++)
+        {
+          f32* pixels = tile + (y - rowMinY) * TileSize;
+          const f32 centerY = static_cast<f32>(y) + 0.5f;
+#if HM_OCCLUSION_SSE
+          const __m128 centerX =
+              _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0.f, 1.f, 2.f, 3.f));
+          __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+          for (u32 edge = 0; edge < 3; edge++)
+          {
+            const __m128 value = _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(triangle.edgeX[edge]), centerX),
+                _mm_set1_ps(triangle.edgeY[edge] * centerY +
+                            triangle.edgeC[edge]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_setzero_ps()));
+          }
+          const __m128 depth = _mm_max_ps(
+              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depthX), centerX),
+                         _mm_set1_ps(triangle.depthY * centerY +
+                                     triangle.depthC)),
+              _mm_set1_ps(triangle.minDepth));
+          const __m128 current = _mm_loadu_ps(pixels);
+          const __m128 nearer = _mm_max_ps(current, depth);
+          _mm_storeu_ps(pixels, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                          _mm_andnot_ps(inside, current)));
+#else
+          for (u32 lane = 0; lane < TileSize; lane++)
+          {
+            const f32 centerX = x + static_cast<f32>(lane);
+            bool bInside = true;
+            for (u32 edge = 0; edge < 3; edge++)
+            {
+              bInside &= triangle.edgeX[edge] * centerX +
+                             (triangle.edgeY[edge] * centerY +
+                              triangle.edgeC[edge]) >=
+                         0.f;
+            }
+            const f32 depth = std::max(
+                triangle.depthX * centerX +
+                    (triangle.depthY * centerY + triangle.depthC),
+                triangle.minDepth);
+            if (bInside)
+            {
+              pixels[lane] = std::max(pixels[lane], depth);
+            }
+          }
+#endif
+        }
+      }
+    }
+  }
+
+  for (u32 tileX = 0; tileX < m_tilesX; tileX++)
+  {
+    const f32* tile = row + tileX * TilePixels;
+    m_tileFarthest[tileRow * m_tilesX + tileX] =
+        *std::min_element(tile, tile + TilePixels);
+  }
+}
+
+bool OcclusionBuffer::IsOccluded(const glm::vec3& center,
+                                 const glm::vec3& extents) const
+{
+  constexpr f32 Infinity = std::numeric_limits<f32>::max();
+  glm::vec2 low {Infinity};
+  glm::vec2 high {-Infinity};
+  f32 nearest = 0.f;
+  for (u32 i = 0; i < 8; i++)
+  {
+    const glm::vec3 corner {(i & 1) == 0 ? -1.f : 1.f,
+                            (i & 2) == 0 ? -1.f : 1.f,
+                            (i & 4) == 0 ? -1.f : 1.f};
+    const glm::vec4 clip =
+        m_viewProj * glm::vec4(center + corner * extents, 1.f);
+    if (clip.w <= 0.f || clip.z > clip.w)
+    {
+      return false;
+    }
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    const glm::vec2 screen {(ndc.x * 0.5f + 0.5f) * static_cast<f32>(m_width),
+                            (ndc.y * 0.5f + 0.5f) *
+                                static_cast<f32>(m_height)};
+    low = glm::min(low, screen);
+    high = glm::max(high, screen);
+    nearest = std::max(nearest, ndc.z);
+  }
+
+  // every pixel the rectangle touches
+  const i32 minX = std::max(static_cast<i32>(std::floor(low.x)), 0);
+  const i32 minY = std::max(static_cast<i32>(std::floor(low.y)), 0);
+  const i32 maxX = std::min(static_cast<i32>(std::floor(high.x)),
+                            static_cast<i32>(m_width) - 1);
+  const i32 maxY = std::min(static_cast<i32>(std::floor(high.y)),
+                            static_cast<i32>(m_height) - 1);
+  if (minX > maxX || minY > maxY)
+  {
+    return false;
+  }
+
+  constexpr i32 Tile = static_cast<i32>(TileSize);
+  for (i32 tileY = minY / Tile; tileY <= maxY / Tile; tileY++)
+  {
+    for (i32 tileX = minX / Tile; tileX <= maxX / Tile; tileX++)
+    {
+      const u32 tileIndex = tileY * m_tilesX + tileX;
+      if (m_tileFarthest[tileIndex] > nearest)
+      {
+        continue;
+      }
+      const f32* tile = &m_depth[tileIndex * TilePixels];
+      for (i32 y = std::max(minY, tileY * Tile);
+           y <= std::min(maxY, tileY * Tile + Tile - 1); y++)
+      {
+        for (i32 x = std::max(minX, tileX * Tile);
+             x <= std::min(maxX, tileX * Tile + Tile - 1); x++)
+        {
+          if (tile[(y - tileY * Tile) * Tile + (x - tileX * Tile)] <= nearest)
+          {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+u32 OcclusionBuffer::RemoveOccluded(const BoundsSoA& bounds, u32* indices,
+                                    u32 count) const
+{
+  u32 kept = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    const u32 index = indices[i];
+    const glm::vec3 center {bounds.centerX[index], bounds.centerY[index],
+                            bounds.centerZ[index]};
+    const glm::vec3 extents {bounds.extentX[index], bounds.extentY[index],
+                             bounds.extentZ[index]};
+    indices[kept] = index;
+    kept += IsOccluded(center, extents) ? 0 : 1;
+  }
+  return kept;
+}
@@ -0,0 +1,113 @@
+#include "core/scheduler.hpp"
+
+#include "engine.hpp"
+#include "core/ecs.hpp"
+#include "core/jobs.hpp"
+#include "external/tracy_impl.hpp"
+
+using namespace hm::ecs;
+
+void SystemScheduler::Build(std::span<System* const> systems)
+{
+  HM_ZONE_SCOPED_N("SystemScheduler::Build");
+  m_nodes.clear();
+  m_nodes.resize(systems.size());
+
+  // depth of every node in the graph, used to report the critical path
+  std::vector<u32> levels(systems.size(), 1);
+  m_criticalPathLength = systems.empty() ? 0 : 1;
+
+  for (u32 i = 0; i < systems.size(); i++)
+  {
+    m_nodes[i].system = systems[i];
+    // the sorted order decides who goes first between conflicting systems
+    for (u32 j = 0; j < i; j++)
+    {
+      if (systems[i]->m_access.ConflictsWith(systems[j]->m_access) ||
+          systems[j]->IsOrderedBefore(*systems[i]))
+      {
+        m_nodes[j].dependents.push_back(i);
+        m_nodes[i].dependencyCount++;
+        levels[i] = std::max(levels[i], levels[j] + 1);
+      }
+    }
+    m_criticalPathLength = std::max(m_criticalPathLength, levels[i]);
+  }
+
+  m_pendingDependencies =
+      std::make_unique<std::atomic<u32>[]>(m_nodes.size());
+  m_bDirty = false;
+}
+
+void SystemScheduler::Update(std::span<System* const> systems,
+                             f32 dt)
+{
+  HM_ZONE_SCOPED_N("SystemScheduler::Update");
+  if (m_bDirty || m_nodes.size() != systems.size())
+  {
+    Build(systems);
+  }
+  if (m_nodes.empty())
+  {
+    return;
+  }
+
+  // nothing to overlap, skip the synchronization entirely
+  if (m_criticalPathLength == m_nodes.size())
+  {
+    for (const Node& node : m_nodes)
+    {
+      node.system->Update(dt);
+    }
+    return;
+  }
+
+  jobs::JobSystem& jobSystem = Engine::Instance().GetJobs();
+  jobs::Counter counter;
+  m_deltaTime = dt;
+  for (u32 i = 0; i < m_nodes.size(); i++)
+  {
+    m_pendingDependencies[i].store(m_nodes[i].dependencyCount,
+                                   std::memory_order_relaxed);
+  }
+  for (u32 i = 0; i < m_nodes.size(); i++)
+  {
+    if (m_nodes[i].dependencyCount == 0)
+    {
+      jobSystem.Schedule(
+          [this, i, &jobSystem, &counter]()
+          {
+            Execute(i, jobSystem, counter);
+          },
+          &counter);
+    }
+  }
+  // the main thread helps out until every system of this frame has finished
+  jobSystem.Wait(counter);
+}
+
+void SystemScheduler::Execute(u32 nodeIndex, jobs::JobSystem& jobSystem,
+                              jobs::Counter& counter)
+{
+  const Node& node = m_nodes[nodeIndex];
+  {
+    HM_ZONE_SCOPED_N("System::Update");
+    HM_ZONE_TEXT(node.system->m_name.c_str(), node.system->m_name.size());
+    node.system->Update(m_deltaTime);
+  }
+
+  // scheduled before this job leaves the counter, so it cannot hit zero early
+  for (const u32 dependent : node.dependents)
+  {
+    if (m_pendingDependencies[dependent].fetch_sub(
+            1, std::memory_order_acq_rel) == 1)
+    {
+      jobSystem.Schedule(
+          [this, dependent, &jobSystem, &counter]()
+          {
+            Execute(dependent, jobSystem, counter);
+          },
+          &counter);
+    }
+  }
+}
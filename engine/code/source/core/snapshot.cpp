@@ -0,0 +1,317 @@
+#include "core/snapshot.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace hm::ecs;
+
+namespace
+{
+u64 Align(u64 offset)
+{
+  return (offset + SnapshotAlignment - 1) & ~(SnapshotAlignment - 1);
+}
+
+// Read-only view of a whole file, unmapped on destruction
+class MappedFile
+{
+ public:
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+  HM_NON_COPYABLE_NON_MOVABLE(MappedFile);
+
+  bool IsOpen() const { return m_pData != nullptr; }
+  std::span<const std::byte> GetBytes() const
+  {
+    return {static_cast<const std::byte*>(m_pData), m_size};
+  }
+
+ private:
+  const void* m_pData {nullptr};
+  size_t m_size {0};
+#ifdef _WIN32
+  HANDLE m_file {INVALID_HANDLE_VALUE};
+  HANDLE m_mapping {nullptr};
+#endif
+};
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER size {};
+  if (m_file == INVALID_HANDLE_VALUE || GetFileSizeEx(m_file, &size) == 0 ||
+      size.QuadPart == 0)
+  {
+    return;
+  }
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr)
+  {
+    return;
+  }
+  m_pData = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  m_size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_pData != nullptr)
+  {
+    UnmapViewOfFile(m_pData);
+  }
+  if (m_mapping != nullptr)
+  {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_file);
+  }
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  const int file = open(path.c_str(), O_RDONLY);
+  if (file < 0)
+  {
+    return;
+  }
+  struct stat status {};
+  if (fstat(file, &status) == 0 && status.st_size > 0)
+  {
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ,
+                      MAP_PRIVATE, file, 0);
+    if (data != MAP_FAILED)
+    {
+      m_pData = data;
+      m_size = static_cast<size_t>(status.st_size);
+      // the whole file is read front to back right away
+      madvise(data, m_size, MADV_SEQUENTIAL);
+      madvise(data, m_size, MADV_WILLNEED);
+    }
+  }
+  // the mapping keeps its own reference to the file
+  close(file);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_pData != nullptr)
+  {
+    munmap(const_cast<void*>(m_pData), m_size);
+  }
+}
+#endif
+} // namespace
+
+const SnapshotSerializer::ComponentType* SnapshotSerializer::Find(
+    ComponentId id) const
+{
+  const auto it = std::ranges::find(m_types, id, &ComponentType::id);
+  return it == m_types.end() ? nullptr : &*it;
+}
+
+u64 SnapshotSerializer::ComputeSize(const Registry& registry) const
+{
+  u64 size = sizeof(SnapshotHeader) + m_types.size() * sizeof(SnapshotColumn);
+  size = Align(size) + Align(registry.storage<Entity>()->size() *
+                             sizeof(Entity));
+  for (const ComponentType& type : m_types)
+  {
+    const u64 count = type.count(registry, type.id);
+    size += Align(count * sizeof(Entity)) + Align(count * type.componentSize);
+  }
+  return size;
+}
+
+void SnapshotSerializer::Write(const Registry& registry,
+                               std::span<std::byte> out) const
+{
+  HM_ZONE_SCOPED_N("SnapshotSerializer::Write");
+  SDL_assert(out.size() == ComputeSize(registry));
+  const auto& entities = *registry.storage<Entity>();
+
+  SnapshotHeader header;
+  header.entityCount = static_cast<u32>(entities.size());
+  header.aliveCount = static_cast<u32>(entities.free_list());
+  header.columnCount = static_cast<u32>(m_types.size());
+  header.entitiesOffset =
+      Align(sizeof(SnapshotHeader) + m_types.size() * sizeof(SnapshotColumn));
+  header.totalSize = out.size();
+  std::memcpy(out.data(), &header, sizeof(header));
+  std::memcpy(out.data() + header.entitiesOffset, entities.data(),
+              entities.size() * sizeof(Entity));
+
+  u64 offset =
+      header.entitiesOffset + Align(entities.size() * sizeof(Entity));
+  auto* columns =
+      reinterpret_cast<SnapshotColumn*>(out.data() + sizeof(SnapshotHeader));
+  for (const ComponentType& type : m_types)
+  {
+    SnapshotColumn column;
+    column.id = type.id;
+    column.componentSize = type.componentSize;
+    column.count = type.count(registry, type.id);
+    column.entitiesOffset = offset;
+    column.componentsOffset =
+        offset + Align(u64 {column.count} * sizeof(Entity));
+    offset = column.componentsOffset +
+             Align(u64 {column.count} * column.componentSize);
+    if (column.count != 0)
+    {
+      type.write(registry, type.id,
+                 reinterpret_cast<Entity*>(out.data() + column.entitiesOffset),
+                 out.data() + column.componentsOffset);
+    }
+    std::memcpy(columns++, &column, sizeof(column));
+  }
+}
+
+std::vector<std::byte> SnapshotSerializer::Save(const Registry& registry) const
+{
+  std::vector<std::byte> snapshot(ComputeSize(registry));
+  Write(registry, snapshot);
+  return snapshot;
+}
+
+bool SnapshotSerializer::Save(const Registry& registry,
+                              const std::filesystem::path& path) const
+{
+  HM_ZONE_SCOPED_N("SnapshotSerializer::Save");
+  const std::vector<std::byte> snapshot = Save(registry);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(snapshot.data()),
+             static_cast<std::streamsize>(snapshot.size()));
+  if (file.good() == false)
+  {
+    log::Error("Could not write snapshot {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+bool SnapshotSerializer::Load(Registry& registry,
+                              std::span<const std::byte> snapshot) const
+{
+  HM_ZONE_SCOPED_N("SnapshotSerializer::Load");
+  SnapshotHeader header;
+  if (snapshot.size() < sizeof(header))
+  {
+    log::Error("Snapshot is too small");
+    return false;
+  }
+  std::memcpy(&header, snapshot.data(), sizeof(header));
+  if (header.magic != SnapshotMagic || header.entitySize != sizeof(Entity))
+  {
+    log::Error("Not a snapshot of this engine");
+    return false;
+  }
+  if (header.version != SnapshotVersion)
+  {
+    log::Error("Snapshot version {} is not supported, expected {}",
+               header.version, SnapshotVersion);
+    return false;
+  }
+  auto fits = [&snapshot](u64 offset, u64 size)
+  {
+    return offset % SnapshotAlignment == 0 && offset <= snapshot.size() &&
+           size <= snapshot.size() - offset;
+  };
+  if (header.totalSize != snapshot.size() ||
+      header.aliveCount > header.entityCount ||
+      u64 {header.columnCount} * sizeof(SnapshotColumn) >
+          snapshot.size() - sizeof(header) ||
+      fits(header.entitiesOffset, u64 {header.entityCount} * sizeof(Entity)) ==
+          false)
+  {
+    log::Error("Snapshot is truncated or corrupt");
+    return false;
+  }
+  std::vector<SnapshotColumn> columns(header.columnCount);
+  std::memcpy(columns.data(), snapshot.data() + sizeof(header),
+              columns.size() * sizeof(SnapshotColumn));
+  for (const SnapshotColumn& column : columns)
+  {
+    if (fits(column.entitiesOffset, u64 {column.count} * sizeof(Entity)) ==
+            false ||
+        fits(column.componentsOffset,
+             u64 {column.count} * column.componentSize) == false)
+    {
+      log::Error("Snapshot is truncated or corrupt");
+      return false;
+    }
+  }
+
+  // clearing keeps the signals connected to the storages, so whatever follows
+  // the components sees them go. The released entities are dropped too.
+  registry.clear();
+  registry.storage<Entity>().clear();
+
+  // same as entt::snapshot_loader, generated in storage order so the
+  // released entities stay in the free list in the same order
+  {
+    HM_ZONE_SCOPED_N("Restore Entities");
+    using Traits = entt::entt_traits<Entity>;
+    auto& entities = registry.storage<Entity>();
+    const auto* source = reinterpret_cast<const Entity*>(
+        snapshot.data() + header.entitiesOffset);
+    entities.reserve(header.entityCount);
+    Entity placeholder {};
+    for (u32 i = 0; i < header.entityCount; i++)
+    {
+      entities.generate(source[i]);
+      placeholder = std::max(placeholder, source[i]);
+    }
+    entities.start_from(Traits::next(placeholder));
+    entities.free_list(header.aliveCount);
+  }
+
+  for (const SnapshotColumn& column : columns)
+  {
+    const ComponentType* type = Find(column.id);
+    if (type == nullptr)
+    {
+      log::Warning("Snapshot column {} has no registered component, skipped",
+                   column.id);
+      continue;
+    }
+    if (type->componentSize != column.componentSize)
+    {
+      log::Error("Snapshot column {} has {} byte components, expected {}",
+                 column.id, column.componentSize, type->componentSize);
+      continue;
+    }
+    if (column.count != 0)
+    {
+      HM_ZONE_SCOPED_N("Restore Column");
+      type->read(registry, type->id,
+                 reinterpret_cast<const Entity*>(snapshot.data() +
+                                                 column.entitiesOffset),
+                 snapshot.data() + column.componentsOffset, column.count);
+    }
+  }
+  return true;
+}
+
+bool SnapshotSerializer::Load(Registry& registry,
+                              const std::filesystem::path& path) const
+{
+  const MappedFile file(path);
+  if (file.IsOpen() == false)
+  {
+    log::Error("Could not map snapshot {}", path.string());
+    return false;
+  }
+  return Load(registry, file.GetBytes());
+}
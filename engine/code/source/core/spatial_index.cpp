@@ -0,0 +1,434 @@
+#include "core/spatial_index.hpp"
+
+#include "engine.hpp"
+#include "external/tracy_impl.hpp"
+
+using namespace hm::ecs;
+using hm::culling::Aabb;
+
+namespace
+{
+// 21 bits per axis, cells within a million of the origin on every level
+u64 KeyOf(const glm::ivec3& coord)
+{
+  constexpr u64 Mask = (1ull << 21) - 1;
+  return ((static_cast<u64>(coord.x) & Mask) << 42) |
+         ((static_cast<u64>(coord.y) & Mask) << 21) |
+         (static_cast<u64>(coord.z) & Mask);
+}
+
+bool Overlaps(const Aabb& a, const Aabb& b)
+{
+  return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y &&
+         a.max.y >= b.min.y && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+bool OverlapsSphere(const Aabb& box, const glm::vec3& center, f32 radius)
+{
+  const glm::vec3 closest = glm::clamp(center, box.min, box.max);
+  const glm::vec3 offset = closest - center;
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+bool OverlapsFrustum(const Aabb& box, const hm::culling::Frustum& frustum)
+{
+  const glm::vec3 center = (box.min + box.max) * 0.5f;
+  const glm::vec3 extents = box.max - center;
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    const f32 distance = glm::dot(glm::vec3(plane), center) + plane.w;
+    if (distance + glm::dot(glm::abs(glm::vec3(plane)), extents) < 0.f)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Box around `local` moved by `world`, it grows to fit rotations
+Aabb TransformBounds(const glm::mat4& world, const Aabb& local)
+{
+  const glm::vec3 center = (local.min + local.max) * 0.5f;
+  const glm::vec3 extents = local.max - center;
+  const glm::vec3 worldCenter = glm::vec3(world * glm::vec4(center, 1.f));
+  const glm::vec3 worldExtents = glm::abs(glm::vec3(world[0])) * extents.x +
+                                 glm::abs(glm::vec3(world[1])) * extents.y +
+                                 glm::abs(glm::vec3(world[2])) * extents.z;
+  return {worldCenter - worldExtents, worldCenter + worldExtents};
+}
+
+// Slab test, `hit` is where the ray enters the box, 0 when it starts inside
+bool IntersectRay(const Aabb& box, const glm::vec3& origin,
+                  const glm::vec3& inverseDirection, f32 maxDistance, f32& hit)
+{
+  f32 enter = 0.f;
+  f32 exit = maxDistance;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    f32 near = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+    f32 far = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+    if (near > far)
+    {
+      std::swap(near, far);
+    }
+    // written so a NaN, from a ray running along a face, changes nothing
+    enter = near > enter ? near : enter;
+    exit = far < exit ? far : exit;
+  }
+  hit = enter;
+  return enter <= exit;
+}
+} // namespace
+
+SpatialIndex::SpatialIndex(const std::string& name,
+                           const TransformSystem& transforms,
+                           f32 smallestCellSize)
+    : System(name), m_registry(Engine::Instance().GetECS().GetRegistry()),
+      m_transforms(transforms)
+{
+  f32 cellSize = smallestCellSize;
+  for (Level& level : m_levels)
+  {
+    level.cellSize = cellSize;
+    cellSize *= 2.f;
+  }
+  Reads<Transform>();
+  RunAfter<TransformSystem>();
+  m_registry.on_destroy<SpatialProxy>()
+      .connect<&SpatialIndex::OnProxyDestroyed>(*this);
+}
+
+SpatialIndex::~SpatialIndex()
+{
+  m_registry.on_destroy<SpatialProxy>().disconnect(this);
+}
+
+void SpatialIndex::OnProxyDestroyed(Registry& registry, Entity entity)
+{
+  // the proxies are gone already after a snapshot was loaded
+  const ProxyId id = registry.get<SpatialProxy>(entity).id;
+  if (id < m_proxies.size() && m_proxies[id].entity == entity)
+  {
+    Remove(id);
+  }
+}
+
+u32 SpatialIndex::LevelOf(const Aabb& bounds) const
+{
+  const glm::vec3 size = bounds.max - bounds.min;
+  const f32 largest = std::max({size.x, size.y, size.z});
+  for (u32 level = 0; level < LevelCount; level++)
+  {
+    if (largest <= m_levels[level].cellSize)
+    {
+      return level;
+    }
+  }
+  SDL_assert(false && "Bounds are bigger than the largest cell");
+  return LevelCount - 1;
+}
+
+glm::ivec3 SpatialIndex::CoordOf(const Aabb& bounds, u32 level) const
+{
+  const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  const f32 cellSize = m_levels[level].cellSize;
+  return glm::ivec3(static_cast<int>(std::floor(center.x / cellSize)),
+                    static_cast<int>(std::floor(center.y / cellSize)),
+                    static_cast<int>(std::floor(center.z / cellSize)));
+}
+
+Aabb SpatialIndex::LooseBounds(const Level& level, const Cell& cell) const
+{
+  const glm::vec3 min = glm::vec3(static_cast<f32>(cell.coord.x),
+                                  static_cast<f32>(cell.coord.y),
+                                  static_cast<f32>(cell.coord.z)) *
+                        level.cellSize;
+  const glm::vec3 half(level.cellSize * 0.5f);
+  return {min - half, min + glm::vec3(level.cellSize) + half};
+}
+
+void SpatialIndex::AddToCell(ProxyId id)
+{
+  Proxy& proxy = m_proxies[id];
+  Level& level = m_levels[proxy.level];
+  const glm::ivec3 coord = CoordOf(proxy.bounds, proxy.level);
+
+  auto [it, bInserted] = level.cellOfKey.try_emplace(KeyOf(coord), 0u);
+  if (bInserted)
+  {
+    if (level.freeCells.empty() == false)
+    {
+      it->second = level.freeCells.back();
+      level.freeCells.pop_back();
+    }
+    else
+    {
+      it->second = static_cast<u32>(level.cells.size());
+      level.cells.emplace_back();
+    }
+    level.cells[it->second].coord = coord;
+    level.occupiedCount++;
+  }
+
+  Cell& cell = level.cells[it->second];
+  proxy.cell = it->second;
+  proxy.slot = static_cast<u32>(cell.proxies.size());
+  cell.proxies.push_back(id);
+}
+
+void SpatialIndex::RemoveFromCell(ProxyId id)
+{
+  const Proxy& proxy = m_proxies[id];
+  Level& level = m_levels[proxy.level];
+  Cell& cell = level.cells[proxy.cell];
+
+  // swap with the last one, it takes over the slot
+  const ProxyId last = cell.proxies.back();
+  cell.proxies[proxy.slot] = last;
+  m_proxies[last].slot = proxy.slot;
+  cell.proxies.pop_back();
+
+  if (cell.proxies.empty())
+  {
+    level.cellOfKey.erase(KeyOf(cell.coord));
+    level.freeCells.push_back(proxy.cell);
+    level.occupiedCount--;
+  }
+}
+
+ProxyId SpatialIndex::Insert(Entity entity, const Aabb& bounds,
+                             TransformId transform)
+{
+  ProxyId id;
+  if (m_freeProxies.empty() == false)
+  {
+    id = m_freeProxies.back();
+    m_freeProxies.pop_back();
+  }
+  else
+  {
+    id = static_cast<ProxyId>(m_proxies.size());
+    m_proxies.emplace_back();
+  }
+
+  Proxy& proxy = m_proxies[id];
+  proxy.entity = entity;
+  proxy.localBounds = bounds;
+  proxy.transform = transform;
+  proxy.bounds = bounds;
+  if (transform != InvalidTransform)
+  {
+    // fixed up by the next Update if the world matrix is not there yet
+    proxy.bounds = TransformBounds(m_transforms.GetWorld(transform), bounds);
+  }
+  proxy.level = LevelOf(proxy.bounds);
+  AddToCell(id);
+  m_proxyCount++;
+  return id;
+}
+
+void SpatialIndex::Remove(ProxyId id)
+{
+  RemoveFromCell(id);
+  // unlinked as well, so Update skips it
+  m_proxies[id] = Proxy {};
+  m_freeProxies.push_back(id);
+  m_proxyCount--;
+}
+
+void SpatialIndex::Move(ProxyId id, const Aabb& bounds)
+{
+  Proxy& proxy = m_proxies[id];
+  const u32 level = LevelOf(bounds);
+  const bool bSameCell =
+      level == proxy.level &&
+      CoordOf(bounds, level) == m_levels[level].cells[proxy.cell].coord;
+  if (bSameCell)
+  {
+    proxy.bounds = bounds;
+    return;
+  }
+  RemoveFromCell(id);
+  proxy.level = level;
+  proxy.bounds = bounds;
+  AddToCell(id);
+}
+
+void SpatialIndex::Update(f32)
+{
+  HM_ZONE_SCOPED_N("SpatialIndex::Update");
+  for (ProxyId id = 0; id < m_proxies.size(); id++)
+  {
+    const Proxy& proxy = m_proxies[id];
+    if (proxy.transform == InvalidTransform ||
+        m_transforms.HasChanged(proxy.transform) == false)
+    {
+      continue;
+    }
+    Move(id, TransformBounds(m_transforms.GetWorld(proxy.transform),
+                             proxy.localBounds));
+  }
+}
+
+void SpatialIndex::OnSnapshotLoaded()
+{
+  for (Level& level : m_levels)
+  {
+    level.cellOfKey.clear();
+    level.cells.clear();
+    level.freeCells.clear();
+    level.occupiedCount = 0;
+  }
+  m_proxies.clear();
+  m_freeProxies.clear();
+  m_proxyCount = 0;
+}
+
+template<typename Overlaps, typename Visit>
+void SpatialIndex::ForEachCandidate(const Aabb& range, Overlaps&& overlaps,
+                                    Visit&& visit) const
+{
+  for (const Level& level : m_levels)
+  {
+    if (level.occupiedCount == 0)
+    {
+      continue;
+    }
+
+    // the cells a proxy touching the range can be in, proxies reach half a
+    // cell past their own
+    const f32 half = level.cellSize * 0.5f;
+    const glm::vec3 first = glm::floor((range.min - glm::vec3(half)) /
+                                       level.cellSize);
+    const glm::vec3 last =
+        glm::floor((range.max + glm::vec3(half)) / level.cellSize);
+    const glm::vec3 span = last - first + glm::vec3(1.f);
+    const f64 rangeCells = static_cast<f64>(span.x) * span.y * span.z;
+
+    auto visitCell = [&](const Cell& cell)
+    {
+      if (overlaps(LooseBounds(level, cell)) == false)
+      {
+        return;
+      }
+      for (const ProxyId id : cell.proxies)
+      {
+        const Proxy& proxy = m_proxies[id];
+        if (overlaps(proxy.bounds))
+        {
+          visit(proxy);
+        }
+      }
+    };
+
+    // walking the occupied cells is cheaper than looking up a huge range,
+    // and the only option for unbounded ranges
+    if (std::isfinite(rangeCells) == false ||
+        rangeCells > static_cast<f64>(level.occupiedCount))
+    {
+      for (const Cell& cell : level.cells)
+      {
+        if (cell.proxies.empty() == false)
+        {
+          visitCell(cell);
+        }
+      }
+      continue;
+    }
+    const glm::ivec3 from(first);
+    const glm::ivec3 to(last);
+    for (int z = from.z; z <= to.z; z++)
+    {
+      for (int y = from.y; y <= to.y; y++)
+      {
+        for (int x = from.x; x <= to.x; x++)
+        {
+          const auto it = level.cellOfKey.find(KeyOf({x, y, z}));
+          if (it != level.cellOfKey.end())
+          {
+            visitCell(level.cells[it->second]);
+          }
+        }
+      }
+    }
+  }
+}
+
+void SpatialIndex::QueryFrustum(const culling::Frustum& frustum,
+                                std::vector<Entity>& entities) const
+{
+  HM_ZONE_SCOPED_N("SpatialIndex::QueryFrustum");
+  constexpr f32 Infinity = std::numeric_limits<f32>::infinity();
+  ForEachCandidate(
+      {glm::vec3(-Infinity), glm::vec3(Infinity)},
+      [&frustum](const Aabb& box)
+      {
+        return OverlapsFrustum(box, frustum);
+      },
+      [&entities](const Proxy& proxy)
+      {
+        entities.push_back(proxy.entity);
+      });
+}
+
+void SpatialIndex::QueryAabb(const Aabb& box,
+                             std::vector<Entity>& entities) const
+{
+  HM_ZONE_SCOPED_N("SpatialIndex::QueryAabb");
+  ForEachCandidate(
+      box,
+      [&box](const Aabb& other)
+      {
+        return Overlaps(box, other);
+      },
+      [&entities](const Proxy& proxy)
+      {
+        entities.push_back(proxy.entity);
+      });
+}
+
+void SpatialIndex::QuerySphere(const glm::vec3& center, f32 radius,
+                               std::vector<Entity>& entities) const
+{
+  HM_ZONE_SCOPED_N("SpatialIndex::QuerySphere");
+  ForEachCandidate(
+      {center - glm::vec3(radius), center + glm::vec3(radius)},
+      [&center, radius](const Aabb& box)
+      {
+        return OverlapsSphere(box, center, radius);
+      },
+      [&entities](const Proxy& proxy)
+      {
+        entities.push_back(proxy.entity);
+      });
+}
+
+std::optional<RayHit> SpatialIndex::Raycast(const glm::vec3& origin,
+                                            const glm::vec3& direction,
+                                            f32 maxDistance) const
+{
+  HM_ZONE_SCOPED_N("SpatialIndex::Raycast");
+  const glm::vec3 end = origin + direction * maxDistance;
+  const glm::vec3 inverseDirection = glm::vec3(1.f) / direction;
+
+  std::optional<RayHit> closest;
+  f32 reach = maxDistance;
+  ForEachCandidate(
+      {glm::min(origin, end), glm::max(origin, end)},
+      [&](const Aabb& box)
+      {
+        // only boxes that could beat the closest hit so far
+        f32 hit;
+        return IntersectRay(box, origin, inverseDirection, reach, hit);
+      },
+      [&](const Proxy& proxy)
+      {
+        f32 hit;
+        if (IntersectRay(proxy.bounds, origin, inverseDirection, reach, hit))
+        {
+          reach = hit;
+          closest = RayHit {proxy.entity, hit};
+        }
+      });
+  return closest;
+}
@@ -0,0 +1,157 @@
+#include "core/task_graph.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+
+#include <algorithm>
+
+using namespace hm::jobs;
+
+namespace
+{
+f64 MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<f64, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+} // namespace
+
+TaskId TaskGraph::Add(std::string name, Job&& job,
+                      std::initializer_list<TaskId> dependencies)
+{
+  const TaskId id = static_cast<TaskId>(m_tasks.size());
+  Task& task = m_tasks.emplace_back();
+  task.name = std::move(name);
+  task.job = std::move(job);
+  task.dependencies.assign(dependencies.begin(), dependencies.end());
+  for (const TaskId dependency : dependencies)
+  {
+    SDL_assert(dependency < id && "Dependencies have to be added first");
+    m_tasks[dependency].dependents.push_back(id);
+  }
+  return id;
+}
+
+void TaskGraph::Run(JobSystem& jobSystem)
+{
+  HM_ZONE_SCOPED_N("TaskGraph::Run");
+  HM_ZONE_TEXT(m_name.c_str(), m_name.size());
+  m_pendingDependencies =
+      std::make_unique<std::atomic<u32>[]>(m_tasks.size());
+  for (TaskId id = 0; id < m_tasks.size(); id++)
+  {
+    m_pendingDependencies[id].store(
+        static_cast<u32>(m_tasks[id].dependencies.size()),
+        std::memory_order_relaxed);
+  }
+
+  Counter counter;
+  m_startTime = std::chrono::steady_clock::now();
+  for (TaskId id = 0; id < m_tasks.size(); id++)
+  {
+    if (m_tasks[id].dependencies.empty())
+    {
+      jobSystem.Schedule(
+          [this, id, &jobSystem, &counter]()
+          {
+            Execute(id, jobSystem, counter);
+          },
+          &counter);
+    }
+  }
+  jobSystem.Wait(counter);
+  m_wallTime = MillisecondsSince(m_startTime);
+}
+
+void TaskGraph::Execute(TaskId id, JobSystem& jobSystem, Counter& counter)
+{
+  Task& task = m_tasks[id];
+  task.threadIndex = JobSystem::GetThreadIndex();
+  task.start = MillisecondsSince(m_startTime);
+  {
+    HM_ZONE_SCOPED_N("TaskGraph::Task");
+    HM_ZONE_TEXT(task.name.c_str(), task.name.size());
+    task.job();
+  }
+  task.duration = MillisecondsSince(m_startTime) - task.start;
+  // the captures may hold on to resources, they are not needed anymore
+  task.job = nullptr;
+
+  // scheduled before this job leaves the counter, so it cannot hit zero early
+  for (const TaskId dependent : task.dependents)
+  {
+    if (m_pendingDependencies[dependent].fetch_sub(
+            1, std::memory_order_acq_rel) == 1)
+    {
+      jobSystem.Schedule(
+          [this, dependent, &jobSystem, &counter]()
+          {
+            Execute(dependent, jobSystem, counter);
+          },
+          &counter);
+    }
+  }
+}
+
+void TaskGraph::LogReport() const
+{
+  if (m_tasks.empty())
+  {
+    return;
+  }
+
+  // latest finish time along any chain ending in a task, the ids are already
+  // in topological order
+  std::vector<f64> chainTime(m_tasks.size(), 0.0);
+  std::vector<TaskId> slowestDependency(m_tasks.size(), ~0u);
+  f64 workTime = 0.0;
+  TaskId last = 0;
+  for (TaskId id = 0; id < m_tasks.size(); id++)
+  {
+    const Task& task = m_tasks[id];
+    f64 before = 0.0;
+    for (const TaskId dependency : task.dependencies)
+    {
+      if (chainTime[dependency] > before)
+      {
+        before = chainTime[dependency];
+        slowestDependency[id] = dependency;
+      }
+    }
+    chainTime[id] = before + task.duration;
+    workTime += task.duration;
+    if (chainTime[id] > chainTime[last])
+    {
+      last = id;
+    }
+  }
+
+  log::Info("{}: {:.1f} ms wall time, {:.1f} ms of work in {} tasks", m_name,
+            m_wallTime, workTime, m_tasks.size());
+
+  std::vector<TaskId> order(m_tasks.size());
+  for (TaskId id = 0; id < m_tasks.size(); id++)
+  {
+    order[id] = id;
+  }
+  std::ranges::sort(order,
+                    [this](TaskId a, TaskId b)
+                    {
+                      return m_tasks[a].start < m_tasks[b].start;
+                    });
+  for (const TaskId id : order)
+  {
+    const Task& task = m_tasks[id];
+    log::Info("  {:8.1f} ms  {:8.1f} ms  thread {:2}  {}", task.start,
+              task.duration, task.threadIndex, task.name);
+  }
+
+  std::string criticalPath = m_tasks[last].name;
+  for (TaskId id = slowestDependency[last]; id != ~0u;
+       id = slowestDependency[id])
+  {
+    criticalPath = m_tasks[id].name + " -> " + criticalPath;
+  }
+  log::Info("  critical path ({:.1f} ms): {}", chainTime[last], criticalPath);
+}
@@ -0,0 +1,665 @@
+#include "core/transform.hpp"
+
+#include "engine.hpp"
+#include "core/jobs.hpp"
+#include "external/tracy_impl.hpp"
+#include "utility/simd.hpp"
+
+#include <array>
+
+using namespace hm::ecs;
+
+namespace
+{
+constexpr u32 InvalidSlot = ~0u;
+// levels smaller than this are not worth splitting over the workers
+constexpr u32 LevelGrainSize = 1024;
+// axes scaled less than this count as flattened
+constexpr f32 MinScale = 1e-12f;
+// how far a decomposed matrix may be off, relative to its largest scale
+constexpr f32 DecomposeTolerance = 1e-4f;
+
+template<typename T>
+void Permute(std::vector<T>& values, const std::vector<u32>& order)
+{
+  std::vector<T> sorted;
+  sorted.reserve(order.size());
+  for (const u32 slot : order)
+  {
+    sorted.push_back(values[slot]);
+  }
+  values.swap(sorted);
+}
+
+// unit vector at a right angle to the unit `axis`
+glm::vec3 Perpendicular(const glm::vec3& axis)
+{
+  const glm::vec3 other = std::abs(axis.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f)
+                                                  : glm::vec3(0.f, 1.f, 0.f);
+  return glm::normalize(glm::cross(axis, other));
+}
+} // namespace
+
+bool hm::ecs::Decompose(const glm::mat4& matrix, glm::vec3& translation,
+                        glm::quat& rotation, glm::vec3& scale)
+{
+  translation = glm::vec3(matrix[3]);
+  const glm::mat3 linear(matrix);
+  scale = glm::vec3(glm::length(linear[0]), glm::length(linear[1]),
+                    glm::length(linear[2]));
+  // the mirror goes into the x scale, quat_cast needs a proper rotation
+  if (glm::determinant(linear) < 0.f)
+  {
+    scale.x = -scale.x;
+  }
+
+  // flattened axes are not divided, their direction comes from the others
+  glm::mat3 axes(1.f);
+  std::array<int, 3> scaled {};
+  u32 scaledCount = 0;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (std::abs(scale[axis]) > MinScale)
+    {
+      axes[axis] = linear[axis] / scale[axis];
+      scaled[scaledCount++] = axis;
+    }
+    else
+    {
+      scale[axis] = 0.f;
+    }
+  }
+  if (scaledCount == 2)
+  {
+    const int axis = 3 - scaled[0] - scaled[1];
+    const glm::vec3 normal =
+        glm::cross(axes[(axis + 1) % 3], axes[(axis + 2) % 3]);
+    if (glm::length(normal) > MinScale)
+    {
+      axes[axis] = glm::normalize(normal);
+    }
+    else
+    {
+      // the two are parallel, the second one cannot be kept
+      scaledCount = 1;
+    }
+  }
+  if (scaledCount == 1)
+  {
+    const int axis = scaled[0];
+    axes[(axis + 1) % 3] = Perpendicular(axes[axis]);
+    axes[(axis + 2) % 3] = glm::cross(axes[axis], axes[(axis + 1) % 3]);
+  }
+  rotation = glm::normalize(glm::quat_cast(axes));
+
+  // shear and projection do not survive the trip through the parts
+  const glm::mat3 rotationMatrix = glm::mat3_cast(rotation);
+  f32 error = glm::length(glm::vec4(matrix[0][3], matrix[1][3], matrix[2][3],
+                                    matrix[3][3] - 1.f));
+  f32 size = 1.f;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    error = std::max(
+        error, glm::length(rotationMatrix[axis] * scale[axis] - linear[axis]));
+    size = std::max(size, std::abs(scale[axis]));
+  }
+  return error <= DecomposeTolerance * size;
+}
+
+TransformSystem::TransformSystem(const std::string& name)
+    : System(name), m_registry(Engine::Instance().GetECS().GetRegistry())
+{
+  // every other system reading world matrices has to declare it
+  Writes<Transform>();
+  m_registry.on_destroy<Transform>()
+      .connect<&TransformSystem::OnTransformDestroyed>(*this);
+}
+
+TransformSystem::~TransformSystem()
+{
+  m_registry.on_destroy<Transform>().disconnect(this);
+}
+
+TransformId TransformSystem::Create(TransformId parent,
+                                    const glm::vec3& translation,
+                                    const glm::quat& rotation,
+                                    const glm::vec3& scale)
+{
+  TransformId id;
+  if (m_freeIds.empty() == false)
+  {
+    id = m_freeIds.back();
+    m_freeIds.pop_back();
+  }
+  else
+  {
+    id = static_cast<TransformId>(m_slotOfId.size());
+    m_slotOfId.push_back(InvalidSlot);
+    m_parentOfId.push_back(InvalidTransform);
+    m_firstChild.push_back(InvalidTransform);
+    m_nextSibling.push_back(InvalidTransform);
+    m_previousSibling.push_back(InvalidTransform);
+    m_listed.push_back(0);
+  }
+
+  // appended at the end, SortByDepth moves it to its level before the update
+  m_slotOfId[id] = static_cast<u32>(m_idOfSlot.size());
+  LinkChild(id, parent);
+  m_idOfSlot.push_back(id);
+  m_parentSlot.push_back(InvalidSlot);
+  m_translations.push_back(translation);
+  m_rotations.push_back(rotation);
+  m_scales.push_back(scale);
+  m_matrixLocal.push_back(0);
+  m_worlds.emplace_back(1.f);
+  m_previousWorlds.emplace_back(1.f);
+  m_dirty.push_back(1);
+  m_changed.push_back(Created);
+  m_dirtyRoots.push_back(id);
+  m_bStructureDirty = true;
+  return id;
+}
+
+void TransformSystem::Destroy(TransformId id)
+{
+  const TransformId parent = m_parentOfId[id];
+  while (m_firstChild[id] != InvalidTransform)
+  {
+    const TransformId child = m_firstChild[id];
+    UnlinkChild(child);
+    LinkChild(child, parent);
+    MarkDirty(child);
+  }
+  UnlinkChild(id);
+  m_localMatrices.erase(id);
+
+  // the slot is dropped by the next SortByDepth
+  m_idOfSlot[m_slotOfId[id]] = InvalidTransform;
+  m_slotOfId[id] = InvalidSlot;
+  m_freeIds.push_back(id);
+  m_bStructureDirty = true;
+}
+
+void TransformSystem::OnTransformDestroyed(Registry& registry, Entity entity)
+{
+  const TransformId id = registry.get<Transform>(entity).id;
+  if (id != InvalidTransform && m_slotOfId[id] != InvalidSlot)
+  {
+    Destroy(id);
+  }
+}
+
+void TransformSystem::Reserve(u32 count)
+{
+  const size_t ids =
+      m_slotOfId.size() + count - std::min<size_t>(count, m_freeIds.size());
+  m_slotOfId.reserve(ids);
+  m_parentOfId.reserve(ids);
+  m_firstChild.reserve(ids);
+  m_nextSibling.reserve(ids);
+  m_previousSibling.reserve(ids);
+  m_listed.reserve(ids);
+
+  const size_t slots = m_idOfSlot.size() + count;
+  m_idOfSlot.reserve(slots);
+  m_parentSlot.reserve(slots);
+  m_translations.reserve(slots);
+  m_rotations.reserve(slots);
+  m_scales.reserve(slots);
+  m_matrixLocal.reserve(slots);
+  m_worlds.reserve(slots);
+  m_previousWorlds.reserve(slots);
+  m_dirty.reserve(slots);
+  m_changed.reserve(slots);
+  m_dirtyRoots.reserve(m_dirtyRoots.size() + count);
+}
+
+void TransformSystem::SetParent(TransformId id, TransformId parent)
+{
+  UnlinkChild(id);
+  LinkChild(id, parent);
+  MarkDirty(id);
+  m_bStructureDirty = true;
+}
+
+void TransformSystem::SetLocal(TransformId id, const glm::vec3& translation,
+                               const glm::quat& rotation,
+                               const glm::vec3& scale)
+{
+  const u32 slot = m_slotOfId[id];
+  m_translations[slot] = translation;
+  m_rotations[slot] = rotation;
+  m_scales[slot] = scale;
+  DropLocalMatrix(id);
+  MarkDirty(id);
+}
+
+void TransformSystem::SetLocal(TransformId id, const glm::mat4& local)
+{
+  glm::vec3 translation, scale;
+  glm::quat rotation;
+  const bool bSplit = Decompose(local, translation, rotation, scale);
+  SetLocal(id, translation, rotation, scale);
+  // the parts stay as close as they get, the matrix is what is used
+  if (bSplit == false)
+  {
+    m_matrixLocal[m_slotOfId[id]] = 1;
+    m_localMatrices[id] = local;
+  }
+}
+
+void TransformSystem::SetTranslation(TransformId id,
+                                     const glm::vec3& translation)
+{
+  m_translations[m_slotOfId[id]] = translation;
+  DropLocalMatrix(id);
+  MarkDirty(id);
+}
+
+void TransformSystem::SetRotation(TransformId id, const glm::quat& rotation)
+{
+  m_rotations[m_slotOfId[id]] = rotation;
+  DropLocalMatrix(id);
+  MarkDirty(id);
+}
+
+void TransformSystem::SetScale(TransformId id, const glm::vec3& scale)
+{
+  m_scales[m_slotOfId[id]] = scale;
+  DropLocalMatrix(id);
+  MarkDirty(id);
+}
+
+void TransformSystem::DropLocalMatrix(TransformId id)
+{
+  u8& bMatrix = m_matrixLocal[m_slotOfId[id]];
+  if (bMatrix != 0)
+  {
+    bMatrix = 0;
+    m_localMatrices.erase(id);
+  }
+}
+
+const glm::vec3& TransformSystem::GetTranslation(TransformId id) const
+{
+  return m_translations[m_slotOfId[id]];
+}
+
+const glm::quat& TransformSystem::GetRotation(TransformId id) const
+{
+  return m_rotations[m_slotOfId[id]];
+}
+
+const glm::vec3& TransformSystem::GetScale(TransformId id) const
+{
+  return m_scales[m_slotOfId[id]];
+}
+
+const glm::mat4& TransformSystem::GetWorld(TransformId id) const
+{
+  return m_worlds[m_slotOfId[id]];
+}
+
+glm::mat4 TransformSystem::GetInterpolatedWorld(TransformId id,
+                                                f32 alpha) const
+{
+  const u32 slot = m_slotOfId[id];
+  if (m_changed[slot] != Moved)
+  {
+    return m_worlds[slot];
+  }
+
+  // decompose both ends, blending the matrices directly would shear them.
+  // Mirrors keep their negative x scale, so the blend keeps its sign too.
+  glm::vec3 fromTranslation, toTranslation, fromScale, toScale;
+  glm::quat fromRotation, toRotation;
+  Decompose(m_previousWorlds[slot], fromTranslation, fromRotation, fromScale);
+  Decompose(m_worlds[slot], toTranslation, toRotation, toScale);
+  // a mirror that came or went during the tick has no rotation to blend
+  if (fromScale.x * toScale.x < 0.f)
+  {
+    return m_worlds[slot];
+  }
+
+  const glm::mat3 rotation =
+      glm::mat3_cast(glm::slerp(fromRotation, toRotation, alpha));
+  const glm::vec3 scale = glm::mix(fromScale, toScale, alpha);
+  return glm::mat4(glm::vec4(rotation[0] * scale.x, 0.f),
+                   glm::vec4(rotation[1] * scale.y, 0.f),
+                   glm::vec4(rotation[2] * scale.z, 0.f),
+                   glm::vec4(glm::mix(fromTranslation, toTranslation, alpha),
+                             1.f));
+}
+
+void TransformSystem::SortByDepth()
+{
+  HM_ZONE_SCOPED_N("TransformSystem::SortByDepth");
+  // breadth first from the roots, so the children of a node come right after
+  // the children of the node before it on the same level
+  std::vector<u32> order;
+  order.reserve(m_idOfSlot.size());
+  for (u32 slot = 0; slot < m_idOfSlot.size(); slot++)
+  {
+    const TransformId id = m_idOfSlot[slot];
+    if (id != InvalidTransform && m_parentOfId[id] == InvalidTransform)
+    {
+      order.push_back(slot);
+    }
+  }
+  m_levelStarts.assign(1, 0);
+  m_childBegin.clear();
+  m_childEnd.clear();
+  u32 levelEnd = static_cast<u32>(order.size());
+  for (u32 slot = 0; slot < order.size(); slot++)
+  {
+    if (slot == levelEnd)
+    {
+      m_levelStarts.push_back(slot);
+      levelEnd = static_cast<u32>(order.size());
+    }
+    m_childBegin.push_back(static_cast<u32>(order.size()));
+    for (TransformId child = m_firstChild[m_idOfSlot[order[slot]]];
+         child != InvalidTransform; child = m_nextSibling[child])
+    {
+      order.push_back(m_slotOfId[child]);
+    }
+    m_childEnd.push_back(static_cast<u32>(order.size()));
+  }
+  m_levelStarts.push_back(static_cast<u32>(order.size()));
+  // a node that is not reached is part of a parent cycle
+  SDL_assert(order.size() == m_slotOfId.size() - m_freeIds.size());
+
+  Permute(m_idOfSlot, order);
+  Permute(m_translations, order);
+  Permute(m_rotations, order);
+  Permute(m_scales, order);
+  Permute(m_matrixLocal, order);
+  Permute(m_worlds, order);
+  Permute(m_previousWorlds, order);
+  Permute(m_dirty, order);
+  Permute(m_changed, order);
+
+  for (u32 slot = 0; slot < m_idOfSlot.size(); slot++)
+  {
+    m_slotOfId[m_idOfSlot[slot]] = slot;
+  }
+  m_parentSlot.resize(m_idOfSlot.size());
+  for (u32 slot = 0; slot < m_idOfSlot.size(); slot++)
+  {
+    const TransformId parent = m_parentOfId[m_idOfSlot[slot]];
+    m_parentSlot[slot] = parent == InvalidTransform ? InvalidSlot
+                                                    : m_slotOfId[parent];
+  }
+  m_bStructureDirty = false;
+}
+
+glm::mat4 TransformSystem::ComputeLocal(u32 slot) const
+{
+  if (m_matrixLocal[slot] != 0)
+  {
+    return m_localMatrices.find(m_idOfSlot[slot])->second;
+  }
+  const glm::mat3 rotation = glm::mat3_cast(m_rotations[slot]);
+  const glm::vec3& scale = m_scales[slot];
+  return glm::mat4(glm::vec4(rotation[0] * scale.x, 0.f),
+                   glm::vec4(rotation[1] * scale.y, 0.f),
+                   glm::vec4(rotation[2] * scale.z, 0.f),
+                   glm::vec4(m_translations[slot], 1.f));
+}
+
+void TransformSystem::UpdateRange(u32 begin, u32 end)
+{
+  // the first level holds the roots and only them
+  if (m_parentSlot[begin] == InvalidSlot)
+  {
+    for (u32 slot = begin; slot < end; slot++)
+    {
+      m_worlds[slot] = ComputeLocal(slot);
+    }
+    return;
+  }
+
+  // the parents are one level up and already done
+  u32 slot = begin;
+  glm::mat4 locals[4];
+  const glm::mat4* parents[4];
+  for (; slot + 4 <= end; slot += 4)
+  {
+    for (u32 i = 0; i < 4; i++)
+    {
+      locals[i] = ComputeLocal(slot + i);
+      parents[i] = &m_worlds[m_parentSlot[slot + i]];
+    }
+    simd::MultiplyMatrices4(parents, locals, &m_worlds[slot]);
+  }
+  for (; slot < end; slot++)
+  {
+    simd::MultiplyMatrices(m_worlds[m_parentSlot[slot]], ComputeLocal(slot),
+                           m_worlds[slot]);
+  }
+}
+
+void TransformSystem::Update(f32)
+{
+  HM_ZONE_SCOPED_N("TransformSystem::Update");
+  if (m_bStructureDirty)
+  {
+    SortByDepth();
+  }
+
+  // nodes that moved during the last tick start interpolating from here
+  for (const TransformId id : m_movedIds)
+  {
+    const u32 slot = m_slotOfId[id];
+    if (slot != InvalidSlot && m_changed[slot] == Moved)
+    {
+      m_previousWorlds[slot] = m_worlds[slot];
+      m_changed[slot] = Unchanged;
+      ListChanged(id);
+    }
+  }
+  m_movedIds.clear();
+  if (m_dirtyRoots.empty())
+  {
+    return;
+  }
+
+  std::vector<u32> rootSlots;
+  rootSlots.reserve(m_dirtyRoots.size());
+  for (const TransformId id : m_dirtyRoots)
+  {
+    // skips the destroyed nodes and the ones listed twice
+    const u32 slot = m_slotOfId[id];
+    if (slot != InvalidSlot && m_dirty[slot])
+    {
+      m_dirty[slot] = 0;
+      rootSlots.push_back(slot);
+    }
+  }
+  m_dirtyRoots.clear();
+  std::ranges::sort(rootSlots);
+
+  // a subtree is one range per level, so the dirty nodes of a level are the
+  // child ranges of the level above plus the roots on this level
+  jobs::JobSystem& jobSystem = Engine::Instance().GetJobs();
+  std::vector<SlotRange> ranges;
+  std::vector<SlotRange> childRanges;
+  std::vector<SlotRange> updatedRanges;
+  std::vector<u32> offsets;
+  auto root = rootSlots.begin();
+  for (u32 level = 0; level + 1 < m_levelStarts.size(); level++)
+  {
+    for (; root != rootSlots.end() && *root < m_levelStarts[level + 1]; ++root)
+    {
+      ranges.push_back({*root, *root + 1});
+    }
+    if (ranges.empty() && root == rootSlots.end())
+    {
+      break;
+    }
+
+    // nested roots overlap the ranges of their ancestors
+    std::ranges::sort(ranges, {}, &SlotRange::begin);
+    size_t merged = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+      if (ranges[i].begin == ranges[i].end)
+      {
+        continue;
+      }
+      if (merged > 0 && ranges[i].begin <= ranges[merged - 1].end)
+      {
+        SlotRange& last = ranges[merged - 1];
+        last.end = std::max(last.end, ranges[i].end);
+      }
+      else
+      {
+        ranges[merged++] = ranges[i];
+      }
+    }
+    ranges.resize(merged);
+
+    offsets.clear();
+    u32 count = 0;
+    for (const SlotRange& range : ranges)
+    {
+      offsets.push_back(count);
+      count += range.end - range.begin;
+    }
+    jobSystem.ParallelFor(
+        count, LevelGrainSize,
+        [&](u32 first, u32 last)
+        {
+          size_t i = std::ranges::upper_bound(offsets, first) -
+                     offsets.begin() - 1;
+          for (; first < last; i++)
+          {
+            const u32 begin = ranges[i].begin + (first - offsets[i]);
+            const u32 end = std::min(ranges[i].end, begin + (last - first));
+            UpdateRange(begin, end);
+            first += end - begin;
+          }
+        });
+
+    childRanges.clear();
+    for (const SlotRange& range : ranges)
+    {
+      updatedRanges.push_back(range);
+      childRanges.push_back(
+          {m_childBegin[range.begin], m_childEnd[range.end - 1]});
+    }
+    ranges.swap(childRanges);
+  }
+
+  // the ranges ran in parallel, so the moved nodes are gathered afterwards
+  for (const SlotRange& range : updatedRanges)
+  {
+    for (u32 slot = range.begin; slot < range.end; slot++)
+    {
+      if (m_changed[slot] == Created)
+      {
+        m_previousWorlds[slot] = m_worlds[slot];
+      }
+      m_changed[slot] = Moved;
+      m_movedIds.push_back(m_idOfSlot[slot]);
+      ListChanged(m_idOfSlot[slot]);
+    }
+  }
+}
+
+void TransformSystem::OnSnapshotLoaded()
+{
+  m_slotOfId.clear();
+  m_parentOfId.clear();
+  m_firstChild.clear();
+  m_nextSibling.clear();
+  m_previousSibling.clear();
+  m_freeIds.clear();
+  m_idOfSlot.clear();
+  m_parentSlot.clear();
+  m_translations.clear();
+  m_rotations.clear();
+  m_scales.clear();
+  m_matrixLocal.clear();
+  m_localMatrices.clear();
+  m_worlds.clear();
+  m_previousWorlds.clear();
+  m_dirty.clear();
+  m_changed.clear();
+  m_childBegin.clear();
+  m_childEnd.clear();
+  m_dirtyRoots.clear();
+  m_movedIds.clear();
+  m_listed.clear();
+  m_changedIds.clear();
+  m_levelStarts.clear();
+  m_bStructureDirty = false;
+}
+
+void TransformSystem::ClearChangedIds()
+{
+  for (const TransformId id : m_changedIds)
+  {
+    m_listed[id] = 0;
+  }
+  m_changedIds.clear();
+}
+
+void TransformSystem::ListChanged(TransformId id)
+{
+  if (m_listed[id] == 0)
+  {
+    m_listed[id] = 1;
+    m_changedIds.push_back(id);
+  }
+}
+
+void TransformSystem::MarkDirty(TransformId id)
+{
+  const u32 slot = m_slotOfId[id];
+  if (m_dirty[slot] == 0)
+  {
+    m_dirty[slot] = 1;
+    m_dirtyRoots.push_back(id);
+  }
+}
+
+void TransformSystem::LinkChild(TransformId id, TransformId parent)
+{
+  m_parentOfId[id] = parent;
+  m_previousSibling[id] = InvalidTransform;
+  m_nextSibling[id] = InvalidTransform;
+  if (parent == InvalidTransform)
+  {
+    return;
+  }
+  const TransformId next = m_firstChild[parent];
+  if (next != InvalidTransform)
+  {
+    m_previousSibling[next] = id;
+  }
+  m_nextSibling[id] = next;
+  m_firstChild[parent] = id;
+}
+
+void TransformSystem::UnlinkChild(TransformId id)
+{
+  const TransformId parent = m_parentOfId[id];
+  const TransformId previous = m_previousSibling[id];
+  const TransformId next = m_nextSibling[id];
+  if (previous != InvalidTransform)
+  {
+    m_nextSibling[previous] = next;
+  }
+  else if (parent != InvalidTransform)
+  {
+    m_firstChild[parent] = next;
+  }
+  if (next != InvalidTransform)
+  {
+    m_previousSibling[next] = previous;
+  }
+  m_parentOfId[id] = InvalidTransform;
+  m_previousSibling[id] = InvalidTransform;
+  m_nextSibling[id] = InvalidTransform;
+}
@@ -2,6 +2,9 @@
 
 #include "core/ecs.hpp"
 #include "core/input.hpp"
+#include "core/jobs.hpp"
+#include "core/spatial_index.hpp"
+#include "core/transform.hpp"
 #include "camera.hpp"
 #include "core/device.hpp"
 #include "utility/logger.hpp"
@@ -20,15 +23,22 @@ Engine& Engine::Instance()
 
 void Engine::Init()
 {
+  // started first so every other module can hand work to it
+  m_pJobSystem = new jobs::JobSystem();
   m_pDevice = new Device();
   m_pInput = new input::Input();
 
   m_pEntityComponentSystem = new EntityComponentSystem();
+  const auto& transforms =
+      m_pEntityComponentSystem->CreateSystem<TransformSystem>("Transforms");
+  m_pEntityComponentSystem->CreateSystem<SpatialIndex>("Spatial Index",
+                                                       transforms);
 
   // TODO create camera based if it is the editor or not
   auto& camera =
       m_pEntityComponentSystem->CreateSystem<Camera>("Camera Editor");
   m_pInput->AddInputHandler(camera);
+  m_lastFrameTime = std::chrono::steady_clock::now();
 
   Logger logger;
   // console
@@ -49,6 +59,10 @@ SDL_AppResult Engine::Run()
   }
 
   const auto start = std::chrono::system_clock::now();
+  const auto now = std::chrono::steady_clock::now();
+  const f64 frameTime =
+      std::chrono::duration<f64>(now - m_lastFrameTime).count();
+  m_lastFrameTime = now;
 
   // do not draw if we are minimized
   if (m_pDevice->m_bMinimized)
@@ -66,8 +80,26 @@ SDL_AppResult Engine::Run()
   // m_pDevice->PreRender();
 
   // m_pDevice->Render();
-  // TODO add delta time
-  m_pEntityComponentSystem->UpdateSystems(0.1f);
+  // the simulation advances in fixed steps, rendering happens once per frame
+  // in between two of them
+  m_accumulator += frameTime;
+  u32 ticks = 0;
+  while (m_accumulator >= m_fixedDeltaTime && ticks < m_maxTicksPerFrame)
+  {
+    m_pEntityComponentSystem->UpdateSystems(m_fixedDeltaTime);
+    // sync point, structural changes recorded during the update land here
+    m_pEntityComponentSystem->FlushCommands();
+    m_accumulator -= m_fixedDeltaTime;
+    ticks++;
+  }
+  if (ticks == m_maxTicksPerFrame && m_accumulator >= m_fixedDeltaTime)
+  {
+    // too far behind, let the simulation slow down instead of catching up
+    m_accumulator = std::fmod(m_accumulator, m_fixedDeltaTime);
+  }
+  m_interpolationAlpha = static_cast<f32>(m_accumulator / m_fixedDeltaTime);
+  stats.tick_count = static_cast<int>(ticks);
+
   m_pEntityComponentSystem->RenderSystems();
   m_pDevice->EndFrame();
   auto end = std::chrono::system_clock::now();
@@ -78,6 +110,12 @@ SDL_AppResult Engine::Run()
   return SDL_APP_CONTINUE;
 }
 
+void Engine::SetTickRate(f32 ticksPerSecond)
+{
+  SDL_assert(ticksPerSecond > 0.f);
+  m_fixedDeltaTime = 1.f / ticksPerSecond;
+}
+
 void Engine::Shutdown()
 {
   Info("Engine is freeing resources");
@@ -85,5 +123,6 @@ void Engine::Shutdown()
   delete m_pInput;
 
   delete m_pDevice;
+  delete m_pJobSystem;
   Info("Engine is closed");
 }
@@ -5,8 +5,25 @@
 #include "platform/opengl/imgui_impl_gl.hpp"
 #include "platform/opengl/opengl_gl.hpp"
 #include "platform/opengl/shader_gl.hpp"
-hm::gpx::Renderer::Renderer(const std::string& name) : System(name) {}
+#include "utility/logger.hpp"
+hm::gpx::Renderer::Renderer(const std::string& name) : System(name)
+{
+  // all the work happens in Render, on the main thread
+  m_access.bExclusive = false;
+}
 hm::gpx::Renderer::~Renderer() {}
+void hm::gpx::Renderer::SetThreadedRendering(bool enabled)
+{
+  // the GL context is bound to the main thread
+  if (enabled)
+  {
+    hm::log::Warning("Threaded rendering is not supported with OpenGL");
+  }
+}
+bool hm::gpx::Renderer::IsThreadedRendering() const
+{
+  return false;
+}
 struct ComputeEffect
 {
   std::string name;
@@ -172,3 +189,4 @@ void hm::gpx::Renderer::Render()
   external::ImGuiEndFrame();
 }
 void hm::gpx::Renderer::Update(f32 dt) {}
+void hm::gpx::Renderer::OnSnapshotLoaded() {}
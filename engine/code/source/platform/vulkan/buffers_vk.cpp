@@ -0,0 +1,73 @@
+#include "platform/vulkan/buffers_vk.hpp"
+
+#include "volk.h"
+
+#include <bit>
+
+VkDeviceAddress vkutil::get_buffer_address(VkDevice device, VkBuffer buffer)
+{
+  const VkBufferDeviceAddressInfo addressInfo {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+      .buffer = buffer};
+  return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void vkutil::memory_barrier(VkCommandBuffer cmd,
+                            VkPipelineStageFlags2 srcStage,
+                            VkAccessFlags2 srcAccess,
+                            VkPipelineStageFlags2 dstStage,
+                            VkAccessFlags2 dstAccess)
+{
+  VkMemoryBarrier2 barrier {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+  barrier.srcStageMask = srcStage;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstStageMask = dstStage;
+  barrier.dstAccessMask = dstAccess;
+
+  VkDependencyInfo depInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  depInfo.memoryBarrierCount = 1;
+  depInfo.pMemoryBarriers = &barrier;
+
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+VkPipelineStageFlags2 vkutil::draw_shader_stages()
+{
+  return VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+         (hm::_bMeshShaders ? VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT : 0);
+}
+
+using namespace hm;
+
+PerFrameBuffer::Mapping PerFrameBuffer::Map(size_t size)
+{
+  Frame& frame = m_frames[_frameNumber % internal::FRAME_OVERLAP];
+  if (frame.size < size)
+  {
+    if (frame.size != 0)
+    {
+      destroy_buffer(frame.buffer);
+    }
+    frame.size = std::bit_ceil(size);
+    frame.buffer =
+        create_buffer(frame.size, m_usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.address =
+        (m_usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0
+            ? vkutil::get_buffer_address(_device, frame.buffer.buffer)
+            : 0;
+  }
+  return {frame.buffer.buffer, frame.address,
+          static_cast<std::byte*>(frame.buffer.info.pMappedData)};
+}
+
+void PerFrameBuffer::Destroy()
+{
+  for (Frame& frame : m_frames)
+  {
+    if (frame.size != 0)
+    {
+      destroy_buffer(frame.buffer);
+    }
+    frame = {};
+  }
+}
@@ -0,0 +1,155 @@
+#include "platform/vulkan/depth_pyramid_vk.hpp"
+
+#include "volk.h"
+#include "core/fileio.hpp"
+#include "external/tracy_impl.hpp"
+#include "platform/vulkan/buffers_vk.hpp"
+#include "platform/vulkan/descriptors_vk.hpp"
+#include "platform/vulkan/images_vk.hpp"
+#include "platform/vulkan/initializers_vk.hpp"
+#include "platform/vulkan/pipelines_vk.hpp"
+#include "utility/logger.hpp"
+
+#include <algorithm>
+#include <bit>
+
+using namespace hm;
+
+void DepthPyramid::Init()
+{
+  DescriptorLayoutBuilder builder;
+  builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  m_reduceSetLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+  VkPushConstantRange pushConstant {};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(ReducePushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo =
+      vkinit::pipeline_layout_create_info();
+  layoutInfo.pSetLayouts = &m_reduceSetLayout;
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstant;
+  layoutInfo.pushConstantRangeCount = 1;
+  VK_CHECK(vkCreatePipelineLayout(_device, &layoutInfo, nullptr,
+                                  &m_reduceLayout));
+
+  VkShaderModule reduceShader;
+  if (!vkutil::load_shader_module(
+          io::GetPath("shaders/depth_reduce.comp.vk.spv").c_str(), _device,
+          &reduceShader))
+  {
+    log::Error("Error when building the depth reduce shader");
+  }
+
+  VkPipelineShaderStageCreateInfo stageInfo {};
+  stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  stageInfo.module = reduceShader;
+  stageInfo.pName = "main";
+
+  VkComputePipelineCreateInfo pipelineInfo {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = m_reduceLayout;
+  pipelineInfo.stage = stageInfo;
+  VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo,
+                                    nullptr, &m_reducePipeline));
+  vkDestroyShaderModule(_device, reduceShader, nullptr);
+
+  // the depth image keeps its size when the window does
+  const VkExtent3D extent {std::bit_floor(_depthImage.imageExtent.width),
+                           std::bit_floor(_depthImage.imageExtent.height), 1};
+  m_image = create_image(extent, VK_FORMAT_R32_SFLOAT,
+                         VK_IMAGE_USAGE_STORAGE_BIT |
+                             VK_IMAGE_USAGE_SAMPLED_BIT,
+                         true);
+  m_levelCount = std::bit_width(std::max(extent.width, extent.height));
+  m_levelViews.resize(m_levelCount);
+  for (u32 level = 0; level < m_levelCount; level++)
+  {
+    VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(
+        VK_FORMAT_R32_SFLOAT, m_image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    viewInfo.subresourceRange.baseMipLevel = level;
+    VK_CHECK(
+        vkCreateImageView(_device, &viewInfo, nullptr, &m_levelViews[level]));
+  }
+  // written and read in the general layout from then on
+  immediate_submit(
+      [this](VkCommandBuffer cmd)
+      {
+        vkutil::transition_image(cmd, m_image.image,
+                                 VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_IMAGE_LAYOUT_GENERAL);
+      });
+
+  _mainDeletionQueue.push_function(
+      [this]()
+      {
+        for (VkImageView view : m_levelViews)
+        {
+          vkDestroyImageView(_device, view, nullptr);
+        }
+        m_levelViews.clear();
+        destroy_image(m_image);
+        vkDestroyPipeline(_device, m_reducePipeline, nullptr);
+        vkDestroyPipelineLayout(_device, m_reduceLayout, nullptr);
+        vkDestroyDescriptorSetLayout(_device, m_reduceSetLayout, nullptr);
+      });
+}
+
+void DepthPyramid::Build(VkCommandBuffer cmd, VkExtent2D viewport,
+                         VkExtent2D drawn)
+{
+  HM_ZONE_SCOPED_N("DepthPyramid::Build");
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipeline);
+
+  glm::ivec2 sourceSize {viewport.width, viewport.height};
+  glm::ivec2 validSize {std::min(drawn.width, viewport.width),
+                        std::min(drawn.height, viewport.height)};
+  for (u32 level = 0; level < m_levelCount; level++)
+  {
+    const glm::ivec2 targetSize {
+        std::max(m_image.imageExtent.width >> level, 1u),
+        std::max(m_image.imageExtent.height >> level, 1u)};
+
+    // level 0 reads the depth image, every other level the one before it
+    VkDescriptorSet set = get_current_frame()._frameDescriptors.allocate(
+        _device, m_reduceSetLayout);
+    DescriptorWriter writer;
+    if (level == 0)
+    {
+      writer.write_image(0, _depthImage.imageView, _defaultSamplerNearest,
+                         VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    }
+    else
+    {
+      writer.write_image(0, m_levelViews[level - 1], _defaultSamplerNearest,
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    }
+    writer.write_image(1, m_levelViews[level], VK_NULL_HANDLE,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.update_set(_device, set);
+
+    const ReducePushConstants pushConstants {sourceSize, targetSize,
+                                             validSize};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_reduceLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(cmd, m_reduceLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(ReducePushConstants), &pushConstants);
+    vkCmdDispatch(cmd, (targetSize.x + ReduceGroupSize - 1) / ReduceGroupSize,
+                  (targetSize.y + ReduceGroupSize - 1) / ReduceGroupSize, 1);
+
+    // the next level and the cull pass read what was just written
+    vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    sourceSize = targetSize;
+    validSize = targetSize;
+  }
+}
@@ -20,12 +20,14 @@
 #include <platform/vulkan/types_vk.hpp>
 
 #include "core/fileio.hpp"
+#include "core/task_graph.hpp"
 #include "external/imgui_impl.hpp"
 #include "platform/vulkan/imgui_impl_vk.hpp"
 
 #include "platform/vulkan/loader_vk.hpp"
 
 #include "platform/vulkan/pipelines_vk.hpp"
+#include "platform/vulkan/render_thread_vk.hpp"
 
 #include "utility/logger.hpp"
 
@@ -43,6 +45,8 @@ bool stop_rendering {false};
 VkFence _immFence;
 VkCommandBuffer _immCommandBuffer;
 VkCommandPool _immCommandPool;
+// the structures above are shared by every thread uploading data
+std::mutex _immSubmitMutex;
 
 void init_swapchain(glm::uvec2 windowSize);
 void init_commands();
@@ -99,12 +103,22 @@ void Device::Initialize()
                                static_cast<i32>(m_windowSize.y), windowFlags);
 
   InitVulkan(m_pWindow, m_bValidationLayer);
-  init_swapchain(m_windowSize);
-  init_commands();
-  init_sync_structures();
 
-  external::ImGuiInitialize();
+  // everything below only needs the device
+  jobs::TaskGraph startup("Device startup");
+  startup.Add("Swapchain",
+              [this]()
+              {
+                init_swapchain(m_windowSize);
+              });
+  startup.Add("Command pools", init_commands);
+  startup.Add("Sync structures", init_sync_structures);
+  startup.Add("ImGui context", external::ImGuiInitialize);
+  startup.Run(Engine::Instance().GetJobs());
+
+  // SDL wants the window to be touched from the main thread only
   external::ImGuiInitializeVulkan(m_pWindow);
+  startup.LogReport();
 }
 
 void Device::DestroyBackend()
@@ -278,7 +292,8 @@ MaterialInstance GLTFMetallic_Roughness::write_material(
 
   matData.materialSet = descriptorAllocator.allocate(device, materialLayout);
 
-  writer.clear();
+  // local so that materials can be written from several loading threads
+  DescriptorWriter writer;
   writer.write_buffer(0, resources.dataBuffer, sizeof(MaterialConstants),
                       resources.dataBufferOffset,
                       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
@@ -328,6 +343,12 @@ void internal::InitVulkan(SDL_Window* window, bool debug)
       .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
   features12.bufferDeviceAddress = true;
   features12.descriptorIndexing = true;
+  features12.drawIndirectCount = true;
+
+  // vulkan 1.0 features
+  VkPhysicalDeviceFeatures features10 {};
+  features10.multiDrawIndirect = true;
+  features10.drawIndirectFirstInstance = true;
 
   // use vkbootstrap to select a gpu.
   // We want a gpu that can write to the SDL surface and supports vulkan 1.3
@@ -336,10 +357,20 @@ void internal::InitVulkan(SDL_Window* window, bool debug)
   vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 3)
                                            .set_required_features_13(features)
                                            .set_required_features_12(features12)
+                                           .set_required_features(features10)
                                            .set_surface(_surface)
                                            .select()
                                            .value();
 
+  // optional, the meshlets are drawn with indirect draws without it
+  VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT};
+  meshShaderFeatures.meshShader = true;
+  _bMeshShaders =
+      physicalDevice.enable_extension_if_present(
+          VK_EXT_MESH_SHADER_EXTENSION_NAME) &&
+      physicalDevice.enable_extension_features_if_present(meshShaderFeatures);
+
   // create the final vulkan device
   vkb::DeviceBuilder deviceBuilder {physicalDevice};
 
@@ -354,6 +385,7 @@ void internal::InitVulkan(SDL_Window* window, bool debug)
   {
     log::Info("Vulkan debug output enabled.");
   }
+  log::Info("Mesh shaders: {}", _bMeshShaders ? "supported" : "unsupported");
   // Get the VkDevice handle used in the rest of a vulkan application
   _device = vkbDevice.device;
 
@@ -446,6 +478,7 @@ void internal::init_commands()
 void internal::immediate_submit(
     std::function<void(VkCommandBuffer cmd)>&& function)
 {
+  std::scoped_lock immediateLock(_immSubmitMutex);
   VK_CHECK(vkResetFences(_device, 1, &_immFence));
   VK_CHECK(vkResetCommandBuffer(_immCommandBuffer, 0));
 
@@ -465,7 +498,10 @@ void internal::immediate_submit(
 
   // submit command buffer to the queue and execute it.
   //  _renderFence will now block until the graphic commands finish execution
-  VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, _immFence));
+  {
+    std::scoped_lock queueLock(_graphicsQueueMutex);
+    VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, _immFence));
+  }
 
   VK_CHECK(vkWaitForFences(_device, 1, &_immFence, true, 9999999999));
 }
@@ -503,6 +539,8 @@ void internal::init_sync_structures()
 
 void hm::Device::ResizeSwapchain()
 {
+  // the render thread may still be using the old swapchain
+  _renderThread.Flush();
   vkDeviceWaitIdle(_device);
 
   destroy_swapchain();
@@ -622,6 +660,8 @@ void internal::init_swapchain(glm::uvec2 windowSize)
   _depthImage.imageExtent = drawImageExtent;
   VkImageUsageFlags depthImageUsages {};
   depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  // read to build the depth pyramid
+  depthImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
   VkImageCreateInfo dimg_info = vkinit::image_create_info(
       _depthImage.imageFormat, depthImageUsages, drawImageExtent);
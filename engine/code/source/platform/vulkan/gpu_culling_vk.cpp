@@ -0,0 +1,454 @@
+#include "platform/vulkan/gpu_culling_vk.hpp"
+
+#include "volk.h"
+#include "core/fileio.hpp"
+#include "external/tracy_impl.hpp"
+#include "platform/vulkan/descriptors_vk.hpp"
+#include "platform/vulkan/initializers_vk.hpp"
+#include "platform/vulkan/pipelines_vk.hpp"
+#include "utility/logger.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace hm;
+
+namespace
+{
+VkPipeline create_cull_pipeline(const char* shaderPath, VkPipelineLayout layout)
+{
+  VkShaderModule cullShader;
+  if (!vkutil::load_shader_module(io::GetPath(shaderPath).c_str(), _device,
+                                  &cullShader))
+  {
+    log::Error("Error when building the cull shader {}", shaderPath);
+  }
+
+  VkPipelineShaderStageCreateInfo stageInfo {};
+  stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  stageInfo.module = cullShader;
+  stageInfo.pName = "main";
+
+  VkComputePipelineCreateInfo pipelineInfo {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = layout;
+  pipelineInfo.stage = stageInfo;
+  VkPipeline pipeline;
+  VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo,
+                                    nullptr, &pipeline));
+  vkDestroyShaderModule(_device, cullShader, nullptr);
+  return pipeline;
+}
+
+// dispatch command of the meshlet cull, padded to 16 bytes
+constexpr size_t TaskHeaderSize {16};
+} // namespace
+
+void GPUCulling::Init()
+{
+  DescriptorLayoutBuilder builder;
+  builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_cullSetLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+  VkPushConstantRange pushConstant {};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(CullPushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo =
+      vkinit::pipeline_layout_create_info();
+  layoutInfo.pSetLayouts = &m_cullSetLayout;
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstant;
+  layoutInfo.pushConstantRangeCount = 1;
+  VK_CHECK(
+      vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &m_cullLayout));
+
+  m_cullPipeline =
+      create_cull_pipeline("shaders/object_cull.comp.vk.spv", m_cullLayout);
+  m_meshletCullPipeline =
+      create_cull_pipeline("shaders/meshlet_cull.comp.vk.spv", m_cullLayout);
+
+  _mainDeletionQueue.push_function(
+      [this]()
+      {
+        vkDestroyPipeline(_device, m_cullPipeline, nullptr);
+        vkDestroyPipeline(_device, m_meshletCullPipeline, nullptr);
+        vkDestroyPipelineLayout(_device, m_cullLayout, nullptr);
+        vkDestroyDescriptorSetLayout(_device, m_cullSetLayout, nullptr);
+        if (m_commandCapacity != 0)
+        {
+          destroy_buffer(m_commands);
+          destroy_buffer(m_instances);
+        }
+        if (m_bucketCapacity != 0)
+        {
+          destroy_buffer(m_counts);
+          destroy_buffer(m_meshTasks);
+        }
+        if (m_taskCapacity != 0)
+        {
+          destroy_buffer(m_tasks);
+        }
+        if (m_meshletDrawCapacity != 0)
+        {
+          destroy_buffer(m_meshletDraws);
+        }
+        if (m_visibilityCapacity != 0)
+        {
+          destroy_buffer(m_visibility);
+        }
+        m_cullData.Destroy();
+        m_commandCapacity = 0;
+        m_bucketCapacity = 0;
+        m_visibilityCapacity = 0;
+        m_taskCapacity = 0;
+        m_meshletDrawCapacity = 0;
+      });
+}
+
+void GPUCulling::Prepare(VkCommandBuffer cmd, const GPUObjectBuffer& objects,
+                         std::span<const RenderObjectId> candidates,
+                         const culling::Frustum& frustum,
+                         const glm::mat4& viewProj,
+                         const glm::vec3& cameraPosition,
+                         const DepthPyramid& pyramid, MeshletMode meshletMode,
+                         const gpx::LodSettings& lodSettings)
+{
+  HM_ZONE_SCOPED_N("GPUCulling::Prepare");
+  const std::span<const GPUObjectBuffer::DrawBucket> buckets =
+      objects.GetDrawBuckets();
+  const u32 bucketCount = static_cast<u32>(buckets.size());
+
+  // recorded by pipeline and material, like the sorted CPU draws. Every
+  // object is a command at most, or with indexed meshlets every meshlet.
+  m_meshletMode = meshletMode;
+  m_draws.clear();
+  for (u32 bucket = 0; bucket < bucketCount; bucket++)
+  {
+    const GPUObjectBuffer::DrawBucket& drawBucket = buckets[bucket];
+    if (drawBucket.objectCount == 0)
+    {
+      continue;
+    }
+    BucketDraw draw {.bucket = bucket, .maxCount = drawBucket.objectCount};
+    if (meshletMode == MeshletMode::Indexed)
+    {
+      draw.maxCount += drawBucket.meshletCount;
+    }
+    else if (meshletMode == MeshletMode::MeshShader)
+    {
+      draw.maxMeshletDraws = drawBucket.meshletCount;
+    }
+    m_draws.push_back(draw);
+  }
+  std::ranges::sort(m_draws,
+                    [&](const BucketDraw& a, const BucketDraw& b)
+                    {
+                      const MaterialInstance* first =
+                          buckets[a.bucket].material;
+                      const MaterialInstance* second =
+                          buckets[b.bucket].material;
+                      if (first->pipeline->sortId != second->pipeline->sortId)
+                      {
+                        return first->pipeline->sortId <
+                               second->pipeline->sortId;
+                      }
+                      if (first->sortId != second->sortId)
+                      {
+                        return first->sortId < second->sortId;
+                      }
+                      return a.bucket < b.bucket;
+                    });
+
+  m_firstDraws.assign(bucketCount * 2, 0);
+  m_commandCount = 0;
+  m_meshletDrawCount = 0;
+  for (BucketDraw& draw : m_draws)
+  {
+    draw.firstCommand = m_commandCount;
+    draw.firstMeshletDraw = m_meshletDrawCount;
+    m_firstDraws[draw.bucket] = m_commandCount;
+    m_firstDraws[bucketCount + draw.bucket] = m_meshletDrawCount;
+    m_commandCount += draw.maxCount;
+    m_meshletDrawCount += draw.maxMeshletDraws;
+  }
+  HM_ZONE_VALUE(static_cast<int64_t>(m_commandCount));
+  m_objectCount = objects.GetObjectLimit();
+  m_candidateCount = static_cast<u32>(candidates.size());
+  m_objectsAddress = objects.GetAddress();
+  ReserveVisibility(cmd, m_objectCount);
+  if (m_commandCount == 0)
+  {
+    return;
+  }
+  Reserve(m_commandCount, bucketCount);
+  if (meshletMode != MeshletMode::Off)
+  {
+    ReserveMeshlets(m_objectCount, m_meshletDrawCount);
+  }
+
+  const size_t firstDrawsSize = m_firstDraws.size() * sizeof(u32);
+  const size_t candidatesSize = candidates.size_bytes();
+  const PerFrameBuffer::Mapping cullData =
+      m_cullData.Map(sizeof(CullData) + firstDrawsSize + candidatesSize);
+  const VkExtent2D pyramidExtent = pyramid.GetExtent();
+  CullData header {};
+  header.planes = frustum.planes;
+  header.viewProj = viewProj;
+  header.cameraPosition = glm::vec4(cameraPosition, 1.f);
+  header.pyramidSize = {pyramidExtent.width, pyramidExtent.height};
+  header.candidateCount = m_candidateCount;
+  header.pyramidLevels = pyramid.GetLevelCount();
+  header.bucketCount = bucketCount;
+  header.meshletMode = meshletMode;
+  header.pixelsPerUnit = lodSettings.pixelsPerUnit;
+  header.lodErrorPixels = lodSettings.errorPixels;
+  header.minPixelSize = lodSettings.minPixelSize;
+  std::memcpy(cullData.data, &header, sizeof(CullData));
+  std::memcpy(cullData.data + sizeof(CullData), m_firstDraws.data(),
+              firstDrawsSize);
+  std::memcpy(cullData.data + sizeof(CullData) + firstDrawsSize,
+              candidates.data(), candidatesSize);
+  m_cullDataAddress = cullData.address;
+}
+
+void GPUCulling::Cull(VkCommandBuffer cmd, Pass pass,
+                      const DepthPyramid& pyramid)
+{
+  HM_ZONE_SCOPED_N("GPUCulling::Cull");
+  if (m_commandCount == 0)
+  {
+    return;
+  }
+
+  // the draws before read what is written now, the visibility flags of the
+  // last late pass are read
+  vkutil::memory_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | vkutil::draw_shader_stages() |
+          VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+          VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+  const size_t bucketCount = m_firstDraws.size() / 2;
+  vkCmdFillBuffer(cmd, m_counts.buffer, 0, bucketCount * sizeof(u32), 0);
+  // the dispatch and the mesh task draws are all zeros until something is
+  // appended to them
+  if (m_meshletMode != MeshletMode::Off)
+  {
+    vkCmdFillBuffer(cmd, m_tasks.buffer, 0, TaskHeaderSize, 0);
+  }
+  if (m_meshletMode == MeshletMode::MeshShader)
+  {
+    vkCmdFillBuffer(cmd, m_meshTasks.buffer, 0,
+                    bucketCount * sizeof(VkDrawMeshTasksIndirectCommandEXT),
+                    0);
+  }
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                         VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                             VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  VkDescriptorSet set = get_current_frame()._frameDescriptors.allocate(
+      _device, m_cullSetLayout);
+  DescriptorWriter writer;
+  writer.write_image(0, pyramid.GetView(), _defaultSamplerNearest,
+                     VK_IMAGE_LAYOUT_GENERAL,
+                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  writer.update_set(_device, set);
+
+  const CullPushConstants pushConstants {
+      .objects = m_objectsAddress,
+      .cullData = m_cullDataAddress,
+      .commands = m_commandsAddress,
+      .counts = m_countsAddress,
+      .instances = m_instancesAddress,
+      .visibility = m_visibilityAddress,
+      .tasks = m_tasksAddress,
+      .meshletDraws = m_meshletDrawsAddress,
+      .meshTasks = m_meshTasksAddress,
+      .pass = pass,
+      .pad = 0};
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0,
+                          1, &set, 0, nullptr);
+  vkCmdPushConstants(cmd, m_cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(CullPushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (m_candidateCount + CullGroupSize - 1) / CullGroupSize,
+                1, 1);
+
+  if (m_meshletMode != MeshletMode::Off)
+  {
+    // a workgroup per object the first dispatch handed over, with the same
+    // layout the set and the push constants stay
+    vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                           VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                               VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                               VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      m_meshletCullPipeline);
+    vkCmdDispatchIndirect(cmd, m_tasks.buffer, 0);
+  }
+
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                             vkutil::draw_shader_stages(),
+                         VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                             VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+}
+
+void GPUCulling::Reserve(u32 commandCount, u32 bucketCount)
+{
+  // the frame still in flight can be using the old buffers
+  internal::DeletionQueue& deletionQueue =
+      internal::get_current_frame()._deletionQueue;
+  if (commandCount > m_commandCapacity)
+  {
+    if (m_commandCapacity != 0)
+    {
+      const AllocatedBuffer commands = m_commands;
+      const AllocatedBuffer instances = m_instances;
+      deletionQueue.push_function(
+          [commands, instances]()
+          {
+            destroy_buffer(commands);
+            destroy_buffer(instances);
+          });
+    }
+    m_commandCapacity = std::bit_ceil(commandCount);
+    m_commands = create_buffer(
+        m_commandCapacity * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_instances = create_buffer(m_commandCapacity * sizeof(RenderObjectId),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                VMA_MEMORY_USAGE_GPU_ONLY);
+    m_commandsAddress = vkutil::get_buffer_address(_device, m_commands.buffer);
+    m_instancesAddress =
+        vkutil::get_buffer_address(_device, m_instances.buffer);
+  }
+  if (bucketCount > m_bucketCapacity)
+  {
+    if (m_bucketCapacity != 0)
+    {
+      const AllocatedBuffer counts = m_counts;
+      const AllocatedBuffer meshTasks = m_meshTasks;
+      deletionQueue.push_function(
+          [counts, meshTasks]()
+          {
+            destroy_buffer(counts);
+            destroy_buffer(meshTasks);
+          });
+    }
+    m_bucketCapacity = std::bit_ceil(bucketCount);
+    m_counts = create_buffer(m_bucketCapacity * sizeof(u32),
+                             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                             VMA_MEMORY_USAGE_GPU_ONLY);
+    m_countsAddress = vkutil::get_buffer_address(_device, m_counts.buffer);
+    m_meshTasks = create_buffer(
+        m_bucketCapacity * sizeof(VkDrawMeshTasksIndirectCommandEXT),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_meshTasksAddress =
+        vkutil::get_buffer_address(_device, m_meshTasks.buffer);
+  }
+}
+
+void GPUCulling::ReserveMeshlets(u32 objectCount, u32 meshletDrawCount)
+{
+  internal::DeletionQueue& deletionQueue =
+      internal::get_current_frame()._deletionQueue;
+  if (objectCount > m_taskCapacity)
+  {
+    if (m_taskCapacity != 0)
+    {
+      const AllocatedBuffer tasks = m_tasks;
+      deletionQueue.push_function(
+          [tasks]()
+          {
+            destroy_buffer(tasks);
+          });
+    }
+    m_taskCapacity = std::bit_ceil(objectCount);
+    m_tasks = create_buffer(TaskHeaderSize + m_taskCapacity * sizeof(u32),
+                            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                            VMA_MEMORY_USAGE_GPU_ONLY);
+    m_tasksAddress = vkutil::get_buffer_address(_device, m_tasks.buffer);
+  }
+  // an object id and a meshlet index per draw
+  if (meshletDrawCount > m_meshletDrawCapacity)
+  {
+    if (m_meshletDrawCapacity != 0)
+    {
+      const AllocatedBuffer meshletDraws = m_meshletDraws;
+      deletionQueue.push_function(
+          [meshletDraws]()
+          {
+            destroy_buffer(meshletDraws);
+          });
+    }
+    m_meshletDrawCapacity = std::bit_ceil(meshletDrawCount);
+    m_meshletDraws = create_buffer(
+        m_meshletDrawCapacity * sizeof(glm::uvec2),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_meshletDrawsAddress =
+        vkutil::get_buffer_address(_device, m_meshletDraws.buffer);
+  }
+}
+
+void GPUCulling::ReserveVisibility(VkCommandBuffer cmd, u32 objectCount)
+{
+  if (objectCount <= m_visibilityCapacity)
+  {
+    return;
+  }
+  // everything is drawn by the late pass once, then the flags are right again
+  if (m_visibilityCapacity != 0)
+  {
+    const AllocatedBuffer visibility = m_visibility;
+    internal::get_current_frame()._deletionQueue.push_function(
+        [visibility]()
+        {
+          destroy_buffer(visibility);
+        });
+  }
+  m_visibilityCapacity = std::bit_ceil(objectCount);
+  m_visibility = create_buffer(m_visibilityCapacity * sizeof(u32),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                               VMA_MEMORY_USAGE_GPU_ONLY);
+  m_visibilityAddress =
+      vkutil::get_buffer_address(_device, m_visibility.buffer);
+  vkCmdFillBuffer(cmd, m_visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                         VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                             VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
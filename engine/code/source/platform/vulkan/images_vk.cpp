@@ -20,8 +20,13 @@ void vkutil::transition_image(VkCommandBuffer cmd, VkImage image,
   imageBarrier.oldLayout = currentLayout;
   imageBarrier.newLayout = newLayout;
 
+  auto is_depth_layout = [](VkImageLayout layout)
+  {
+    return layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+           layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+  };
   VkImageAspectFlags aspectMask =
-      (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
+      (is_depth_layout(currentLayout) || is_depth_layout(newLayout))
           ? VK_IMAGE_ASPECT_DEPTH_BIT
           : VK_IMAGE_ASPECT_COLOR_BIT;
   imageBarrier.subresourceRange = vkinit::image_subresource_range(aspectMask);
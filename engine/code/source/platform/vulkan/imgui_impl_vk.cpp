@@ -71,7 +71,8 @@ ImGui_ImplVulkan_InitInfo CreateImGuiVulkanInitInfo()
   return init_info;
 }
 
-void RenderVulkanImGui(VkCommandBuffer cmd, VkImageView targetImageView)
+void RenderVulkanImGui(VkCommandBuffer cmd, VkImageView targetImageView,
+                       ImDrawData* drawData)
 {
   VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
       targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -80,7 +81,7 @@ void RenderVulkanImGui(VkCommandBuffer cmd, VkImageView targetImageView)
 
   vkCmdBeginRendering(cmd, &renderInfo);
 
-  ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+  ImGui_ImplVulkan_RenderDrawData(drawData, cmd);
 
   vkCmdEndRendering(cmd);
 }
@@ -112,9 +113,8 @@ void external::ImGuiCleanUp()
   ImGui::DestroyContext();
 }
 
+// only finishes the frame, the renderer records the draw data itself
 void external::ImGuiEndFrame()
 {
   ImGui::Render();
-  internal::RenderVulkanImGui(internal::get_current_frame()._mainCommandBuffer,
-                              _swapchainImageViews[swapchainImageIndex]);
 }
@@ -0,0 +1,104 @@
+#include "platform/vulkan/indirect_draws_vk.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace hm;
+
+void IndirectDrawList::Clear()
+{
+  m_draws.clear();
+  m_batches.clear();
+  m_commands.clear();
+  m_instances.clear();
+  m_triangleCount = 0;
+}
+
+void IndirectDrawList::Add(const RenderObject& object, RenderObjectId id,
+                           u32 lod)
+{
+  const u32 index = static_cast<u32>(m_draws.size());
+  if (m_batches.empty() || m_batches.back().material != object.material ||
+      m_batches.back().indexBuffer != object.indexBuffer)
+  {
+    m_batches.push_back({object.material, object.indexBuffer, index, 0});
+  }
+  m_batches.back().count++;
+  // the levels are ranges of the same index buffer, the batch stays
+  const bool bLod = lod != 0 && lod < object.lodCount;
+  const u32 firstIndex = bLod ? object.lods[lod].firstIndex : object.firstIndex;
+  const u32 indexCount = bLod ? object.lods[lod].indexCount : object.indexCount;
+  m_draws.push_back({firstIndex, indexCount, id});
+  m_triangleCount += indexCount / 3;
+}
+
+IndirectDrawList::Buffers IndirectDrawList::Upload()
+{
+  HM_ZONE_SCOPED_N("IndirectDrawList::Upload");
+  BuildCommands();
+  if (m_commands.empty())
+  {
+    return {};
+  }
+
+  // commands first, the instances after them on a 16 byte boundary
+  const size_t commandsSize =
+      (m_commands.size() * sizeof(VkDrawIndexedIndirectCommand) + 15) &
+      ~size_t {15};
+  const size_t instancesSize = m_instances.size() * sizeof(RenderObjectId);
+  const PerFrameBuffer::Mapping mapping =
+      m_buffer.Map(commandsSize + instancesSize);
+  std::memcpy(mapping.data, m_commands.data(),
+              m_commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+  std::memcpy(mapping.data + commandsSize, m_instances.data(), instancesSize);
+  return {mapping.buffer, mapping.address + commandsSize};
+}
+
+void IndirectDrawList::BuildCommands()
+{
+  HM_ZONE_SCOPED_N("IndirectDrawList::BuildCommands");
+  m_commands.clear();
+  m_instances.clear();
+  for (IndirectBatch& batch : m_batches)
+  {
+    const auto first = m_draws.begin() + batch.first;
+    const auto last = first + batch.count;
+    if (m_bInstancing)
+    {
+      // stable, the instances of a surface keep their front to back order
+      std::stable_sort(first, last,
+                       [](const Draw& a, const Draw& b)
+                       {
+                         return a.firstIndex != b.firstIndex
+                                    ? a.firstIndex < b.firstIndex
+                                    : a.indexCount < b.indexCount;
+                       });
+    }
+
+    batch.first = static_cast<u32>(m_commands.size());
+    for (auto draw = first; draw != last; draw++)
+    {
+      const bool bSameSurface =
+          m_bInstancing && m_commands.size() > batch.first &&
+          m_commands.back().firstIndex == draw->firstIndex &&
+          m_commands.back().indexCount == draw->indexCount;
+      if (bSameSurface)
+      {
+        m_commands.back().instanceCount++;
+      }
+      else
+      {
+        VkDrawIndexedIndirectCommand& command = m_commands.emplace_back();
+        command.indexCount = draw->indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = draw->firstIndex;
+        command.vertexOffset = 0;
+        command.firstInstance = static_cast<u32>(m_instances.size());
+      }
+      m_instances.push_back(draw->id);
+    }
+    batch.count = static_cast<u32>(m_commands.size()) - batch.first;
+  }
+}
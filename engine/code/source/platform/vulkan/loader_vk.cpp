@@ -9,10 +9,17 @@
 #include <stb_image.h>
 #include <volk.h>
 #include "platform/vulkan/device_vk.hpp"
+#include "engine.hpp"
+#include "core/bvh.hpp"
+#include "core/jobs.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
 using namespace tinygltf;
 using namespace hm;
 inline void ReadComponent(const unsigned char* ptr, int type, int c, bool norm,
@@ -39,18 +46,21 @@ inline void ReadComponent(const unsigned char* ptr, int type, int c, bool norm,
       break;
   }
 }
-std::optional<AllocatedImage> load_image(const tinygltf::Model& model,
-                                         const tinygltf::Image& image)
+// tinygltf decodes every image while parsing unless told otherwise, which
+// happens on a single thread and also for files we only want meshes from
+bool skip_image_decoding(Image*, const int, std::string*, std::string*, int,
+                         int, const unsigned char*, int, void*)
 {
-  AllocatedImage newImage {};
-  int width = 0, height = 0, channels = 0;
+  return true;
+}
 
-  auto upload_image = [&](unsigned char* pixels)
-  {
-    VkExtent3D imagesize {(uint32_t)width, (uint32_t)height, 1};
-    newImage = create_image(pixels, imagesize, VK_FORMAT_R8G8B8A8_UNORM,
-                            VK_IMAGE_USAGE_SAMPLED_BIT, true);
-  };
+DecodedImage decode_image(const tinygltf::Model& model,
+                          const tinygltf::Image& image,
+                          const std::filesystem::path& directory)
+{
+  HM_ZONE_SCOPED;
+  DecodedImage decoded {};
+  int width = 0, height = 0, channels = 0;
 
   if (image.uri.empty())
   {
@@ -60,19 +70,14 @@ std::optional<AllocatedImage> load_image(const tinygltf::Model& model,
       const auto& buffer = model.buffers[view.buffer];
       const unsigned char* ptr = buffer.data.data() + view.byteOffset;
 
-      unsigned char* data =
+      decoded.pixels.reset(
           stbi_load_from_memory(ptr, static_cast<int>(view.byteLength), &width,
-                                &height, &channels, 4);
-      if (data)
-      {
-        upload_image(data);
-        stbi_image_free(data);
-      }
+                                &height, &channels, 4));
     }
   }
   else
   {
-    std::string path = image.uri;
+    std::filesystem::path path = directory / image.uri;
 
     // Load file into memory
     std::ifstream file(path, std::ios::binary | std::ios::ate);
@@ -83,18 +88,29 @@ std::optional<AllocatedImage> load_image(const tinygltf::Model& model,
       std::vector<unsigned char> buffer(size);
       if (file.read(reinterpret_cast<char*>(buffer.data()), size))
       {
-        unsigned char* data = stbi_load_from_memory(
+        decoded.pixels.reset(stbi_load_from_memory(
             buffer.data(), static_cast<int>(buffer.size()), &width, &height,
-            &channels, 4);
-        if (data)
-        {
-          upload_image(data);
-          stbi_image_free(data);
-        }
+            &channels, 4));
       }
     }
   }
 
+  decoded.width = static_cast<u32>(width);
+  decoded.height = static_cast<u32>(height);
+  return decoded;
+}
+
+std::optional<AllocatedImage> upload_image(const DecodedImage& decoded)
+{
+  if (decoded.pixels == nullptr)
+  {
+    return {};
+  }
+  VkExtent3D imagesize {decoded.width, decoded.height, 1};
+  AllocatedImage newImage =
+      create_image(decoded.pixels.get(), imagesize, VK_FORMAT_R8G8B8A8_UNORM,
+                   VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
   if (newImage.image == VK_NULL_HANDLE)
     return {};
   return newImage;
@@ -133,7 +149,48 @@ VkSamplerMipmapMode extract_mipmap_mode(int32_t filter)
     default:
       return VK_SAMPLER_MIPMAP_MODE_LINEAR;
   }
-} // TODO this is super slow for now
+}
+
+// Splits every surface of the mesh into meshlets, reordering the triangles
+// inside of its index range, and appends its levels of detail to the indices
+// before uploading it all
+GPUMeshBuffers upload_mesh(MeshAsset& mesh, std::vector<uint32_t>& indices,
+                           std::vector<Vertex>& vertices)
+{
+  HM_ZONE_SCOPED;
+  std::vector<glm::vec3> positions(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    positions[i] = vertices[i].position;
+  }
+  gpx::MeshletSet meshlets;
+  mesh.lods.clear();
+  for (GeoSurface& surface : mesh.surfaces)
+  {
+    surface.firstMeshlet = static_cast<uint32_t>(meshlets.meshlets.size());
+    surface.meshletCount = gpx::BuildMeshlets(
+        std::span(indices).subspan(surface.startIndex, surface.count),
+        surface.startIndex, positions, meshlets);
+    // the back faces are drawn, so no direction hides the whole meshlet
+    if (surface.bDoubleSided)
+    {
+      for (uint32_t i = 0; i < surface.meshletCount; i++)
+      {
+        meshlets.meshlets[surface.firstMeshlet + i].coneCutoff = 1.f;
+      }
+    }
+  }
+  // the levels go behind all the surfaces, the meshlets index the full ones
+  for (GeoSurface& surface : mesh.surfaces)
+  {
+    surface.firstLod = static_cast<uint32_t>(mesh.lods.size());
+    surface.lodCount = gpx::BuildLods(indices, surface.startIndex,
+                                      surface.count, positions, mesh.lods);
+  }
+  return UploadMesh(indices, vertices, meshlets, mesh.lods);
+}
+
+// TODO this is super slow for now
 std::optional<std::vector<std::shared_ptr<hm::MeshAsset>>> hm::loadGltfMeshes(
     const std::filesystem::path& filePath)
 {
@@ -144,6 +201,8 @@ std::optional<std::vector<std::shared_ptr<hm::MeshAsset>>> hm::loadGltfMeshes(
 
   Model model;
   TinyGLTF loader;
+  // only the meshes are used
+  loader.SetImageLoader(skip_image_decoding, nullptr);
   std::string err;
   std::string warn;
 
@@ -211,6 +270,9 @@ std::optional<std::vector<std::shared_ptr<hm::MeshAsset>>> hm::loadGltfMeshes(
       newSurface.startIndex = static_cast<uint32_t>(indices.size());
       newSurface.count =
           static_cast<uint32_t>(model.accessors[primitive.indices].count);
+      newSurface.bDoubleSided =
+          primitive.material >= 0 &&
+          model.materials[primitive.material].doubleSided;
 
       size_t initialVtx = vertices.size();
 
@@ -369,7 +431,7 @@ std::optional<std::vector<std::shared_ptr<hm::MeshAsset>>> hm::loadGltfMeshes(
     {
       HM_ZONE_SCOPED_N("Upload Mesh");
       auto uploadStart = std::chrono::high_resolution_clock::now();
-      meshAsset.meshBuffers = UploadMesh(indices, vertices);
+      meshAsset.meshBuffers = upload_mesh(meshAsset, indices, vertices);
       auto uploadEnd = std::chrono::high_resolution_clock::now();
       auto uploadDuration =
           std::chrono::duration_cast<std::chrono::microseconds>(uploadEnd -
@@ -405,43 +467,102 @@ std::optional<std::vector<std::shared_ptr<hm::MeshAsset>>> hm::loadGltfMeshes(
   return meshes;
 }
 
-void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx)
+namespace
 {
-  glm::mat4 nodeMatrix = topMatrix * worldTransform;
+// 0 means unassigned
+std::atomic<uint32_t> nextMeshSortId {1};
+std::atomic<uint32_t> nextMaterialSortId {1};
+} // namespace
 
-  for (auto& s : mesh->surfaces)
+void hm::assignSortIds(MeshAsset& mesh)
+{
+  if (mesh.meshBuffers.sortId == 0)
+  {
+    mesh.meshBuffers.sortId = nextMeshSortId++;
+  }
+  for (GeoSurface& s : mesh.surfaces)
   {
-    RenderObject def;
-    def.indexCount = s.count;
-    def.firstIndex = s.startIndex;
-    def.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
-    def.material = &s.material->data;
-    def.bounds = s.bounds;
-    def.transform = nodeMatrix;
-    def.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+    assignSortId(s.material->data);
+  }
+}
 
-    if (s.material->data.passType == MaterialPass::Transparent)
-    {
-      ctx.TransparentSurfaces.push_back(def);
-    }
-    else
-    {
-      ctx.OpaqueSurfaces.push_back(def);
-    }
+void hm::assignSortId(MaterialInstance& material)
+{
+  if (material.sortId == 0)
+  {
+    material.sortId = nextMaterialSortId++;
+  }
+}
+
+RenderObject hm::makeRenderObject(const MeshAsset& mesh, const GeoSurface& s,
+                                  const glm::mat4& transform)
+{
+  RenderObject def;
+  def.indexCount = s.count;
+  def.firstIndex = s.startIndex;
+  def.indexBuffer = mesh.meshBuffers.indexBuffer.buffer;
+  def.material = &s.material->data;
+  def.meshId = mesh.meshBuffers.sortId;
+  def.bounds = s.bounds;
+  def.transform = transform;
+  def.vertexBufferAddress = mesh.meshBuffers.vertexBufferAddress;
+  def.occluder = s.occluder.get();
+  def.meshletBuffer = mesh.meshBuffers.meshletBufferAddress;
+  def.firstMeshlet = s.firstMeshlet;
+  def.meshletCount = s.meshletCount;
+  def.lods = mesh.lods.data() + s.firstLod;
+  def.lodCount = s.lodCount;
+  def.lodOffset = mesh.meshBuffers.lodOffset +
+                  s.firstLod * (sizeof(GPUMeshLod) / sizeof(uint32_t));
+  def.bDoubleSided = s.bDoubleSided;
+  return def;
+}
+
+void hm::drawSurface(const MeshAsset& mesh, const GeoSurface& s,
+                     const glm::mat4& transform, DrawContext& ctx)
+{
+  const RenderObject def = makeRenderObject(mesh, s, transform);
+  if (s.material->data.passType == MaterialPass::Transparent)
+  {
+    ctx.TransparentSurfaces.push_back(def);
+  }
+  else
+  {
+    ctx.OpaqueSurfaces.push_back(def);
+    ctx.OpaqueBounds.Add(transform, s.bounds.origin, s.bounds.sphereRadius,
+                         s.bounds.extents);
   }
+}
+
+void hm::drawMesh(const MeshAsset& mesh, const glm::mat4& transform,
+                  DrawContext& ctx)
+{
+  for (auto& s : mesh.surfaces)
+  {
+    drawSurface(mesh, s, transform, ctx);
+  }
+}
+
+void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx)
+{
+  drawMesh(*mesh, topMatrix * worldTransform, ctx);
 
   // recurse down
   Node::Draw(topMatrix, ctx);
 }
 
-// TODO only works for vulkan
-std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
-    VkDevice _device, const std::filesystem::path& filePath)
+std::optional<ParsedGLTF> hm::parseGltf(const std::filesystem::path& filePath)
 {
-  log::Info("Loading GLTF: {}", filePath.string());
+  HM_ZONE_SCOPED;
+  HM_ZONE_TEXT(filePath.string().c_str(), filePath.string().size());
+  log::Info("Parsing GLTF: {}", filePath.string());
 
-  Model model;
+  ParsedGLTF parsed;
+  parsed.path = filePath;
+  Model& model = parsed.model;
   TinyGLTF loader;
+  // decoded below, in parallel
+  loader.SetImageLoader(skip_image_decoding, nullptr);
   std::string err;
   std::string warn;
   bool res {false};
@@ -468,6 +589,249 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
     log::Error("Failed to parse GLTF file: {}", filePath.string());
     return {};
   }
+
+  parsed.images.resize(model.images.size());
+  const std::filesystem::path directory = filePath.parent_path();
+  Engine::Instance().GetJobs().ParallelFor(
+      static_cast<u32>(model.images.size()), 1,
+      [&](u32 begin, u32 end)
+      {
+        for (u32 i = begin; i < end; i++)
+        {
+          parsed.images[i] = decode_image(model, model.images[i], directory);
+        }
+      });
+  return parsed;
+}
+
+// vertices and indices of a mesh, kept on the CPU for static batching
+struct MeshGeometry
+{
+  std::vector<uint32_t> indices;
+  std::vector<Vertex> vertices;
+};
+
+// Gives every opaque surface of the mesh an occluder holding just the
+// vertices its triangles use
+void add_occluders(MeshAsset& mesh, const std::vector<uint32_t>& indices,
+                   const std::vector<Vertex>& vertices)
+{
+  std::vector<uint32_t> remap(vertices.size(), ~0u);
+  for (GeoSurface& surface : mesh.surfaces)
+  {
+    if (surface.material->data.passType == MaterialPass::Transparent)
+    {
+      continue;
+    }
+    std::shared_ptr<culling::OccluderMesh> occluder =
+        std::make_shared<culling::OccluderMesh>();
+    occluder->indices.reserve(surface.count);
+    const uint32_t end = surface.startIndex + surface.count;
+    for (uint32_t i = surface.startIndex; i < end; i++)
+    {
+      const uint32_t source = indices[i];
+      if (remap[source] == ~0u)
+      {
+        remap[source] = static_cast<uint32_t>(occluder->positions.size());
+        occluder->positions.push_back(vertices[source].position);
+      }
+      occluder->indices.push_back(remap[source]);
+    }
+    for (uint32_t i = surface.startIndex; i < end; i++)
+    {
+      remap[indices[i]] = ~0u;
+    }
+    surface.occluder = std::move(occluder);
+  }
+}
+
+// 10 bits per axis interleaved, for a position inside [0, 1]
+u32 morton_code(const glm::vec3& position)
+{
+  auto spread = [](u32 x)
+  {
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+  };
+  const glm::vec3 unit =
+      glm::clamp(position, glm::vec3(0.f), glm::vec3(1.f));
+  const glm::uvec3 cell = glm::uvec3(unit * 1023.f);
+  return (spread(cell.x) << 2) | (spread(cell.y) << 1) | spread(cell.z);
+}
+
+// Merges the surfaces of every mesh node into one mesh, per material, with
+// the world transforms of the nodes baked in. Surfaces are ordered along a
+// Morton curve so the clusters they are packed into stay compact.
+std::shared_ptr<MeshAsset> batch_static_meshes(
+    const std::vector<std::shared_ptr<MeshAsset>>& meshes,
+    const std::vector<MeshGeometry>& geometry,
+    const std::vector<std::shared_ptr<hm::Node>>& nodes,
+    const std::vector<std::shared_ptr<GLTFMaterial>>& materials,
+    u32 clusterTriangles, bool bOccluders)
+{
+  HM_ZONE_SCOPED;
+  struct Placed
+  {
+    const GeoSurface* surface;
+    const MeshGeometry* geometry;
+    glm::mat4 transform;
+    glm::vec3 center;
+    u32 code;
+  };
+
+  std::unordered_map<const MeshAsset*, u32> meshIndices;
+  size_t maxVertices = 0;
+  for (size_t i = 0; i < meshes.size(); i++)
+  {
+    meshIndices[meshes[i].get()] = static_cast<u32>(i);
+    maxVertices = std::max(maxVertices, geometry[i].vertices.size());
+  }
+  std::unordered_map<const GLTFMaterial*, u32> materialIndices;
+  for (size_t i = 0; i < materials.size(); i++)
+  {
+    materialIndices[materials[i].get()] = static_cast<u32>(i);
+  }
+
+  constexpr f32 Infinity = std::numeric_limits<f32>::max();
+  std::vector<std::vector<Placed>> byMaterial(materials.size());
+  culling::Aabb sceneBounds {glm::vec3(Infinity), glm::vec3(-Infinity)};
+  u32 surfaceCount = 0;
+  for (const std::shared_ptr<hm::Node>& node : nodes)
+  {
+    const auto* meshNode = dynamic_cast<const MeshNode*>(node.get());
+    if (meshNode == nullptr)
+    {
+      continue;
+    }
+    const MeshGeometry& meshGeometry =
+        geometry[meshIndices.at(meshNode->mesh.get())];
+    for (const GeoSurface& surface : meshNode->mesh->surfaces)
+    {
+      const glm::vec3 center = glm::vec3(
+          node->worldTransform * glm::vec4(surface.bounds.origin, 1.f));
+      byMaterial[materialIndices.at(surface.material.get())].push_back(
+          {&surface, &meshGeometry, node->worldTransform, center, 0});
+      sceneBounds.min = glm::min(sceneBounds.min, center);
+      sceneBounds.max = glm::max(sceneBounds.max, center);
+      surfaceCount++;
+    }
+  }
+
+  std::shared_ptr<MeshAsset> batch = std::make_shared<MeshAsset>();
+  batch->name = "static batch";
+  std::vector<uint32_t> indices;
+  std::vector<Vertex> vertices;
+  // position of a source vertex in the batch, for the surface being copied
+  std::vector<uint32_t> remap(maxVertices, ~0u);
+  std::vector<uint32_t> touched;
+  const glm::vec3 sceneSize =
+      glm::max(sceneBounds.max - sceneBounds.min, glm::vec3(1e-6f));
+
+  for (size_t material = 0; material < byMaterial.size(); material++)
+  {
+    std::vector<Placed>& placed = byMaterial[material];
+    for (Placed& p : placed)
+    {
+      p.code = morton_code((p.center - sceneBounds.min) / sceneSize);
+    }
+    std::ranges::sort(placed, {}, &Placed::code);
+
+    GeoSurface cluster {};
+    culling::Aabb clusterBounds {};
+    auto closeCluster = [&]()
+    {
+      if (cluster.count == 0)
+      {
+        return;
+      }
+      cluster.bounds.origin = (clusterBounds.max + clusterBounds.min) * 0.5f;
+      cluster.bounds.extents = (clusterBounds.max - clusterBounds.min) * 0.5f;
+      cluster.bounds.sphereRadius = glm::length(cluster.bounds.extents);
+      batch->surfaces.push_back(cluster);
+      cluster.count = 0;
+    };
+
+    for (const Placed& p : placed)
+    {
+      if (cluster.count != 0 &&
+          (cluster.count + p.surface->count) / 3 > clusterTriangles)
+      {
+        closeCluster();
+      }
+      if (cluster.count == 0)
+      {
+        cluster.startIndex = static_cast<uint32_t>(indices.size());
+        cluster.material = materials[material];
+        cluster.bDoubleSided = p.surface->bDoubleSided;
+        clusterBounds = {glm::vec3(Infinity), glm::vec3(-Infinity)};
+      }
+
+      const glm::mat3 normalMatrix =
+          glm::transpose(glm::inverse(glm::mat3(p.transform)));
+      const uint32_t end = p.surface->startIndex + p.surface->count;
+      for (uint32_t i = p.surface->startIndex; i < end; i++)
+      {
+        const uint32_t source = p.geometry->indices[i];
+        if (remap[source] == ~0u)
+        {
+          Vertex vertex = p.geometry->vertices[source];
+          vertex.position =
+              glm::vec3(p.transform * glm::vec4(vertex.position, 1.f));
+          const glm::vec3 normal = normalMatrix * vertex.normal;
+          vertex.normal = glm::length(normal) > 0.f ? glm::normalize(normal)
+                                                    : vertex.normal;
+          clusterBounds.min = glm::min(clusterBounds.min, vertex.position);
+          clusterBounds.max = glm::max(clusterBounds.max, vertex.position);
+          remap[source] = static_cast<uint32_t>(vertices.size());
+          vertices.push_back(vertex);
+          touched.push_back(source);
+        }
+        indices.push_back(remap[source]);
+      }
+      cluster.count += p.surface->count;
+
+      for (const uint32_t source : touched)
+      {
+        remap[source] = ~0u;
+      }
+      touched.clear();
+    }
+    closeCluster();
+  }
+
+  log::Info("Static batching: {} surfaces into {} clusters, {} vertices",
+            surfaceCount, batch->surfaces.size(), vertices.size());
+  batch->meshBuffers = upload_mesh(*batch, indices, vertices);
+  if (bOccluders)
+  {
+    add_occluders(*batch, indices, vertices);
+  }
+  return batch;
+}
+
+// TODO only works for vulkan
+std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
+    VkDevice _device, const std::filesystem::path& filePath,
+    const LoadOptions& options)
+{
+  std::optional<ParsedGLTF> parsed = parseGltf(filePath);
+  if (parsed.has_value() == false)
+  {
+    return {};
+  }
+  return loadGltf(_device, *parsed, options);
+}
+
+std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
+    VkDevice _device, const ParsedGLTF& parsed, const LoadOptions& options)
+{
+  HM_ZONE_SCOPED;
+  log::Info("Loading GLTF: {}", parsed.path.string());
+  const Model& model = parsed.model;
+
   std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
@@ -502,9 +866,10 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
   std::vector<std::shared_ptr<GLTFMaterial>> materials;
 
   // load all textures
-  for (auto& image : model.images)
+  for (size_t i = 0; i < model.images.size(); i++)
   {
-    std::optional<AllocatedImage> img = load_image(model, image);
+    const tinygltf::Image& image = model.images[i];
+    std::optional<AllocatedImage> img = upload_image(parsed.images[i]);
 
     if (img.has_value())
     {
@@ -587,6 +952,8 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
 
   std::vector<uint32_t> indices;
   std::vector<Vertex> vertices;
+  // batched meshes are uploaded once they are merged
+  std::vector<MeshGeometry> geometry;
   for (auto& mesh : model.meshes)
   {
     std::shared_ptr<MeshAsset> newmesh = std::make_shared<MeshAsset>();
@@ -601,6 +968,9 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
       newSurface.startIndex = static_cast<uint32_t>(indices.size());
       newSurface.count =
           static_cast<uint32_t>(model.accessors[primitive.indices].count);
+      newSurface.bDoubleSided =
+          primitive.material >= 0 &&
+          model.materials[primitive.material].doubleSided;
 
       size_t initialVtx = vertices.size();
 
@@ -750,10 +1120,21 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
       newmesh->surfaces.push_back(newSurface);
     }
 
-    newmesh->meshBuffers = UploadMesh(indices, vertices);
+    if (options.bStaticBatching)
+    {
+      geometry.push_back({indices, vertices});
+    }
+    else
+    {
+      newmesh->meshBuffers = upload_mesh(*newmesh, indices, vertices);
+      if (options.bOccluders)
+      {
+        add_occluders(*newmesh, indices, vertices);
+      }
+    }
   }
 
-  for (tinygltf::Node& node : model.nodes)
+  for (const tinygltf::Node& node : model.nodes)
   {
     std::shared_ptr<hm::Node> newNode;
 
@@ -825,6 +1206,24 @@ std::optional<std::shared_ptr<hm::LoadedGLTF>> hm::loadGltf(
       node->refreshTransform(glm::mat4 {1.f});
     }
   }
+
+  if (options.bStaticBatching)
+  {
+    std::shared_ptr<MeshAsset> batch = batch_static_meshes(
+        meshes, geometry, nodes, materials, options.clusterTriangles,
+        options.bOccluders);
+    // the source meshes never got buffers, only the batch is kept
+    file.meshes.clear();
+    file.meshes[batch->name] = batch;
+
+    std::shared_ptr<MeshNode> root = std::make_shared<MeshNode>();
+    root->mesh = batch;
+    root->localTransform = glm::mat4 {1.f};
+    root->refreshTransform(glm::mat4 {1.f});
+    file.nodes.clear();
+    file.nodes[batch->name] = root;
+    file.topNodes = {root};
+  }
   return scene;
 }
 void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& ctx)
@@ -844,6 +1243,7 @@ void LoadedGLTF::clearAll(VkDevice dv)
   {
     destroy_buffer(v->meshBuffers.indexBuffer);
     destroy_buffer(v->meshBuffers.vertexBuffer);
+    destroy_buffer(v->meshBuffers.meshletBuffer);
   }
 
   for (auto& [k, v] : images)
@@ -0,0 +1,256 @@
+#include "platform/vulkan/object_buffer_vk.hpp"
+
+#include "volk.h"
+#include "core/fileio.hpp"
+#include "external/tracy_impl.hpp"
+#include "platform/vulkan/initializers_vk.hpp"
+#include "platform/vulkan/pipelines_vk.hpp"
+#include "utility/logger.hpp"
+
+#include <bit>
+#include <cstring>
+#include <numeric>
+
+using namespace hm;
+
+namespace
+{
+AllocatedBuffer create_object_buffer(u32 capacity)
+{
+  return create_buffer(capacity * sizeof(GPUObjectData),
+                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                       VMA_MEMORY_USAGE_GPU_ONLY);
+}
+} // namespace
+
+void GPUObjectBuffer::Init()
+{
+  VkPushConstantRange pushConstant {};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(ScatterPushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo =
+      vkinit::pipeline_layout_create_info();
+  layoutInfo.pPushConstantRanges = &pushConstant;
+  layoutInfo.pushConstantRangeCount = 1;
+  VK_CHECK(
+      vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &m_scatterLayout));
+
+  VkShaderModule scatterShader;
+  if (!vkutil::load_shader_module(
+          io::GetPath("shaders/object_scatter.comp.vk.spv").c_str(), _device,
+          &scatterShader))
+  {
+    log::Error("Error when building the object scatter shader");
+  }
+
+  VkPipelineShaderStageCreateInfo stageInfo {};
+  stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  stageInfo.module = scatterShader;
+  stageInfo.pName = "main";
+
+  VkComputePipelineCreateInfo pipelineInfo {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = m_scatterLayout;
+  pipelineInfo.stage = stageInfo;
+  VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo,
+                                    nullptr, &m_scatterPipeline));
+  vkDestroyShaderModule(_device, scatterShader, nullptr);
+
+  m_capacity = InitialCapacity;
+  m_buffer = create_object_buffer(m_capacity);
+  m_address = vkutil::get_buffer_address(_device, m_buffer.buffer);
+
+  _mainDeletionQueue.push_function(
+      [this]()
+      {
+        vkDestroyPipeline(_device, m_scatterPipeline, nullptr);
+        vkDestroyPipelineLayout(_device, m_scatterLayout, nullptr);
+        destroy_buffer(m_buffer);
+        m_staging.Destroy();
+        m_buffer = {};
+        m_address = 0;
+        m_capacity = 0;
+        m_bUploadAll = true;
+      });
+}
+
+void GPUObjectBuffer::Update(VkCommandBuffer cmd,
+                             const RenderObjectStore& objects)
+{
+  HM_ZONE_SCOPED_N("GPUObjectBuffer::Update");
+  m_uploadIds.clear();
+  m_objectLimit = objects.GetIdLimit();
+  if (m_bUploadAll || objects.WasFullySynced())
+  {
+    // unused ids included, so they are marked as removed
+    m_uploadIds.resize(m_objectLimit);
+    std::iota(m_uploadIds.begin(), m_uploadIds.end(), 0u);
+    m_buckets.clear();
+    m_bucketIndices.clear();
+    m_objectBuckets.assign(m_objectLimit, NoDrawBucket);
+    m_objectMeshlets.assign(m_objectLimit, 0);
+    m_bUploadAll = false;
+  }
+  else
+  {
+    // removed objects are uploaded too, as removed
+    const std::span<const RenderObjectId> synced = objects.GetSyncedIds();
+    m_uploadIds.assign(synced.begin(), synced.end());
+    m_objectBuckets.resize(m_objectLimit, NoDrawBucket);
+    m_objectMeshlets.resize(m_objectLimit, 0);
+  }
+  m_uploadCount = static_cast<u32>(m_uploadIds.size());
+  HM_ZONE_VALUE(static_cast<int64_t>(m_uploadCount));
+
+  Reserve(cmd, m_objectLimit);
+  if (m_uploadCount == 0)
+  {
+    return;
+  }
+
+  // ids first, the objects after them on a 16 byte boundary
+  const size_t idsSize = (m_uploadCount * sizeof(u32) + 15) & ~size_t {15};
+  const size_t uploadSize = idsSize + m_uploadCount * sizeof(GPUObjectData);
+  const PerFrameBuffer::Mapping staging = m_staging.Map(uploadSize);
+  std::memcpy(staging.data, m_uploadIds.data(), m_uploadCount * sizeof(u32));
+  GPUObjectData* data =
+      reinterpret_cast<GPUObjectData*>(staging.data + idsSize);
+  for (u32 i = 0; i < m_uploadCount; i++)
+  {
+    const RenderObject* object = objects.Find(m_uploadIds[i]);
+    Write(object, UpdateBucket(m_uploadIds[i], object), data[i]);
+  }
+
+  // the frame before may still read the spots that are written now
+  vkutil::memory_barrier(
+      cmd,
+      vkutil::draw_shader_stages() | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  const ScatterPushConstants pushConstants {
+      .ids = staging.address,
+      .source = staging.address + idsSize,
+      .target = m_address,
+      .count = m_uploadCount,
+      .pad = 0};
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_scatterPipeline);
+  vkCmdPushConstants(cmd, m_scatterLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(ScatterPushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (m_uploadCount + ScatterGroupSize - 1) / ScatterGroupSize,
+                1, 1);
+
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                         vkutil::draw_shader_stages() |
+                             VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+}
+
+void GPUObjectBuffer::Reserve(VkCommandBuffer cmd, u32 count)
+{
+  if (count <= m_capacity)
+  {
+    return;
+  }
+  HM_ZONE_SCOPED_N("GPUObjectBuffer::Reserve");
+  const u32 capacity = std::bit_ceil(count);
+  const AllocatedBuffer buffer = create_object_buffer(capacity);
+
+  vkutil::memory_barrier(
+      cmd,
+      vkutil::draw_shader_stages() | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+      VK_ACCESS_2_TRANSFER_READ_BIT);
+  VkBufferCopy copy {};
+  copy.size = m_capacity * sizeof(GPUObjectData);
+  vkCmdCopyBuffer(cmd, m_buffer.buffer, buffer.buffer, 1, &copy);
+  vkutil::memory_barrier(
+      cmd, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      vkutil::draw_shader_stages() | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+      VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  // draws of the frame still in flight use the old one, this frame's fence
+  // is signaled after them
+  const AllocatedBuffer old = m_buffer;
+  internal::get_current_frame()._deletionQueue.push_function(
+      [old]()
+      {
+        destroy_buffer(old);
+      });
+  m_buffer = buffer;
+  m_address = vkutil::get_buffer_address(_device, m_buffer.buffer);
+  m_capacity = capacity;
+}
+
+u32 GPUObjectBuffer::UpdateBucket(RenderObjectId id, const RenderObject* object)
+{
+  u32 bucket = NoDrawBucket;
+  // transparent objects are drawn back to front from the CPU list
+  if (object != nullptr &&
+      object->material->passType != MaterialPass::Transparent)
+  {
+    const auto [entry, bInserted] = m_bucketIndices.try_emplace(
+        {object->material, object->indexBuffer},
+        static_cast<u32>(m_buckets.size()));
+    if (bInserted)
+    {
+      m_buckets.push_back({object->material, object->indexBuffer, 0, 0});
+    }
+    bucket = entry->second;
+  }
+
+  u32& current = m_objectBuckets[id];
+  u32& currentMeshlets = m_objectMeshlets[id];
+  const u32 meshlets = bucket != NoDrawBucket ? object->meshletCount : 0;
+  if (current != bucket || currentMeshlets != meshlets)
+  {
+    if (current != NoDrawBucket)
+    {
+      m_buckets[current].objectCount--;
+      m_buckets[current].meshletCount -= currentMeshlets;
+    }
+    if (bucket != NoDrawBucket)
+    {
+      m_buckets[bucket].objectCount++;
+      m_buckets[bucket].meshletCount += meshlets;
+    }
+    current = bucket;
+    currentMeshlets = meshlets;
+  }
+  return bucket;
+}
+
+void GPUObjectBuffer::Write(const RenderObject* object, u32 drawBucket,
+                            GPUObjectData& data)
+{
+  data = {};
+  data.drawBucket = drawBucket;
+  if (object == nullptr)
+  {
+    return;
+  }
+  const culling::WorldBounds world = culling::TransformBounds(
+      object->transform, object->bounds.origin, object->bounds.sphereRadius,
+      object->bounds.extents);
+  data.transform = object->transform;
+  data.sphere = glm::vec4(world.center, world.radius);
+  data.extents = glm::vec4(world.extents, 0.f);
+  data.vertexBuffer = object->vertexBufferAddress;
+  data.materialIndex = object->material->sortId;
+  data.firstIndex = object->firstIndex;
+  data.indexCount = object->indexCount;
+  data.meshletBuffer = object->meshletBuffer;
+  data.firstMeshlet = object->firstMeshlet;
+  data.meshletCount = object->meshletCount;
+  data.firstLod = object->lodOffset;
+  data.lodCount = object->lodCount;
+}
@@ -181,6 +181,17 @@ void PipelineBuilder::set_shaders(VkShaderModule vertexShader,
   _shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
       VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
+void PipelineBuilder::set_mesh_shaders(VkShaderModule meshShader,
+                                       VkShaderModule fragmentShader)
+{
+  _shaderStages.clear();
+
+  _shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
+      VK_SHADER_STAGE_MESH_BIT_EXT, meshShader));
+
+  _shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
+      VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+}
 void PipelineBuilder::set_input_topology(VkPrimitiveTopology topology)
 {
   _inputAssembly.topology = topology;
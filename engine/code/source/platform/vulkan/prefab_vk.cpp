@@ -0,0 +1,149 @@
+#include "platform/vulkan/prefab_vk.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+
+using namespace hm;
+
+Prefab::Prefab(std::shared_ptr<LoadedGLTF> file) : m_file(std::move(file))
+{
+  HM_ZONE_SCOPED_N("Prefab::Prefab");
+  for (const auto& node : m_file->topNodes)
+  {
+    AddNode(*node, NoParent);
+  }
+  log::Info("Prefab with {} nodes, {} of them with a mesh", GetNodeCount(),
+            GetMeshNodeCount());
+}
+
+void Prefab::AddNode(const Node& node, u32 parent)
+{
+  const u32 index = GetNodeCount();
+  glm::vec3 translation, scale;
+  glm::quat rotation;
+  const bool bSplit =
+      ecs::Decompose(node.localTransform, translation, rotation, scale);
+  m_parents.push_back(parent);
+  m_translations.push_back(translation);
+  m_rotations.push_back(rotation);
+  m_scales.push_back(scale);
+  // when the parts do not rebuild the matrix, it is kept as it is
+  m_matrixOfNode.push_back(
+      bSplit ? NoMatrix : static_cast<u32>(m_localMatrices.size()));
+  if (bSplit == false)
+  {
+    m_localMatrices.push_back(node.localTransform);
+  }
+
+  if (const auto* meshNode = dynamic_cast<const MeshNode*>(&node))
+  {
+    m_meshNodes.push_back(index);
+    m_meshes.push_back(meshNode->mesh.get());
+    assignSortIds(*meshNode->mesh);
+
+    culling::Aabb bounds {glm::vec3(0.f), glm::vec3(0.f)};
+    for (size_t i = 0; i < meshNode->mesh->surfaces.size(); i++)
+    {
+      const Bounds& surface = meshNode->mesh->surfaces[i].bounds;
+      const culling::Aabb box {surface.origin - surface.extents,
+                               surface.origin + surface.extents};
+      bounds = i == 0 ? box
+                      : culling::Aabb {glm::min(bounds.min, box.min),
+                                       glm::max(bounds.max, box.max)};
+    }
+    m_meshBounds.push_back(bounds);
+  }
+
+  for (const auto& child : node.children)
+  {
+    AddNode(*child, index);
+  }
+}
+
+std::vector<ecs::Entity> Prefab::Instantiate(
+    ecs::EntityComponentSystem& ecs, std::span<const glm::mat4> rootTransforms,
+    bool bStatic) const
+{
+  HM_ZONE_SCOPED_N("Prefab::Instantiate");
+  const u32 instanceCount = static_cast<u32>(rootTransforms.size());
+  const u32 nodeCount = GetNodeCount();
+  // the root of every instance comes first, then its nodes
+  const u32 stride = nodeCount + 1;
+  HM_ZONE_VALUE(instanceCount);
+
+  ecs::Registry& registry = ecs.GetRegistry();
+  auto& transforms = ecs.GetSystem<ecs::TransformSystem>();
+
+  std::vector<ecs::Entity> entities(size_t {instanceCount} * stride);
+  registry.create(entities.begin(), entities.end());
+
+  std::vector<ecs::Transform> transformComponents(entities.size());
+  std::vector<ecs::TransformId> nodeIds(nodeCount);
+  transforms.Reserve(static_cast<u32>(entities.size()));
+  for (u32 instance = 0; instance < instanceCount; instance++)
+  {
+    ecs::Transform* components =
+        &transformComponents[size_t {instance} * stride];
+    const ecs::TransformId root = transforms.Create();
+    transforms.SetLocal(root, rootTransforms[instance]);
+    components[0].id = root;
+    for (u32 node = 0; node < nodeCount; node++)
+    {
+      const u32 parent = m_parents[node];
+      nodeIds[node] = transforms.Create(
+          parent == NoParent ? root : nodeIds[parent], m_translations[node],
+          m_rotations[node], m_scales[node]);
+      if (m_matrixOfNode[node] != NoMatrix)
+      {
+        transforms.SetLocal(nodeIds[node],
+                            m_localMatrices[m_matrixOfNode[node]]);
+      }
+      components[node + 1].id = nodeIds[node];
+    }
+  }
+  registry.insert<ecs::Transform>(entities.begin(), entities.end(),
+                                  transformComponents.begin());
+
+  // the mesh nodes are a subset, gathered so they go in with one insert too
+  std::vector<ecs::Entity> meshEntities;
+  std::vector<RenderMesh> meshComponents;
+  meshEntities.reserve(size_t {instanceCount} * m_meshNodes.size());
+  meshComponents.reserve(meshEntities.capacity());
+  for (u32 instance = 0; instance < instanceCount; instance++)
+  {
+    const ecs::Entity* nodes = &entities[size_t {instance} * stride + 1];
+    for (size_t i = 0; i < m_meshNodes.size(); i++)
+    {
+      meshEntities.push_back(nodes[m_meshNodes[i]]);
+      meshComponents.push_back({m_meshes[i]});
+    }
+  }
+  registry.insert<RenderMesh>(meshEntities.begin(), meshEntities.end(),
+                              meshComponents.begin());
+  if (bStatic)
+  {
+    registry.insert<StaticMesh>(meshEntities.begin(), meshEntities.end());
+  }
+  else
+  {
+    // moving meshes are found through the spatial index
+    auto& spatialIndex = ecs.GetSystem<ecs::SpatialIndex>();
+    std::vector<ecs::SpatialProxy> proxies(meshEntities.size());
+    for (size_t i = 0; i < meshEntities.size(); i++)
+    {
+      const ecs::Entity entity = meshEntities[i];
+      proxies[i].id = spatialIndex.Insert(
+          entity, m_meshBounds[i % m_meshNodes.size()],
+          registry.get<ecs::Transform>(entity).id);
+    }
+    registry.insert<ecs::SpatialProxy>(meshEntities.begin(),
+                                       meshEntities.end(), proxies.begin());
+  }
+
+  std::vector<ecs::Entity> roots(instanceCount);
+  for (u32 instance = 0; instance < instanceCount; instance++)
+  {
+    roots[instance] = entities[size_t {instance} * stride];
+  }
+  return roots;
+}
@@ -0,0 +1,334 @@
+#include "platform/vulkan/render_objects_vk.hpp"
+
+#include "external/tracy_impl.hpp"
+
+#include <algorithm>
+
+using namespace hm;
+
+RenderObjectRange RenderObjectStore::Add(const MeshAsset& mesh,
+                                         const glm::mat4& transform,
+                                         bool bStatic)
+{
+  const u32 count = static_cast<u32>(mesh.surfaces.size());
+  const RenderObjectRange range {Allocate(count), count};
+  for (u32 i = 0; i < count; i++)
+  {
+    Insert(range.first + i,
+           makeRenderObject(mesh, mesh.surfaces[i], transform));
+    m_static[range.first + i] = bStatic ? 1 : 0;
+    MarkChanged(range.first + i);
+  }
+  m_bStaticChanged = m_bStaticChanged || (bStatic && count > 0);
+  return range;
+}
+
+void RenderObjectStore::SetTransform(RenderObjectRange range,
+                                     const glm::mat4& transform)
+{
+  for (RenderObjectId id = range.first; id < range.first + range.count; id++)
+  {
+    const Slot& slot = m_slots[id];
+    RenderObject& object = GetObject(slot);
+    object.transform = transform;
+    if (slot.list == List::Opaque)
+    {
+      m_context.OpaqueBounds.Set(slot.index, transform, object.bounds.origin,
+                                 object.bounds.sphereRadius,
+                                 object.bounds.extents);
+    }
+    m_bStaticMoved = m_bStaticMoved || m_static[id] != 0;
+    MarkChanged(id);
+  }
+}
+
+void RenderObjectStore::SetMaterial(RenderObjectId id,
+                                    MaterialInstance* material)
+{
+  RenderObject object = GetObject(m_slots[id]);
+  const bool bPassChanged = (object.material->passType ==
+                             MaterialPass::Transparent) !=
+                            (material->passType == MaterialPass::Transparent);
+  object.material = material;
+  if (bPassChanged)
+  {
+    Erase(id);
+    Insert(id, object);
+    m_bStaticChanged = m_bStaticChanged || m_static[id] != 0;
+  }
+  else
+  {
+    GetObject(m_slots[id]) = object;
+  }
+  MarkChanged(id);
+}
+
+void RenderObjectStore::Remove(RenderObjectRange range)
+{
+  if (range.count == 0)
+  {
+    return;
+  }
+  for (RenderObjectId id = range.first; id < range.first + range.count; id++)
+  {
+    Erase(id);
+    m_bStaticChanged = m_bStaticChanged || m_static[id] != 0;
+    m_static[id] = 0;
+    MarkChanged(id);
+  }
+  m_freeRanges[range.count].push_back(range.first);
+}
+
+void RenderObjectStore::Clear()
+{
+  m_context.OpaqueSurfaces.clear();
+  m_context.OpaqueBounds.Clear();
+  m_context.TransparentSurfaces.clear();
+  m_opaqueIds.clear();
+  m_transparentIds.clear();
+  m_slots.clear();
+  m_freeRanges.clear();
+  m_changedFrame.clear();
+  m_static.clear();
+  m_staticIds.clear();
+  m_staticBounds.clear();
+  m_staticTree.Build({});
+  m_bStaticChanged = false;
+  m_bStaticMoved = false;
+  for (std::vector<RenderObjectId>& changes : m_history)
+  {
+    changes.clear();
+  }
+  // the history is gone, jumping past it makes the replicas copy everything
+  m_frame += HistoryFrames;
+  m_syncedFrame = NoFrame;
+}
+
+void RenderObjectStore::Sync(RenderObjectStore& replica) const
+{
+  HM_ZONE_SCOPED_N("RenderObjectStore::Sync");
+  // the frame the replica saw last is replayed as well, it could have gotten
+  // more changes after that
+  const bool bInHistory = replica.m_syncedFrame != NoFrame &&
+                          m_frame - replica.m_syncedFrame < HistoryFrames;
+  if (bInHistory == false)
+  {
+    replica.m_context = m_context;
+    replica.m_opaqueIds = m_opaqueIds;
+    replica.m_transparentIds = m_transparentIds;
+    replica.m_slots = m_slots;
+    replica.m_syncedFrame = m_frame;
+    replica.m_syncedIds.clear();
+    replica.m_bFullSync = true;
+    HM_ZONE_VALUE(static_cast<int64_t>(GetCount()));
+    return;
+  }
+
+  replica.m_slots.resize(m_slots.size());
+  replica.m_syncedIds.clear();
+  replica.m_bFullSync = false;
+  for (u64 frame = replica.m_syncedFrame; frame <= m_frame; frame++)
+  {
+    for (const RenderObjectId id : m_history[frame % HistoryFrames])
+    {
+      CopyObject(id, replica);
+      replica.m_syncedIds.push_back(id);
+    }
+  }
+  // an id can be in more than one of the replayed frames
+  std::ranges::sort(replica.m_syncedIds);
+  const auto duplicates = std::ranges::unique(replica.m_syncedIds);
+  replica.m_syncedIds.erase(duplicates.begin(), duplicates.end());
+  replica.m_syncedFrame = m_frame;
+}
+
+void RenderObjectStore::EndFrame()
+{
+  m_frame++;
+  m_history[m_frame % HistoryFrames].clear();
+}
+
+const RenderObject* RenderObjectStore::Find(RenderObjectId id) const
+{
+  if (id >= m_slots.size() || m_slots[id].list == List::None)
+  {
+    return nullptr;
+  }
+  const Slot& slot = m_slots[id];
+  return slot.list == List::Opaque ? &m_context.OpaqueSurfaces[slot.index]
+                                   : &m_context.TransparentSurfaces[slot.index];
+}
+
+void RenderObjectStore::QueryStatic(const culling::Frustum& frustum,
+                                    std::vector<RenderObjectId>& candidates)
+{
+  HM_ZONE_SCOPED_N("RenderObjectStore::QueryStatic");
+  if (m_bStaticChanged)
+  {
+    m_staticIds.clear();
+    for (const RenderObjectId id : m_opaqueIds)
+    {
+      if (m_static[id] != 0)
+      {
+        m_staticIds.push_back(id);
+      }
+    }
+    GatherStaticBounds();
+    m_staticTree.Build(m_staticBounds);
+  }
+  else if (m_bStaticMoved)
+  {
+    GatherStaticBounds();
+    m_staticTree.Refit(m_staticBounds);
+  }
+  m_bStaticChanged = false;
+  m_bStaticMoved = false;
+
+  m_staticItems.clear();
+  m_staticTree.Query(frustum, m_staticItems);
+  for (const u32 item : m_staticItems)
+  {
+    candidates.push_back(m_staticIds[item]);
+  }
+  HM_ZONE_VALUE(static_cast<int64_t>(m_staticItems.size()));
+}
+
+RenderObjectId RenderObjectStore::Allocate(u32 count)
+{
+  auto freeRanges = m_freeRanges.find(count);
+  if (freeRanges != m_freeRanges.end() && freeRanges->second.empty() == false)
+  {
+    const RenderObjectId first = freeRanges->second.back();
+    freeRanges->second.pop_back();
+    return first;
+  }
+  const RenderObjectId first = static_cast<RenderObjectId>(m_slots.size());
+  m_slots.resize(m_slots.size() + count);
+  m_changedFrame.resize(m_slots.size(), NoFrame);
+  m_static.resize(m_slots.size(), 0);
+  return first;
+}
+
+RenderObject& RenderObjectStore::GetObject(const Slot& slot)
+{
+  SDL_assert(slot.list != List::None);
+  return slot.list == List::Opaque
+             ? m_context.OpaqueSurfaces[slot.index]
+             : m_context.TransparentSurfaces[slot.index];
+}
+
+void RenderObjectStore::Insert(RenderObjectId id, const RenderObject& object)
+{
+  Slot& slot = m_slots[id];
+  if (object.material->passType == MaterialPass::Transparent)
+  {
+    slot = {List::Transparent,
+            static_cast<u32>(m_context.TransparentSurfaces.size())};
+    m_context.TransparentSurfaces.push_back(object);
+    m_transparentIds.push_back(id);
+  }
+  else
+  {
+    slot = {List::Opaque, static_cast<u32>(m_context.OpaqueSurfaces.size())};
+    m_context.OpaqueSurfaces.push_back(object);
+    m_context.OpaqueBounds.Add(object.transform, object.bounds.origin,
+                               object.bounds.sphereRadius,
+                               object.bounds.extents);
+    m_opaqueIds.push_back(id);
+  }
+}
+
+void RenderObjectStore::Erase(RenderObjectId id)
+{
+  Slot& slot = m_slots[id];
+  // the last object of the list fills the hole
+  if (slot.list == List::Opaque)
+  {
+    const RenderObjectId last = m_opaqueIds.back();
+    m_context.OpaqueSurfaces[slot.index] = m_context.OpaqueSurfaces.back();
+    m_context.OpaqueSurfaces.pop_back();
+    m_context.OpaqueBounds.SwapRemove(slot.index);
+    m_opaqueIds[slot.index] = last;
+    m_opaqueIds.pop_back();
+    m_slots[last].index = slot.index;
+  }
+  else if (slot.list == List::Transparent)
+  {
+    const RenderObjectId last = m_transparentIds.back();
+    m_context.TransparentSurfaces[slot.index] =
+        m_context.TransparentSurfaces.back();
+    m_context.TransparentSurfaces.pop_back();
+    m_transparentIds[slot.index] = last;
+    m_transparentIds.pop_back();
+    m_slots[last].index = slot.index;
+  }
+  slot = {};
+}
+
+void RenderObjectStore::MarkChanged(RenderObjectId id)
+{
+  if (m_changedFrame[id] != m_frame)
+  {
+    m_changedFrame[id] = m_frame;
+    m_history[m_frame % HistoryFrames].push_back(id);
+  }
+}
+
+void RenderObjectStore::GatherStaticBounds()
+{
+  const culling::BoundsSoA& bounds = m_context.OpaqueBounds;
+  m_staticBounds.resize(m_staticIds.size());
+  for (size_t i = 0; i < m_staticIds.size(); i++)
+  {
+    const u32 index = m_slots[m_staticIds[i]].index;
+    const glm::vec3 center {bounds.centerX[index], bounds.centerY[index],
+                            bounds.centerZ[index]};
+    const glm::vec3 extents {bounds.extentX[index], bounds.extentY[index],
+                             bounds.extentZ[index]};
+    m_staticBounds[i] = {center - extents, center + extents};
+  }
+}
+
+void RenderObjectStore::CopyObject(RenderObjectId id,
+                                   RenderObjectStore& replica) const
+{
+  const Slot& slot = m_slots[id];
+  Slot& replicaSlot = replica.m_slots[id];
+  if (replicaSlot.list != slot.list && replicaSlot.list != List::None)
+  {
+    replica.Erase(id);
+  }
+  if (slot.list == List::None)
+  {
+    return;
+  }
+
+  const bool bOpaque = slot.list == List::Opaque;
+  const RenderObject& object =
+      bOpaque ? m_context.OpaqueSurfaces[slot.index]
+              : m_context.TransparentSurfaces[slot.index];
+  if (replicaSlot.list == List::None)
+  {
+    std::vector<RenderObject>& objects =
+        bOpaque ? replica.m_context.OpaqueSurfaces
+                : replica.m_context.TransparentSurfaces;
+    std::vector<RenderObjectId>& ids =
+        bOpaque ? replica.m_opaqueIds : replica.m_transparentIds;
+    replicaSlot = {slot.list, static_cast<u32>(objects.size())};
+    objects.push_back(object);
+    ids.push_back(id);
+    if (bOpaque)
+    {
+      replica.m_context.OpaqueBounds.Append(m_context.OpaqueBounds,
+                                            slot.index);
+    }
+    return;
+  }
+
+  replica.GetObject(replicaSlot) = object;
+  if (bOpaque)
+  {
+    replica.m_context.OpaqueBounds.Copy(replicaSlot.index,
+                                        m_context.OpaqueBounds, slot.index);
+  }
+}
@@ -0,0 +1,110 @@
+#include "platform/vulkan/render_thread_vk.hpp"
+
+#include "external/tracy_impl.hpp"
+#include "utility/logger.hpp"
+
+using namespace hm::internal;
+
+void FrameSnapshot::CopyImGuiDrawData(const ImDrawData& drawData)
+{
+  ClearImGuiDrawData();
+  // the draw lists belong to ImGui and are rebuilt by the next NewFrame, so
+  // the render thread gets its own copies
+  imguiDrawData = drawData;
+  imguiDrawData.CmdLists.resize(0);
+  for (ImDrawList* drawList : drawData.CmdLists)
+  {
+    ImDrawList* clone = drawList->CloneOutput();
+    imguiDrawLists.push_back(clone);
+    imguiDrawData.CmdLists.push_back(clone);
+  }
+}
+
+void FrameSnapshot::ClearImGuiDrawData()
+{
+  for (ImDrawList* drawList : imguiDrawLists)
+  {
+    IM_DELETE(drawList);
+  }
+  imguiDrawLists.clear();
+  imguiDrawData.CmdLists.resize(0);
+}
+
+RenderThread::~RenderThread()
+{
+  Stop();
+}
+
+void RenderThread::Start()
+{
+  if (IsRunning())
+  {
+    return;
+  }
+  for (u32 i = 0; i < SnapshotCount; i++)
+  {
+    m_free.Push(i);
+  }
+  m_thread = std::thread(&RenderThread::Loop, this);
+  log::Info("Render thread started");
+}
+
+void RenderThread::Stop()
+{
+  if (IsRunning() == false)
+  {
+    return;
+  }
+  Flush();
+  m_submitted.Push(QuitIndex);
+  m_thread.join();
+
+  // the snapshots go back to the main thread
+  u32 index;
+  while (m_free.TryPop(index))
+  {
+  }
+  log::Info("Render thread stopped");
+}
+
+FrameSnapshot& RenderThread::Acquire()
+{
+  HM_ZONE_SCOPED_N("RenderThread::Acquire");
+  return m_snapshots[m_free.Pop()];
+}
+
+void RenderThread::Submit(FrameSnapshot& snapshot)
+{
+  const u32 index = static_cast<u32>(&snapshot - m_snapshots.data());
+  m_pendingFrames.fetch_add(1, std::memory_order_relaxed);
+  m_submitted.Push(index);
+}
+
+void RenderThread::Flush()
+{
+  HM_ZONE_SCOPED_N("RenderThread::Flush");
+  u32 pending = m_pendingFrames.load(std::memory_order_acquire);
+  while (pending != 0)
+  {
+    m_pendingFrames.wait(pending, std::memory_order_acquire);
+    pending = m_pendingFrames.load(std::memory_order_acquire);
+  }
+}
+
+void RenderThread::Loop()
+{
+  while (true)
+  {
+    const u32 index = m_submitted.Pop();
+    if (index == QuitIndex)
+    {
+      return;
+    }
+
+    draw_frame(m_snapshots[index]);
+
+    m_free.Push(index);
+    m_pendingFrames.fetch_sub(1, std::memory_order_release);
+    m_pendingFrames.notify_all();
+  }
+}
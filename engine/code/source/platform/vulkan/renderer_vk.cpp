@@ -3,6 +3,7 @@
 #include <volk.h>
 
 #include "platform/vulkan/device_vk.hpp"
+#include "core/draw_sort.hpp"
 #define VMA_IMPLEMENTATION
 #include "Common.h"
 
@@ -12,53 +13,27 @@
 #include "engine.hpp"
 #include "core/device.hpp"
 #include "core/fileio.hpp"
+#include "core/occlusion.hpp"
+#include "core/spatial_index.hpp"
 #include "external/imgui_impl.hpp"
 #include "external/tracy_impl.hpp"
+#include "core/task_graph.hpp"
 #include "glslang/Public/ShaderLang.h"
+#include "platform/vulkan/depth_pyramid_vk.hpp"
+#include "platform/vulkan/gpu_culling_vk.hpp"
 #include "platform/vulkan/images_vk.hpp"
+#include "platform/vulkan/imgui_impl_vk.hpp"
+#include "platform/vulkan/indirect_draws_vk.hpp"
 #include "platform/vulkan/initializers_vk.hpp"
 #include "platform/vulkan/loader_vk.hpp"
+#include "platform/vulkan/object_buffer_vk.hpp"
 #include "platform/vulkan/pipelines_vk.hpp"
+#include "platform/vulkan/prefab_vk.hpp"
+#include "platform/vulkan/render_objects_vk.hpp"
+#include "platform/vulkan/render_thread_vk.hpp"
 
 namespace hm::internal
 {
-bool is_visible(const RenderObject& obj, const glm::mat4& viewproj)
-{
-  std::array<glm::vec3, 8> corners {
-      glm::vec3 {1, 1, 1},   glm::vec3 {1, 1, -1},   glm::vec3 {1, -1, 1},
-      glm::vec3 {1, -1, -1}, glm::vec3 {-1, 1, 1},   glm::vec3 {-1, 1, -1},
-      glm::vec3 {-1, -1, 1}, glm::vec3 {-1, -1, -1},
-  };
-
-  glm::mat4 matrix = viewproj * obj.transform;
-
-  glm::vec3 min = {1.5, 1.5, 1.5};
-  glm::vec3 max = {-1.5, -1.5, -1.5};
-
-  for (int c = 0; c < 8; c++)
-  {
-    // project each corner into clip space
-    glm::vec4 v =
-        matrix *
-        glm::vec4(obj.bounds.origin + (corners[c] * obj.bounds.extents), 1.f);
-
-    // perspective correction
-    v.x = v.x / v.w;
-    v.y = v.y / v.w;
-    v.z = v.z / v.w;
-
-    min = glm::min(glm::vec3 {v.x, v.y, v.z}, min);
-    max = glm::max(glm::vec3 {v.x, v.y, v.z}, max);
-  }
-
-  // check the clip space box is within the view
-  if (min.z > 1.f || max.z < 0.f || min.x > 1.f || max.x < -1.f ||
-      min.y > 1.f || max.y < -1.f)
-  {
-    return false;
-  }
-  return true;
-}
 DescriptorAllocatorGrowable globalDescriptorAllocator;
 
 VkDescriptorSet _drawImageDescriptors;
@@ -70,13 +45,17 @@ VkPipelineLayout _trianglePipelineLayout;
 VkPipeline _trianglePipeline;
 
 void init_triangle_pipeline();
-void init_pipelines();
 void init_background_pipelines();
 void init_descriptors();
 
 void init_commands();
 void init_sync_structures();
-void init_default_data();
+void init_default_mesh();
+void init_default_textures();
+void init_default_samplers();
+void init_default_material();
+// builds everything above and loads the scenes, as a graph on the job system
+void init_resources();
 
 VkPipelineLayout _meshPipelineLayout;
 VkPipeline _meshPipeline;
@@ -87,9 +66,29 @@ void init_mesh_pipeline();
 
 // shuts down the engine
 void cleanup();
-void draw_background(VkCommandBuffer cmd);
-
-void draw_geometry(VkCommandBuffer cmd);
+void draw_background(VkCommandBuffer cmd, const FrameSnapshot& snapshot);
+
+void draw_geometry(VkCommandBuffer cmd, FrameSnapshot& snapshot);
+// culls the opaque surfaces among the candidates and returns the visible
+// ones sorted by pipeline, material, mesh and then front to back, spread over
+// the job system for big scenes. Surfaces behind the occluders are dropped
+// when `occlusion` is set. The level of detail of every visible surface goes
+// into `lodLevels`, by index of the opaque list, and the ones too small on
+// screen are dropped.
+std::vector<uint32_t> build_opaque_draws(
+    const RenderObjectStore& objects,
+    std::span<const RenderObjectId> candidates, const culling::Frustum& frustum,
+    const glm::mat4& view, const culling::OcclusionBuffer* occlusion,
+    const gpx::LodSettings& lodSettings, std::vector<u8>& lodLevels);
+// rasterizes the occluders among the opaque surfaces on the CPU
+void rasterize_occluders(const FrameSnapshot& snapshot);
+// keeps the opaque order around, so a still camera does not sort again
+gpx::DrawSorter opaqueSorter;
+// level of detail of every opaque surface the CPU culling kept
+std::vector<u8> opaqueLods;
+// reversed depth, the far plane goes to 0
+constexpr float nearPlane {0.1f};
+constexpr float farPlane {10000.f};
 std::vector<ComputeEffect> backgroundEffects;
 int currentBackgroundEffect {0};
 
@@ -98,38 +97,119 @@ std::vector<std::shared_ptr<MeshAsset>> testMeshes;
 
 float renderScale = 1.f;
 
-GPUSceneData sceneData;
-
 VkDescriptorSetLayout _gpuSceneDataDescriptorLayout;
 
 MaterialInstance defaultData;
 
-DrawContext mainDrawContext;
+// recorded right away on the main thread while the render thread is off
+FrameSnapshot immediateSnapshot;
+bool bThreadedRendering {false};
 std::unordered_map<std::string, std::shared_ptr<Node>> loadedNodes;
+void add_mesh_nodes(const std::vector<std::shared_ptr<MeshAsset>>& meshes,
+                    const glm::mat4& localTransform);
 
-void update_scene(Camera& mainCamera);
+void update_scene(Camera& mainCamera, FrameSnapshot& snapshot);
 
 std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> loadedScenes;
+// built from the loaded scenes, their instances live in the registry
+std::unordered_map<std::string, Prefab> prefabs;
+// render objects of everything drawn, the snapshots hold replicas of it
+RenderObjectStore renderObjects;
+// GPU side of the render objects, the draws read it by object id
+GPUObjectBuffer objectBuffer;
+// draw commands of the frame being recorded
+IndirectDrawList indirectDraws;
+bool bIndirectDraws {true};
+bool bInstancing {true};
+// culls the opaque objects of the object buffer on the GPU
+GPUCulling gpuCulling;
+bool bGpuCulling {true};
+// depth of the early pass, the late pass culls against it
+DepthPyramid depthPyramid;
+bool bOcclusionCulling {true};
+bool bMeshlets {true};
+bool bMeshShaders {true};
+// levels of detail picked by their error on screen, in pixels
+bool bMeshLods {true};
+float lodErrorPixels {1.f};
+float lodMinPixelSize {1.f};
+// the occlusion culling of the CPU path, drawn from the tagged occluders
+culling::OcclusionBuffer occlusionBuffer;
+constexpr u32 OcclusionBufferWidth {320};
+// RenderMesh components added since the last frame, registered in one go
+std::vector<ecs::Entity> addedRenderMeshes;
+// entity of the RenderMesh on a transform, indexed by TransformId
+std::vector<ecs::Entity> renderMeshOfTransform;
+// transforms that were still interpolating last frame
+std::vector<ecs::TransformId> movingTransforms;
+void on_render_mesh_added(ecs::Registry& registry, ecs::Entity entity);
+void on_render_mesh_removed(ecs::Registry& registry, ecs::Entity entity);
+// registers the meshes of the node and everything below it, for nodes that
+// never move
+void add_node_objects(const Node& node, const glm::mat4& topMatrix);
+// registers the new RenderMesh entities and moves the render objects of the
+// transforms that changed
+void sync_render_meshes();
+// render objects that can be in the frustum: the static ones out of the tree
+// of the store, the others through the SpatialIndex
+void collect_cull_candidates(const culling::Frustum& frustum,
+                             std::vector<RenderObjectId>& candidates);
+std::vector<ecs::Entity> candidateEntities;
 } // namespace hm::internal
 using namespace hm::internal;
 using namespace hm;
 hm::gpx::Renderer::Renderer(const std::string& name) : System(name)
 {
-  init_descriptors();
-  init_pipelines();
-  init_default_data();
+  // all the work happens in Render, on the main thread
+  m_access.bExclusive = false;
+  init_resources();
+
+  ecs::Registry& registry = Engine::Instance().GetECS().GetRegistry();
+  registry.on_construct<RenderMesh>().connect<&on_render_mesh_added>();
+  registry.on_destroy<RenderMesh>().connect<&on_render_mesh_removed>();
+
+  // the structure was drawn from its node graph before, now it is one
+  // instance of its prefab in the registry
+  const Prefab& structure =
+      prefabs.try_emplace("structure", loadedScenes["structure"]).first->second;
+  const glm::mat4 origin {1.f};
+  structure.Instantiate(Engine::Instance().GetECS(), {&origin, 1}, true);
+
+  // the test meshes stay where they are, so they are registered once
+  for (const auto& [name, node] : loadedNodes)
+  {
+    add_node_objects(*node, glm::mat4 {1.f});
+  }
+  add_node_objects(*loadedNodes["Suzanne"], glm::mat4 {1.f});
+  for (int x = -3; x < 3; x++)
+  {
+    glm::mat4 scale = glm::scale(glm::identity<glm::mat4>(), glm::vec3 {0.2});
+    glm::mat4 translation =
+        glm::translate(glm::identity<glm::mat4>(), glm::vec3 {x, 1, 0});
+
+    add_node_objects(*loadedNodes["Cube"], translation * scale);
+  }
+
   auto& mainCamera = Engine::Instance().GetECS().GetSystem<Camera>();
 
   mainCamera.velocity = glm::vec3(0.f);
   mainCamera.position = glm::vec3(0, 0, 5);
+  mainCamera.previousPosition = mainCamera.position;
 
   mainCamera.pitch = 0;
   mainCamera.yaw = 0;
 }
 gpx::Renderer::~Renderer()
 {
+  _renderThread.Stop();
   // make sure the gpu has stopped doing its things
   vkDeviceWaitIdle(_device);
+  indirectDraws.Destroy();
+  ecs::Registry& registry = Engine::Instance().GetECS().GetRegistry();
+  registry.on_construct<RenderMesh>().disconnect<&on_render_mesh_added>();
+  registry.on_destroy<RenderMesh>().disconnect<&on_render_mesh_removed>();
+  renderObjects.Clear();
+  prefabs.clear();
   for (auto& scene : loadedScenes)
   {
     scene.second->clearAll(_device);
@@ -138,15 +218,113 @@ gpx::Renderer::~Renderer()
   {
     destroy_buffer(mesh->meshBuffers.indexBuffer);
     destroy_buffer(mesh->meshBuffers.vertexBuffer);
+    destroy_buffer(mesh->meshBuffers.meshletBuffer);
   }
   loadedScenes.clear();
 }
-void internal::init_pipelines()
+void internal::init_resources()
 {
-  init_background_pipelines();
-  init_triangle_pipeline();
-  init_mesh_pipeline();
-  metalRoughMaterial.build_pipelines();
+  HM_ZONE_SCOPED;
+  // reading and parsing the models only needs the CPU, so it starts right
+  // away next to the pipeline builds. Uploads take turns on the immediate
+  // submit, anything that writes a material waits for the material pipelines
+  jobs::TaskGraph startup("Renderer startup");
+
+  const jobs::TaskId descriptors =
+      startup.Add("Descriptors", init_descriptors);
+  startup.Add("Background pipelines", init_background_pipelines,
+              {descriptors});
+  startup.Add("Triangle pipeline", init_triangle_pipeline);
+  startup.Add("Object buffer",
+              []()
+              {
+                objectBuffer.Init();
+              });
+  startup.Add("GPU culling",
+              []()
+              {
+                gpuCulling.Init();
+              });
+  startup.Add("Depth pyramid",
+              []()
+              {
+                depthPyramid.Init();
+              });
+  startup.Add("Mesh pipeline", init_mesh_pipeline, {descriptors});
+  const jobs::TaskId materialPipelines = startup.Add(
+      "Material pipelines",
+      []()
+      {
+        metalRoughMaterial.build_pipelines();
+      },
+      {descriptors});
+
+  startup.Add("Rectangle mesh", init_default_mesh);
+  const jobs::TaskId textures =
+      startup.Add("Default textures", init_default_textures);
+  const jobs::TaskId samplers =
+      startup.Add("Default samplers", init_default_samplers);
+  const jobs::TaskId material =
+      startup.Add("Default material", init_default_material,
+                  {descriptors, materialPipelines, textures, samplers});
+
+  std::vector<std::shared_ptr<MeshAsset>> gameMeshes;
+  std::optional<ParsedGLTF> structure;
+  const jobs::TaskId testMeshesLoaded = startup.Add(
+      "Load basicmesh.glb",
+      []()
+      {
+        testMeshes =
+            loadGltfMeshes(io::GetPath("models/basicmesh.glb")).value();
+      });
+  const jobs::TaskId gameMeshesLoaded = startup.Add(
+      "Load a_beautiful_game.glb",
+      [&gameMeshes]()
+      {
+        gameMeshes =
+            loadGltfMeshes(io::GetPath("models/a_beautiful_game.glb")).value();
+      });
+  const jobs::TaskId structureParsed = startup.Add(
+      "Parse structure.glb",
+      [&structure]()
+      {
+        structure = parseGltf(io::GetPath("models/structure.glb"));
+      });
+
+  const jobs::TaskId testMeshesPlaced = startup.Add(
+      "Place test meshes",
+      []()
+      {
+        add_mesh_nodes(testMeshes, glm::mat4 {1.f});
+      },
+      {testMeshesLoaded, material});
+  // after the test meshes, so the same names end up as before
+  startup.Add(
+      "Place game meshes",
+      [&gameMeshes]()
+      {
+        add_mesh_nodes(gameMeshes, glm::mat4 {1.f * 10});
+      },
+      {gameMeshesLoaded, material, testMeshesPlaced});
+  startup.Add(
+      "Upload structure.glb",
+      [&structure]()
+      {
+        assert(structure.has_value());
+        // the structure never moves, its meshes are merged per material and
+        // its walls hide what is behind them
+        const auto structureFile = loadGltf(
+            _device, *structure,
+            {.bStaticBatching = true, .bOccluders = true});
+
+        assert(structureFile.has_value());
+
+        loadedScenes["structure"] = *structureFile;
+      },
+      {structureParsed, materialPipelines, textures, samplers});
+
+  startup.Run(Engine::Instance().GetJobs());
+  startup.LogReport();
 }
 
 void internal::init_background_pipelines()
@@ -348,7 +526,8 @@ void internal::init_descriptors()
       DescriptorLayoutBuilder builder;
       builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
       _gpuSceneDataDescriptorLayout = builder.build(
-          _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+          _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT |
+                       (_bMeshShaders ? VK_SHADER_STAGE_MESH_BIT_EXT : 0));
     }
     {
       DescriptorLayoutBuilder builder;
@@ -378,188 +557,157 @@ void internal::init_descriptors()
     }
   }
 }
-void internal::init_default_data()
+void internal::init_default_mesh()
 {
   HM_ZONE_SCOPED;
 
-  {
-    HM_ZONE_SCOPED_N("Create Rectangle Mesh");
-    std::array<Vertex, 4> rect_vertices;
+  std::array<Vertex, 4> rect_vertices;
 
-    rect_vertices[0].position = {0.5, -0.5, 0};
-    rect_vertices[1].position = {0.5, 0.5, 0};
-    rect_vertices[2].position = {-0.5, -0.5, 0};
-    rect_vertices[3].position = {-0.5, 0.5, 0};
+  rect_vertices[0].position = {0.5, -0.5, 0};
+  rect_vertices[1].position = {0.5, 0.5, 0};
+  rect_vertices[2].position = {-0.5, -0.5, 0};
+  rect_vertices[3].position = {-0.5, 0.5, 0};
 
-    rect_vertices[0].color = {0, 0, 0, 1};
-    rect_vertices[1].color = {0.5, 0.5, 0.5, 1};
-    rect_vertices[2].color = {1, 0, 0, 1};
-    rect_vertices[3].color = {0, 1, 0, 1};
+  rect_vertices[0].color = {0, 0, 0, 1};
+  rect_vertices[1].color = {0.5, 0.5, 0.5, 1};
+  rect_vertices[2].color = {1, 0, 0, 1};
+  rect_vertices[3].color = {0, 1, 0, 1};
 
-    std::array<uint32_t, 6> rect_indices;
+  std::array<uint32_t, 6> rect_indices;
 
-    rect_indices[0] = 0;
-    rect_indices[1] = 1;
-    rect_indices[2] = 2;
+  rect_indices[0] = 0;
+  rect_indices[1] = 1;
+  rect_indices[2] = 2;
 
-    rect_indices[3] = 2;
-    rect_indices[4] = 1;
-    rect_indices[5] = 3;
+  rect_indices[3] = 2;
+  rect_indices[4] = 1;
+  rect_indices[5] = 3;
 
-    rectangle = UploadMesh(rect_indices, rect_vertices);
-
-    _mainDeletionQueue.push_function(
-        [&]()
-        {
-          destroy_buffer(rectangle.indexBuffer);
-          destroy_buffer(rectangle.vertexBuffer);
-        });
-  }
+  rectangle = UploadMesh(rect_indices, rect_vertices);
 
-  {
-    HM_ZONE_SCOPED_N("Create Default Textures");
-
-    uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
-    _whiteImage =
-        create_image((void*)&white, VkExtent3D {1, 1, 1},
-                     VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-    uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
-    _greyImage =
-        create_image((void*)&grey, VkExtent3D {1, 1, 1},
-                     VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-    uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
-    _blackImage =
-        create_image((void*)&black, VkExtent3D {1, 1, 1},
-                     VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-    uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
-    std::array<uint32_t, 16 * 16> pixels;
-    for (int x = 0; x < 16; x++)
-    {
-      for (int y = 0; y < 16; y++)
+  _mainDeletionQueue.push_function(
+      [&]()
       {
-        pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
-      }
-    }
-    _errorCheckerboardImage =
-        create_image(pixels.data(), VkExtent3D {16, 16, 1},
-                     VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-  }
-
-  {
-    HM_ZONE_SCOPED_N("Create Samplers");
-
-    VkSamplerCreateInfo sampl = {.sType =
-                                     VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
-
-    sampl.magFilter = VK_FILTER_NEAREST;
-    sampl.minFilter = VK_FILTER_NEAREST;
-    vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerNearest);
+        destroy_buffer(rectangle.indexBuffer);
+        destroy_buffer(rectangle.vertexBuffer);
+      });
+}
+void internal::init_default_textures()
+{
+  HM_ZONE_SCOPED;
 
-    sampl.magFilter = VK_FILTER_LINEAR;
-    sampl.minFilter = VK_FILTER_LINEAR;
-    vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerLinear);
+  uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
+  _whiteImage =
+      create_image((void*)&white, VkExtent3D {1, 1, 1},
+                   VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-    _mainDeletionQueue.push_function(
-        [&]()
-        {
-          vkDestroySampler(_device, _defaultSamplerNearest, nullptr);
-          vkDestroySampler(_device, _defaultSamplerLinear, nullptr);
+  uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
+  _greyImage =
+      create_image((void*)&grey, VkExtent3D {1, 1, 1},
+                   VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-          destroy_image(_whiteImage);
-          destroy_image(_greyImage);
-          destroy_image(_blackImage);
-          destroy_image(_errorCheckerboardImage);
-        });
-  }
+  uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
+  _blackImage =
+      create_image((void*)&black, VkExtent3D {1, 1, 1},
+                   VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
+  uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
+  std::array<uint32_t, 16 * 16> pixels;
+  for (int x = 0; x < 16; x++)
   {
-    HM_ZONE_SCOPED_N("Setup Default Material");
-
-    GLTFMetallic_Roughness::MaterialResources materialResources;
-    materialResources.colorImage = _whiteImage;
-    materialResources.colorSampler = _defaultSamplerLinear;
-    materialResources.metalRoughImage = _whiteImage;
-    materialResources.metalRoughSampler = _defaultSamplerLinear;
-
-    AllocatedBuffer materialConstants = create_buffer(
-        sizeof(GLTFMetallic_Roughness::MaterialConstants),
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    GLTFMetallic_Roughness::MaterialConstants* sceneUniformData =
-        static_cast<GLTFMetallic_Roughness::MaterialConstants*>(
-            materialConstants.allocation->GetMappedData());
-    sceneUniformData->colorFactors = glm::vec4 {1, 1, 1, 1};
-    sceneUniformData->metal_rough_factors = glm::vec4 {1, 0.5, 0, 0};
-
-    _mainDeletionQueue.push_function(
-        [=]()
-        {
-          destroy_buffer(materialConstants);
-        });
-
-    materialResources.dataBuffer = materialConstants.buffer;
-    materialResources.dataBufferOffset = 0;
-
-    defaultData = metalRoughMaterial.write_material(
-        _device, MaterialPass::MainColor, materialResources,
-        globalDescriptorAllocator);
+    for (int y = 0; y < 16; y++)
+    {
+      pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
+    }
   }
+  _errorCheckerboardImage =
+      create_image(pixels.data(), VkExtent3D {16, 16, 1},
+                   VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-  {
-    HM_ZONE_SCOPED_N("Load Test Meshes");
+  _mainDeletionQueue.push_function(
+      [&]()
+      {
+        destroy_image(_whiteImage);
+        destroy_image(_greyImage);
+        destroy_image(_blackImage);
+        destroy_image(_errorCheckerboardImage);
+      });
+}
+void internal::init_default_samplers()
+{
+  HM_ZONE_SCOPED;
 
-    testMeshes = loadGltfMeshes(io::GetPath("models/basicmesh.glb")).value();
-    HM_ZONE_VALUE(static_cast<int64_t>(testMeshes.size()));
+  VkSamplerCreateInfo sampl = {.sType =
+                                   VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
 
-    for (auto& m : testMeshes)
-    {
-      std::shared_ptr<MeshNode> newNode = std::make_shared<MeshNode>();
-      newNode->mesh = m;
+  sampl.magFilter = VK_FILTER_NEAREST;
+  sampl.minFilter = VK_FILTER_NEAREST;
+  vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerNearest);
 
-      newNode->localTransform = glm::mat4 {1.f};
-      newNode->worldTransform = glm::mat4 {1.f};
+  sampl.magFilter = VK_FILTER_LINEAR;
+  sampl.minFilter = VK_FILTER_LINEAR;
+  vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerLinear);
 
-      for (auto& s : newNode->mesh->surfaces)
+  _mainDeletionQueue.push_function(
+      [&]()
       {
-        s.material = std::make_shared<GLTFMaterial>(defaultData);
-      }
+        vkDestroySampler(_device, _defaultSamplerNearest, nullptr);
+        vkDestroySampler(_device, _defaultSamplerLinear, nullptr);
+      });
+}
+void internal::init_default_material()
+{
+  HM_ZONE_SCOPED;
 
-      loadedNodes[m->name] = std::move(newNode);
-    }
-  }
+  GLTFMetallic_Roughness::MaterialResources materialResources;
+  materialResources.colorImage = _whiteImage;
+  materialResources.colorSampler = _defaultSamplerLinear;
+  materialResources.metalRoughImage = _whiteImage;
+  materialResources.metalRoughSampler = _defaultSamplerLinear;
 
-  {
-    HM_ZONE_SCOPED_N("Load Structure Scene");
+  AllocatedBuffer materialConstants = create_buffer(
+      sizeof(GLTFMetallic_Roughness::MaterialConstants),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-    std::string structurePath = {io::GetPath("models/structure.glb")};
-    HM_ZONE_TEXT(structurePath.c_str(), structurePath.size());
+  GLTFMetallic_Roughness::MaterialConstants* sceneUniformData =
+      static_cast<GLTFMetallic_Roughness::MaterialConstants*>(
+          materialConstants.allocation->GetMappedData());
+  sceneUniformData->colorFactors = glm::vec4 {1, 1, 1, 1};
+  sceneUniformData->metal_rough_factors = glm::vec4 {1, 0.5, 0, 0};
 
-    const auto structureFile = loadGltf(_device, structurePath);
+  _mainDeletionQueue.push_function(
+      [=]()
+      {
+        destroy_buffer(materialConstants);
+      });
 
-    assert(structureFile.has_value());
+  materialResources.dataBuffer = materialConstants.buffer;
+  materialResources.dataBufferOffset = 0;
 
-    loadedScenes["structure"] = *structureFile;
-  }
+  defaultData = metalRoughMaterial.write_material(
+      _device, MaterialPass::MainColor, materialResources,
+      globalDescriptorAllocator);
+  // the copies made for the test meshes share the id
+  assignSortId(defaultData);
+}
+void internal::add_mesh_nodes(
+    const std::vector<std::shared_ptr<MeshAsset>>& meshes,
+    const glm::mat4& localTransform)
+{
+  HM_ZONE_SCOPED;
+  HM_ZONE_VALUE(static_cast<int64_t>(meshes.size()));
+  for (auto& m : meshes)
   {
-    HM_ZONE_SCOPED_N("Load Beautiful Game Meshes");
-    auto gameMeshes =
-        loadGltfMeshes(io::GetPath("models/a_beautiful_game.glb")).value();
-    HM_ZONE_VALUE(static_cast<int64_t>(gameMeshes.size()));
-    for (auto& m : gameMeshes)
+    std::shared_ptr<MeshNode> newNode = std::make_shared<MeshNode>();
+    newNode->mesh = m;
+    newNode->localTransform = localTransform;
+    newNode->worldTransform = glm::mat4 {1.f};
+    for (auto& s : newNode->mesh->surfaces)
     {
-      std::shared_ptr<MeshNode> newNode = std::make_shared<MeshNode>();
-      newNode->mesh = m;
-      newNode->localTransform = glm::mat4 {1.f * 10};
-      newNode->worldTransform = glm::mat4 {1.f};
-      for (auto& s : newNode->mesh->surfaces)
-      {
-        s.material = std::make_shared<GLTFMaterial>(defaultData);
-      }
-      loadedNodes[m->name] = std::move(newNode);
+      s.material = std::make_shared<GLTFMaterial>(defaultData);
     }
+    assignSortIds(*m);
+    loadedNodes[m->name] = std::move(newNode);
   }
 }
 void internal::init_mesh_pipeline()
@@ -652,10 +800,26 @@ void hm::gpx::Renderer::Render()
   ImGui::Begin("Stats");
 
   ImGui::Text("frametime %f ms", stats.frametime);
+  ImGui::Text("ticks %i", stats.tick_count);
   ImGui::Text("draw time %f ms", stats.mesh_draw_time);
   ImGui::Text("update time %f ms", stats.scene_update_time);
   ImGui::Text("triangles %i", stats.triangle_count);
   ImGui::Text("draws %i", stats.drawcall_count);
+  ImGui::Text("object uploads %i", stats.object_upload_count);
+  ImGui::Text("culling kernel %s", culling::GetKernelName());
+  ImGui::Checkbox("Render thread", &bThreadedRendering);
+  ImGui::Checkbox("Indirect draws", &bIndirectDraws);
+  ImGui::Checkbox("Instancing", &bInstancing);
+  ImGui::Checkbox("GPU culling", &bGpuCulling);
+  ImGui::Checkbox("Occlusion culling", &bOcclusionCulling);
+  ImGui::Checkbox("Meshlet culling", &bMeshlets);
+  ImGui::Checkbox("Mesh LODs", &bMeshLods);
+  ImGui::SliderFloat("LOD error (px)", &lodErrorPixels, 0.f, 16.f);
+  ImGui::SliderFloat("Min object size (px)", &lodMinPixelSize, 0.f, 16.f);
+  if (_bMeshShaders)
+  {
+    ImGui::Checkbox("Mesh shaders", &bMeshShaders);
+  }
   ImGui::End();
   if (ImGui::Begin("background"))
   {
@@ -675,11 +839,83 @@ void hm::gpx::Renderer::Render()
   }
   ImGui::End();
 
+  // finishes the UI, the draw data is copied into the snapshot below
+  external::ImGuiEndFrame();
+
+  SetThreadedRendering(bThreadedRendering);
+  FrameSnapshot& snapshot = _renderThread.IsRunning() ? _renderThread.Acquire()
+                                                      : immediateSnapshot;
+  // results of the last frame recorded with this snapshot
+  stats.drawcall_count = snapshot.results.drawcallCount;
+  stats.triangle_count = snapshot.results.triangleCount;
+  stats.object_upload_count = snapshot.results.objectUploadCount;
+  stats.mesh_draw_time = snapshot.results.meshDrawTime;
+  if (snapshot.results.bSwapchainOutOfDate)
+  {
+    snapshot.results.bSwapchainOutOfDate = false;
+    Engine::Instance().GetDevice().SetResizeRequest(true);
+  }
+
+  auto& mainCamera = Engine::Instance().GetECS().GetSystem<Camera>();
+  update_scene(mainCamera, snapshot);
+  snapshot.windowSize = Engine::Instance().GetDevice().GetWindowSize();
+  snapshot.renderScale = renderScale;
+  snapshot.bIndirectDraws = bIndirectDraws;
+  snapshot.bInstancing = bInstancing;
+  snapshot.bGpuCulling = bGpuCulling;
+  snapshot.bOcclusionCulling = bOcclusionCulling;
+  snapshot.bMeshlets = bMeshlets;
+  snapshot.bMeshShaders = bMeshShaders;
+  snapshot.bMeshLods = bMeshLods;
+  snapshot.lodErrorPixels = lodErrorPixels;
+  snapshot.lodMinPixelSize = lodMinPixelSize;
+  snapshot.backgroundEffect = backgroundEffects[currentBackgroundEffect];
+  snapshot.CopyImGuiDrawData(*ImGui::GetDrawData());
+
+  if (_renderThread.IsRunning())
+  {
+    _renderThread.Submit(snapshot);
+  }
+  else
+  {
+    draw_frame(snapshot);
+  }
+}
+void hm::gpx::Renderer::SetThreadedRendering(bool enabled)
+{
+  bThreadedRendering = enabled;
+  if (enabled)
+  {
+    _renderThread.Start();
+  }
+  else
+  {
+    _renderThread.Stop();
+  }
+}
+bool hm::gpx::Renderer::IsThreadedRendering() const
+{
+  return _renderThread.IsRunning();
+}
+void hm::gpx::Renderer::OnSnapshotLoaded()
+{
+  // the render objects of the old entities went with their RenderMesh, the
+  // restored ones still point into the store from before and are added again
+  renderMeshOfTransform.clear();
+  movingTransforms.clear();
+  addedRenderMeshes.clear();
+  ecs::Registry& registry = Engine::Instance().GetECS().GetRegistry();
+  for (auto [entity, renderMesh] : registry.view<RenderMesh>().each())
+  {
+    renderMesh.objects = {};
+    addedRenderMeshes.push_back(entity);
+  }
+}
+void internal::draw_frame(FrameSnapshot& snapshot)
+{
+  HM_ZONE_SCOPED_N("draw_frame");
   // wait until the gpu has finished rendering the last frame. Timeout of 1
   // second
-  auto& mainCamera = Engine::Instance().GetECS().GetSystem<Camera>();
-
-  update_scene(mainCamera);
   VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true,
                            1000000000));
 
@@ -691,15 +927,17 @@ void hm::gpx::Renderer::Render()
                                      nullptr, &swapchainImageIndex);
   if (e == VK_ERROR_OUT_OF_DATE_KHR)
   {
-    Engine::Instance().GetDevice().SetResizeRequest(true);
+    snapshot.results.bSwapchainOutOfDate = true;
+    // the changes synced into this snapshot never made it to the GPU
+    objectBuffer.Invalidate();
     return;
   }
   _drawExtent.height =
       std::min(_swapchainExtent.height, _drawImage.imageExtent.height) *
-      renderScale;
+      snapshot.renderScale;
   _drawExtent.width =
       std::min(_swapchainExtent.width, _drawImage.imageExtent.width) *
-      renderScale;
+      snapshot.renderScale;
 
   VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._renderFence));
 
@@ -717,18 +955,22 @@ void hm::gpx::Renderer::Render()
 
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+  objectBuffer.Update(cmd, snapshot.renderObjects);
+  snapshot.results.objectUploadCount =
+      static_cast<int>(objectBuffer.GetUploadCount());
+
   // transition our main draw image into general layout so we can write into it
   // we will overwrite it all so we dont care about what was the older layout
   vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                            VK_IMAGE_LAYOUT_GENERAL);
 
-  draw_background(cmd);
+  draw_background(cmd, snapshot);
 
   vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_GENERAL,
                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
   vkutil::transition_image(cmd, _depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                            VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-  draw_geometry(cmd);
+  draw_geometry(cmd, snapshot);
 
   // transtion the draw image and the swapchain image into their correct
   // transfer layouts
@@ -750,7 +992,8 @@ void hm::gpx::Renderer::Render()
                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
   // draw imgui into the swapchain image
-  external::ImGuiEndFrame();
+  RenderVulkanImGui(cmd, _swapchainImageViews[swapchainImageIndex],
+                    &snapshot.imguiDrawData);
   // set swapchain image layout to Present so we can draw it
   vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
@@ -778,6 +1021,7 @@ void hm::gpx::Renderer::Render()
 
   // submit command buffer to the queue and execute it.
   //  _renderFence will now block until the graphic commands finish execution
+  std::unique_lock queueLock(_graphicsQueueMutex);
   VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit,
                           get_current_frame()._renderFence));
 
@@ -799,9 +1043,10 @@ void hm::gpx::Renderer::Render()
 
   const VkResult presentResult =
       vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+  queueLock.unlock();
   if (presentResult == VK_ERROR_OUT_OF_DATE_KHR)
   {
-    Engine::Instance().GetDevice().SetResizeRequest(true);
+    snapshot.results.bSwapchainOutOfDate = true;
     return;
   }
 
@@ -809,11 +1054,14 @@ void hm::gpx::Renderer::Render()
   _frameNumber++;
 }
 
-void internal::draw_geometry(VkCommandBuffer cmd)
+void internal::draw_geometry(VkCommandBuffer cmd, FrameSnapshot& snapshot)
 {
+  const GPUSceneData& sceneData = snapshot.sceneData;
+  const DrawContext& drawContext = snapshot.renderObjects.GetDrawContext();
+  FrameSnapshot::Results& results = snapshot.results;
   // reset counters
-  stats.drawcall_count = 0;
-  stats.triangle_count = 0;
+  results.drawcallCount = 0;
+  results.triangleCount = 0;
   // begin clock
   auto start = std::chrono::system_clock::now();
 
@@ -846,6 +1094,39 @@ void internal::draw_geometry(VkCommandBuffer cmd)
                       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
   writer.update_set(_device, globalDescriptor);
 
+  const culling::Frustum frustum = culling::ExtractFrustum(sceneData.viewproj);
+  // the compute passes have to be recorded outside of the render passes
+  const bool bOcclusion = snapshot.bGpuCulling && snapshot.bOcclusionCulling;
+  // sizes on screen are measured in pixels of the draw image
+  gpx::LodSettings lodSettings {};
+  if (snapshot.bMeshLods)
+  {
+    lodSettings.pixelsPerUnit = glm::abs(sceneData.proj[1][1]) * 0.5f *
+                                static_cast<f32>(_drawExtent.height);
+    lodSettings.errorPixels = snapshot.lodErrorPixels;
+    lodSettings.minPixelSize = snapshot.lodMinPixelSize;
+  }
+  GPUCulling::MeshletMode meshletMode = GPUCulling::MeshletMode::Off;
+  if (snapshot.bMeshlets)
+  {
+    const bool bMeshShader = snapshot.bMeshShaders &&
+                             metalRoughMaterial.meshletPipeline.pipeline !=
+                                 VK_NULL_HANDLE;
+    meshletMode = bMeshShader ? GPUCulling::MeshletMode::MeshShader
+                              : GPUCulling::MeshletMode::Indexed;
+  }
+  if (snapshot.bGpuCulling)
+  {
+    gpuCulling.Prepare(cmd, objectBuffer, snapshot.cullCandidates, frustum,
+                       sceneData.viewproj,
+                       glm::vec3(glm::inverse(sceneData.view)[3]),
+                       depthPyramid, meshletMode, lodSettings);
+    gpuCulling.Cull(cmd,
+                    bOcclusion ? GPUCulling::Pass::Early
+                               : GPUCulling::Pass::All,
+                    depthPyramid);
+  }
+
   // begin a render pass  connected to our draw image
 
   VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
@@ -858,106 +1139,220 @@ void internal::draw_geometry(VkCommandBuffer cmd)
 
   vkCmdBeginRendering(cmd, &renderInfo);
 
-  std::vector<uint32_t> opaque_draws;
-  opaque_draws.reserve(mainDrawContext.OpaqueSurfaces.size());
-
-  for (int i = 0; i < mainDrawContext.OpaqueSurfaces.size(); i++)
+  // the planes are extracted once, then the bounds are tested in batches
+  const bool bCpuOcclusion =
+      snapshot.bGpuCulling == false && snapshot.bOcclusionCulling;
+  if (bCpuOcclusion)
   {
-    if (is_visible(mainDrawContext.OpaqueSurfaces[i], sceneData.viewproj))
-    {
-      opaque_draws.push_back(i);
-    }
+    rasterize_occluders(snapshot);
   }
-
-  // sort the opaque surfaces by material and mesh
-  std::sort(opaque_draws.begin(), opaque_draws.end(),
-            [&](const auto& iA, const auto& iB)
-            {
-              const RenderObject& A = mainDrawContext.OpaqueSurfaces[iA];
-              const RenderObject& B = mainDrawContext.OpaqueSurfaces[iB];
-              if (A.material == B.material)
-              {
-                return A.indexBuffer < B.indexBuffer;
-              }
-              else
-              {
-                return A.material < B.material;
-              }
-            });
+  const std::vector<uint32_t> opaque_draws =
+      snapshot.bGpuCulling
+          ? std::vector<uint32_t> {}
+          : build_opaque_draws(snapshot.renderObjects,
+                               snapshot.cullCandidates, frustum, sceneData.view,
+                               bCpuOcclusion ? &occlusionBuffer : nullptr,
+                               lodSettings, opaqueLods);
 
   // defined outside of the draw function, this is the state we will try to skip
   MaterialPipeline* lastPipeline = nullptr;
   MaterialInstance* lastMaterial = nullptr;
   VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
 
-  auto draw = [&](const RenderObject& r)
+  const std::vector<RenderObjectId>& opaqueIds =
+      snapshot.renderObjects.GetOpaqueIds();
+  const std::vector<RenderObjectId>& transparentIds =
+      snapshot.renderObjects.GetTransparentIds();
+  // the draws are sorted by pipeline and material, every run of the same
+  // state becomes one batch
+  indirectDraws.m_bInstancing = snapshot.bInstancing;
+  indirectDraws.Clear();
+  for (auto& r : opaque_draws)
   {
-    if (r.material != lastMaterial)
-    {
-      lastMaterial = r.material;
-      // rebind pipeline and descriptors if the material changed
-      if (r.material->pipeline != lastPipeline)
-      {
-        lastPipeline = r.material->pipeline;
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          r.material->pipeline->pipeline);
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                r.material->pipeline->layout, 0, 1,
-                                &globalDescriptor, 0, nullptr);
-
-        VkViewport viewport = {};
-        auto windowSize = Engine::Instance().GetDevice().GetWindowSize();
-        viewport.x = 0;
-        viewport.y = 0;
-        viewport.width = static_cast<float>(windowSize.x);
-        viewport.height = static_cast<float>(windowSize.y);
-        viewport.minDepth = 0.f;
-        viewport.maxDepth = 1.f;
-
-        vkCmdSetViewport(cmd, 0, 1, &viewport);
-
-        VkRect2D scissor = {};
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        scissor.extent.width = windowSize.x;
-        scissor.extent.height = windowSize.y;
-
-        vkCmdSetScissor(cmd, 0, 1, &scissor);
-      }
+    indirectDraws.Add(drawContext.OpaqueSurfaces[r], opaqueIds[r],
+                      opaqueLods[r]);
+  }
+  for (size_t i = 0; i < drawContext.TransparentSurfaces.size(); i++)
+  {
+    indirectDraws.Add(drawContext.TransparentSurfaces[i], transparentIds[i]);
+  }
+  const IndirectDrawList::Buffers drawBuffers = indirectDraws.Upload();
+  results.triangleCount = static_cast<int>(indirectDraws.GetTriangleCount());
 
+  GPUObjectPushConstants pushConstants {
+      objectBuffer.GetAddress(),
+      snapshot.bGpuCulling ? gpuCulling.GetInstances() : drawBuffers.instances};
+  auto set_viewport_and_scissor = [&]()
+  {
+    VkViewport viewport = {};
+    const glm::uvec2 windowSize = snapshot.windowSize;
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = static_cast<float>(windowSize.x);
+    viewport.height = static_cast<float>(windowSize.y);
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    scissor.extent.width = windowSize.x;
+    scissor.extent.height = windowSize.y;
+
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+  };
+  auto bind_material = [&](MaterialInstance* material)
+  {
+    if (material == lastMaterial)
+    {
+      return;
+    }
+    lastMaterial = material;
+    // rebind pipeline and descriptors if the material changed
+    if (material->pipeline != lastPipeline)
+    {
+      lastPipeline = material->pipeline;
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        material->pipeline->pipeline);
       vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              r.material->pipeline->layout, 1, 1,
-                              &r.material->materialSet, 0, nullptr);
+                              material->pipeline->layout, 0, 1,
+                              &globalDescriptor, 0, nullptr);
+
+      set_viewport_and_scissor();
+
+      vkCmdPushConstants(cmd, material->pipeline->layout,
+                         VK_SHADER_STAGE_VERTEX_BIT, 0,
+                         sizeof(GPUObjectPushConstants), &pushConstants);
     }
-    // rebind index buffer if needed
-    if (r.indexBuffer != lastIndexBuffer)
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            material->pipeline->layout, 1, 1,
+                            &material->materialSet, 0, nullptr);
+  };
+  // rebind index buffer if needed
+  auto bind_index_buffer = [&](VkBuffer indexBuffer)
+  {
+    if (indexBuffer != lastIndexBuffer)
     {
-      lastIndexBuffer = r.indexBuffer;
-      vkCmdBindIndexBuffer(cmd, r.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+      lastIndexBuffer = indexBuffer;
+      vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
     }
-    // calculate final mesh matrix
-    GPUDrawPushConstants push_constants;
-    push_constants.worldMatrix = r.transform;
-    push_constants.vertexBuffer = r.vertexBufferAddress;
-
-    vkCmdPushConstants(cmd, r.material->pipeline->layout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0,
-                       sizeof(GPUDrawPushConstants), &push_constants);
-
-    vkCmdDrawIndexed(cmd, r.indexCount, 1, r.firstIndex, 0, 0);
-    // stats
-    stats.drawcall_count++;
-    stats.triangle_count += r.indexCount / 3;
   };
 
-  for (auto& r : opaque_draws)
+  // every bucket draws the objects the compute pass kept, the triangles are
+  // only known on the GPU
+  auto draw_culled_buckets = [&]()
   {
-    draw(mainDrawContext.OpaqueSurfaces[r]);
+    const std::span<const GPUObjectBuffer::DrawBucket> buckets =
+        objectBuffer.GetDrawBuckets();
+    for (const GPUCulling::BucketDraw& draw : gpuCulling.GetDraws())
+    {
+      bind_material(buckets[draw.bucket].material);
+      bind_index_buffer(buckets[draw.bucket].indexBuffer);
+      vkCmdDrawIndexedIndirectCount(
+          cmd, gpuCulling.GetCommands(),
+          draw.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+          gpuCulling.GetCounts(), draw.bucket * sizeof(u32), draw.maxCount,
+          sizeof(VkDrawIndexedIndirectCommand));
+      results.drawcallCount++;
+    }
+    if (gpuCulling.GetMeshletMode() != GPUCulling::MeshletMode::MeshShader)
+    {
+      return;
+    }
+
+    // the meshlets the compute pass kept, a mesh shader workgroup each
+    const MaterialPipeline& meshletPipeline =
+        metalRoughMaterial.meshletPipeline;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      meshletPipeline.pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            meshletPipeline.layout, 0, 1, &globalDescriptor,
+                            0, nullptr);
+    set_viewport_and_scissor();
+    for (const GPUCulling::BucketDraw& draw : gpuCulling.GetDraws())
+    {
+      if (draw.maxMeshletDraws == 0)
+      {
+        continue;
+      }
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              meshletPipeline.layout, 1, 1,
+                              &buckets[draw.bucket].material->materialSet, 0,
+                              nullptr);
+      const GPUObjectPushConstants meshletConstants {
+          objectBuffer.GetAddress(),
+          gpuCulling.GetMeshletDraws() +
+              draw.firstMeshletDraw * sizeof(glm::uvec2)};
+      vkCmdPushConstants(cmd, meshletPipeline.layout,
+                         VK_SHADER_STAGE_MESH_BIT_EXT, 0,
+                         sizeof(GPUObjectPushConstants), &meshletConstants);
+      vkCmdDrawMeshTasksIndirectEXT(
+          cmd, gpuCulling.GetMeshTasks(),
+          draw.bucket * sizeof(VkDrawMeshTasksIndirectCommandEXT), 1,
+          sizeof(VkDrawMeshTasksIndirectCommandEXT));
+      results.drawcallCount++;
+    }
+    lastPipeline = nullptr;
+    lastMaterial = nullptr;
+  };
+  if (snapshot.bGpuCulling)
+  {
+    draw_culled_buckets();
+    if (bOcclusion)
+    {
+      // the pyramid is built from what the early pass drew, the late pass
+      // draws on top of it
+      vkCmdEndRendering(cmd);
+      vkutil::transition_image(cmd, _depthImage.image,
+                               VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                               VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+      depthPyramid.Build(cmd, {snapshot.windowSize.x, snapshot.windowSize.y},
+                         _drawExtent);
+      vkutil::transition_image(cmd, _depthImage.image,
+                               VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                               VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+      gpuCulling.Cull(cmd, GPUCulling::Pass::Late, depthPyramid);
+
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+      vkCmdBeginRendering(cmd, &renderInfo);
+      lastPipeline = nullptr;
+      lastMaterial = nullptr;
+      lastIndexBuffer = VK_NULL_HANDLE;
+      draw_culled_buckets();
+    }
+    // the transparent draws read their ids from the CPU list, the next
+    // pipeline bind pushes it
+    pushConstants.instanceBuffer = drawBuffers.instances;
+    lastPipeline = nullptr;
+    lastMaterial = nullptr;
   }
 
-  for (auto& r : mainDrawContext.TransparentSurfaces)
+  const std::span<const VkDrawIndexedIndirectCommand> commands =
+      indirectDraws.GetCommands();
+  for (const IndirectBatch& batch : indirectDraws.GetBatches())
   {
-    draw(r);
+    bind_material(batch.material);
+    bind_index_buffer(batch.indexBuffer);
+    if (snapshot.bIndirectDraws)
+    {
+      vkCmdDrawIndexedIndirect(
+          cmd, drawBuffers.commands,
+          batch.first * sizeof(VkDrawIndexedIndirectCommand), batch.count,
+          sizeof(VkDrawIndexedIndirectCommand));
+      results.drawcallCount++;
+      continue;
+    }
+    for (const VkDrawIndexedIndirectCommand& command :
+         commands.subspan(batch.first, batch.count))
+    {
+      vkCmdDrawIndexed(cmd, command.indexCount, command.instanceCount,
+                       command.firstIndex, command.vertexOffset,
+                       command.firstInstance);
+      results.drawcallCount++;
+    }
   }
 
   vkCmdEndRendering(cmd);
@@ -967,8 +1362,153 @@ void internal::draw_geometry(VkCommandBuffer cmd)
   // convert to microseconds (integer), and then come back to miliseconds
   auto elapsed =
       std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  stats.mesh_draw_time = elapsed.count() / 1000.f;
+  results.meshDrawTime = elapsed.count() / 1000.f;
+}
+void internal::rasterize_occluders(const FrameSnapshot& snapshot)
+{
+  HM_ZONE_SCOPED;
+  const DrawContext& drawContext = snapshot.renderObjects.GetDrawContext();
+  // same aspect as the window, so a pixel covers about the same on both axes
+  const f32 aspect = static_cast<f32>(snapshot.windowSize.y) /
+                     static_cast<f32>(std::max(snapshot.windowSize.x, 1u));
+  occlusionBuffer.Resize(
+      OcclusionBufferWidth,
+      std::max(static_cast<u32>(OcclusionBufferWidth * aspect), 1u));
+  occlusionBuffer.Begin(snapshot.sceneData.viewproj);
+  for (const RenderObject& object : drawContext.OpaqueSurfaces)
+  {
+    if (object.occluder != nullptr)
+    {
+      occlusionBuffer.AddOccluder(*object.occluder, object.transform);
+    }
+  }
+  occlusionBuffer.Rasterize(Engine::Instance().GetJobs());
+  HM_ZONE_VALUE(static_cast<int64_t>(occlusionBuffer.GetTriangleCount()));
+}
+
+std::vector<uint32_t> internal::build_opaque_draws(
+    const RenderObjectStore& objects,
+    std::span<const RenderObjectId> candidates, const culling::Frustum& frustum,
+    const glm::mat4& view, const culling::OcclusionBuffer* occlusion,
+    const gpx::LodSettings& lodSettings, std::vector<u8>& lodLevels)
+{
+  HM_ZONE_SCOPED;
+  constexpr u32 ChunkSize = 4096;
+
+  const DrawContext& drawContext = objects.GetDrawContext();
+  const u32 opaqueCount = drawContext.OpaqueBounds.GetCount();
+  const u32 candidateCount = static_cast<u32>(candidates.size());
+  const u32 chunkCount = (candidateCount + ChunkSize - 1) / ChunkSize;
+  jobs::JobSystem& jobSystem = Engine::Instance().GetJobs();
+  const culling::BoundsSoA& bounds = drawContext.OpaqueBounds;
+
+  // every chunk culls into its own range of the arrays and packs the keys of
+  // what is left, nothing is shared between the workers
+  std::vector<uint32_t> visible(candidateCount);
+  std::vector<u64> keys(candidateCount);
+  std::vector<u32> chunkCounts(chunkCount);
+  lodLevels.assign(opaqueCount, 0);
+  const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+  jobSystem.ParallelFor(
+      chunkCount, 1,
+      [&](u32 firstChunk, u32 lastChunk)
+      {
+        for (u32 chunk = firstChunk; chunk < lastChunk; chunk++)
+        {
+          const u32 begin = chunk * ChunkSize;
+          const u32 count = std::min(ChunkSize, candidateCount - begin);
+          // the candidates go to their spot in the opaque list, the ones that
+          // are not opaque are left out, then they are culled in place
+          u32 opaque = 0;
+          for (u32 i = begin; i < begin + count; i++)
+          {
+            const u32 index = objects.GetOpaqueIndex(candidates[i]);
+            if (index != InvalidRenderObject)
+            {
+              visible[begin + opaque++] = index;
+            }
+          }
+          u32 visibleCount = culling::Cull(
+              frustum, bounds, {&visible[begin], opaque}, &visible[begin]);
+          if (occlusion != nullptr)
+          {
+            visibleCount = occlusion->RemoveOccluded(bounds, &visible[begin],
+                                                     visibleCount);
+          }
+          if (lodSettings.pixelsPerUnit > 0.f)
+          {
+            u32 kept = 0;
+            for (u32 i = 0; i < visibleCount; i++)
+            {
+              const u32 index = visible[begin + i];
+              const RenderObject& object = drawContext.OpaqueSurfaces[index];
+              // the world radius over the mesh one is the largest scale
+              const f32 errorScale =
+                  object.bounds.sphereRadius > 0.f
+                      ? bounds.radius[index] / object.bounds.sphereRadius
+                      : 1.f;
+              const u32 lod = gpx::SelectLod(
+                  {object.lods, object.lodCount},
+                  {bounds.centerX[index], bounds.centerY[index],
+                   bounds.centerZ[index]},
+                  bounds.radius[index], errorScale, cameraPosition,
+                  lodSettings);
+              if (lod == gpx::CulledLod)
+              {
+                continue;
+              }
+              lodLevels[index] = static_cast<u8>(lod);
+              visible[begin + kept++] = index;
+            }
+            visibleCount = kept;
+          }
+          for (u32 i = 0; i < visibleCount; i++)
+          {
+            const u32 index = visible[begin + i];
+            const RenderObject& object = drawContext.OpaqueSurfaces[index];
+            // the camera looks down -z in view space
+            const f32 depth =
+                -(view[0][2] * bounds.centerX[index] +
+                  view[1][2] * bounds.centerY[index] +
+                  view[2][2] * bounds.centerZ[index] + view[3][2]);
+            keys[begin + i] = gpx::MakeDrawKey(
+                object.material->pipeline->sortId, object.material->sortId,
+                object.meshId,
+                gpx::QuantizeDepth(depth, nearPlane, farPlane));
+          }
+          chunkCounts[chunk] = visibleCount;
+        }
+      });
+
+  // the prefix sum gives every chunk the spot of its draws in the packed list
+  std::vector<u32> chunkStarts(chunkCount + 1, 0);
+  for (u32 chunk = 0; chunk < chunkCount; chunk++)
+  {
+    chunkStarts[chunk + 1] = chunkStarts[chunk] + chunkCounts[chunk];
+  }
+  std::vector<u64> packedKeys(chunkStarts[chunkCount]);
+  std::vector<uint32_t> draws(chunkStarts[chunkCount]);
+  jobSystem.ParallelFor(
+      chunkCount, 4,
+      [&](u32 firstChunk, u32 lastChunk)
+      {
+        for (u32 chunk = firstChunk; chunk < lastChunk; chunk++)
+        {
+          const u32 begin = chunk * ChunkSize;
+          std::copy_n(&keys[begin], chunkCounts[chunk],
+                      packedKeys.begin() + chunkStarts[chunk]);
+          std::copy_n(&visible[begin], chunkCounts[chunk],
+                      draws.begin() + chunkStarts[chunk]);
+        }
+      });
+
+  // the draws come in candidate order, so equal keys keep that order and the
+  // result does not depend on the chunking
+  opaqueSorter.Sort(packedKeys, draws);
+  HM_ZONE_VALUE(opaqueSorter.WasReused() ? 1 : 0);
+  return draws;
 }
+
 void GLTFMetallic_Roughness::clear_resources(VkDevice device) {}
 void GLTFMetallic_Roughness::build_pipelines()
 {
@@ -989,7 +1529,7 @@ void GLTFMetallic_Roughness::build_pipelines()
 
   VkPushConstantRange matrixRange {};
   matrixRange.offset = 0;
-  matrixRange.size = sizeof(GPUDrawPushConstants);
+  matrixRange.size = sizeof(GPUObjectPushConstants);
   matrixRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
   DescriptorLayoutBuilder layoutBuilder;
@@ -998,7 +1538,8 @@ void GLTFMetallic_Roughness::build_pipelines()
   layoutBuilder.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
   materialLayout = layoutBuilder.build(
-      _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+      _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT |
+                   (_bMeshShaders ? VK_SHADER_STAGE_MESH_BIT_EXT : 0));
 
   VkDescriptorSetLayout layouts[] = {_gpuSceneDataDescriptorLayout,
                                      materialLayout};
@@ -1016,6 +1557,8 @@ void GLTFMetallic_Roughness::build_pipelines()
 
   opaquePipeline.layout = newLayout;
   transparentPipeline.layout = newLayout;
+  opaquePipeline.sortId = 0;
+  transparentPipeline.sortId = 1;
 
   // build the stage-create-info for both vertex and fragment stages. This
   // lets the pipeline know the shader modules per stage
@@ -1045,12 +1588,47 @@ void GLTFMetallic_Roughness::build_pipelines()
 
   transparentPipeline.pipeline = pipelineBuilder.build_pipeline(_device);
 
+  if (_bMeshShaders)
+  {
+    VkShaderModule meshletShader;
+    if (!vkutil::load_shader_module(
+            io::GetPath("shaders/meshlet.mesh.vk.spv").c_str(), _device,
+            &meshletShader))
+    {
+      hm::log::Error("Failed building the mesh shader module");
+    }
+
+    // the same push constants, read by the mesh shader
+    VkPushConstantRange meshletRange = matrixRange;
+    meshletRange.stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+    VkPipelineLayoutCreateInfo meshletLayoutInfo = mesh_layout_info;
+    meshletLayoutInfo.pPushConstantRanges = &meshletRange;
+    VK_CHECK(vkCreatePipelineLayout(_device, &meshletLayoutInfo, nullptr,
+                                    &meshletPipeline.layout));
+    meshletPipeline.sortId = opaquePipeline.sortId;
+
+    pipelineBuilder.set_mesh_shaders(meshletShader, meshFragShader);
+    pipelineBuilder.disable_blending();
+    pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    pipelineBuilder._pipelineLayout = meshletPipeline.layout;
+    meshletPipeline.pipeline = pipelineBuilder.build_pipeline(_device);
+    vkDestroyShaderModule(_device, meshletShader, nullptr);
+  }
+
   vkDestroyShaderModule(_device, meshFragShader, nullptr);
   vkDestroyShaderModule(_device, meshVertexShader, nullptr);
   _mainDeletionQueue.push_function(
       [=]()
       {
         vkDestroyPipelineLayout(_device, opaquePipeline.layout, nullptr);
+        if (meshletPipeline.pipeline != VK_NULL_HANDLE)
+        {
+          vkDestroyPipeline(_device, meshletPipeline.pipeline, nullptr);
+        }
+        if (meshletPipeline.layout != VK_NULL_HANDLE)
+        {
+          vkDestroyPipelineLayout(_device, meshletPipeline.layout, nullptr);
+        }
 
         vkDestroyPipeline(_device, opaquePipeline.pipeline, nullptr);
 
@@ -1061,10 +1639,16 @@ void GLTFMetallic_Roughness::build_pipelines()
       });
 }
 GPUMeshBuffers hm::UploadMesh(std::span<uint32_t> indices,
-                              std::span<Vertex> vertices)
+                              std::span<Vertex> vertices,
+                              const gpx::MeshletSet& meshlets,
+                              std::span<const gpx::MeshLod> lods)
 {
   const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
   const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+  const size_t meshletBufferSize =
+      meshlets.meshlets.size() * sizeof(GPUMeshlet) +
+      lods.size() * sizeof(GPUMeshLod) +
+      (meshlets.vertices.size() + meshlets.triangles.size()) * sizeof(u32);
 
   GPUMeshBuffers newSurface;
 
@@ -1088,9 +1672,20 @@ GPUMeshBuffers hm::UploadMesh(std::span<uint32_t> indices,
       VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       VMA_MEMORY_USAGE_GPU_ONLY);
 
-  AllocatedBuffer staging = create_buffer(vertexBufferSize + indexBufferSize,
-                                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                          VMA_MEMORY_USAGE_CPU_ONLY);
+  if (meshletBufferSize != 0)
+  {
+    newSurface.meshletBuffer = create_buffer(
+        meshletBufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    newSurface.meshletBufferAddress =
+        vkutil::get_buffer_address(_device, newSurface.meshletBuffer.buffer);
+  }
+
+  AllocatedBuffer staging = create_buffer(
+      vertexBufferSize + indexBufferSize + meshletBufferSize,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
   void* data = staging.allocation->GetMappedData();
 
@@ -1099,6 +1694,41 @@ GPUMeshBuffers hm::UploadMesh(std::span<uint32_t> indices,
   // copy index buffer
   memcpy(static_cast<char*>(data) + vertexBufferSize, indices.data(),
          indexBufferSize);
+  // meshlets first, then the levels, the offsets move past them
+  GPUMeshlet* gpuMeshlets = reinterpret_cast<GPUMeshlet*>(
+      static_cast<char*>(data) + vertexBufferSize + indexBufferSize);
+  newSurface.lodOffset =
+      static_cast<u32>(meshlets.meshlets.size() * sizeof(GPUMeshlet) / 4);
+  const u32 vertexBase =
+      newSurface.lodOffset +
+      static_cast<u32>(lods.size() * sizeof(GPUMeshLod) / 4);
+  const u32 triangleBase =
+      vertexBase + static_cast<u32>(meshlets.vertices.size());
+  for (size_t i = 0; i < meshlets.meshlets.size(); i++)
+  {
+    const gpx::Meshlet& meshlet = meshlets.meshlets[i];
+    gpuMeshlets[i] = {
+        .sphere = glm::vec4(meshlet.center, meshlet.radius),
+        .cone = glm::vec4(meshlet.coneAxis, meshlet.coneCutoff),
+        .firstIndex = meshlet.firstIndex,
+        .triangleCount = meshlet.triangleCount,
+        .vertexOffset = vertexBase + meshlet.vertexOffset,
+        .vertexCount = meshlet.vertexCount,
+        .triangleOffset = triangleBase + meshlet.triangleOffset,
+        .pad = {}};
+  }
+  u32* meshletWords = reinterpret_cast<u32*>(gpuMeshlets);
+  GPUMeshLod* gpuLods =
+      reinterpret_cast<GPUMeshLod*>(meshletWords + newSurface.lodOffset);
+  for (size_t i = 0; i < lods.size(); i++)
+  {
+    gpuLods[i] = {.firstIndex = lods[i].firstIndex,
+                  .indexCount = lods[i].indexCount,
+                  .error = lods[i].error,
+                  .pad = 0};
+  }
+  std::ranges::copy(meshlets.vertices, meshletWords + vertexBase);
+  std::ranges::copy(meshlets.triangles, meshletWords + triangleBase);
 
   immediate_submit(
       [&](VkCommandBuffer cmd)
@@ -1118,16 +1748,28 @@ GPUMeshBuffers hm::UploadMesh(std::span<uint32_t> indices,
 
         vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1,
                         &indexCopy);
+
+        if (meshletBufferSize != 0)
+        {
+          VkBufferCopy meshletCopy {0};
+          meshletCopy.dstOffset = 0;
+          meshletCopy.srcOffset = vertexBufferSize + indexBufferSize;
+          meshletCopy.size = meshletBufferSize;
+
+          vkCmdCopyBuffer(cmd, staging.buffer,
+                          newSurface.meshletBuffer.buffer, 1, &meshletCopy);
+        }
       });
 
   destroy_buffer(staging);
 
   return newSurface;
 }
-void internal::draw_background(VkCommandBuffer cmd)
+void internal::draw_background(VkCommandBuffer cmd,
+                               const FrameSnapshot& snapshot)
 
 {
-  ComputeEffect& effect = backgroundEffects[currentBackgroundEffect];
+  const ComputeEffect& effect = snapshot.backgroundEffect;
 
   // bind the background compute pipeline
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
@@ -1144,17 +1786,153 @@ void internal::draw_background(VkCommandBuffer cmd)
   vkCmdDispatch(cmd, std::ceil(_drawExtent.width / 16.0),
                 std::ceil(_drawExtent.height / 16.0), 1);
 }
-void internal::update_scene(Camera& mainCamera)
+void internal::on_render_mesh_added(ecs::Registry&, ecs::Entity entity)
 {
-  auto start = std::chrono::system_clock::now();
-  mainDrawContext.OpaqueSurfaces.clear();
-  mainDrawContext.TransparentSurfaces.clear();
-  loadedScenes["structure"]->Draw(glm::mat4 {1.f}, mainDrawContext);
-  for (auto& [name, node] : loadedNodes)
+  addedRenderMeshes.push_back(entity);
+}
+
+void internal::on_render_mesh_removed(ecs::Registry& registry,
+                                      ecs::Entity entity)
+{
+  const RenderMesh& renderMesh = registry.get<RenderMesh>(entity);
+  if (renderMesh.objects.IsValid())
+  {
+    renderObjects.Remove(renderMesh.objects);
+  }
+}
+
+void internal::add_node_objects(const Node& node, const glm::mat4& topMatrix)
+{
+  if (const auto* meshNode = dynamic_cast<const MeshNode*>(&node))
+  {
+    renderObjects.Add(*meshNode->mesh, topMatrix * node.worldTransform);
+  }
+  for (const auto& child : node.children)
+  {
+    add_node_objects(*child, topMatrix);
+  }
+}
+
+void internal::sync_render_meshes()
+{
+  HM_ZONE_SCOPED;
+  auto& entityComponentSystem = Engine::Instance().GetECS();
+  ecs::Registry& registry = entityComponentSystem.GetRegistry();
+  auto& transforms = entityComponentSystem.GetSystem<ecs::TransformSystem>();
+  const f32 alpha = Engine::Instance().GetInterpolationAlpha();
+
+  HM_ZONE_VALUE(static_cast<int64_t>(addedRenderMeshes.size()));
+  for (const ecs::Entity entity : addedRenderMeshes)
+  {
+    // it can be gone again before it was ever drawn
+    if (registry.valid(entity) == false)
+    {
+      continue;
+    }
+    auto* renderMesh = registry.try_get<RenderMesh>(entity);
+    const auto* transform = registry.try_get<ecs::Transform>(entity);
+    if (renderMesh == nullptr || transform == nullptr ||
+        renderMesh->objects.IsValid())
+    {
+      continue;
+    }
+    // what has no proxy in the SpatialIndex is culled with the static
+    // objects, it is refit into their tree whenever it moves
+    renderMesh->objects = renderObjects.Add(
+        *renderMesh->mesh,
+        transforms.GetInterpolatedWorld(transform->id, alpha),
+        registry.all_of<ecs::SpatialProxy>(entity) == false);
+    if (transform->id >= renderMeshOfTransform.size())
+    {
+      renderMeshOfTransform.resize(transform->id + 1, entt::null);
+    }
+    renderMeshOfTransform[transform->id] = entity;
+  }
+  addedRenderMeshes.clear();
+
+  // what moved follows the interpolation every frame, and once more after
+  // it came to rest so it lands on its final world
+  std::vector<ecs::TransformId> stillMoving;
+  auto follow = [&](ecs::TransformId id)
+  {
+    if (id >= renderMeshOfTransform.size())
+    {
+      return;
+    }
+    // the transform can belong to something else by now
+    const ecs::Entity entity = renderMeshOfTransform[id];
+    if (registry.valid(entity) == false)
+    {
+      return;
+    }
+    const auto* renderMesh = registry.try_get<RenderMesh>(entity);
+    const auto* transform = registry.try_get<ecs::Transform>(entity);
+    if (renderMesh == nullptr || transform == nullptr || transform->id != id ||
+        renderMesh->objects.IsValid() == false)
+    {
+      return;
+    }
+    renderObjects.SetTransform(renderMesh->objects,
+                               transforms.GetInterpolatedWorld(id, alpha));
+    if (transforms.HasChanged(id))
+    {
+      stillMoving.push_back(id);
+    }
+  };
+  for (const ecs::TransformId id : movingTransforms)
+  {
+    follow(id);
+  }
+  for (const ecs::TransformId id : transforms.GetChangedIds())
+  {
+    follow(id);
+  }
+  transforms.ClearChangedIds();
+
+  std::ranges::sort(stillMoving);
+  const auto duplicates = std::ranges::unique(stillMoving);
+  stillMoving.erase(duplicates.begin(), duplicates.end());
+  movingTransforms.swap(stillMoving);
+}
+
+void internal::collect_cull_candidates(const culling::Frustum& frustum,
+                                       std::vector<RenderObjectId>& candidates)
+{
+  HM_ZONE_SCOPED;
+  candidates.clear();
+  renderObjects.QueryStatic(frustum, candidates);
+
+  // the proxies are where the last tick left them, the objects can still be
+  // on their way there. The next cull tests the objects themselves.
+  auto& entityComponentSystem = Engine::Instance().GetECS();
+  ecs::Registry& registry = entityComponentSystem.GetRegistry();
+  candidateEntities.clear();
+  entityComponentSystem.GetSystem<ecs::SpatialIndex>().QueryFrustum(
+      frustum, candidateEntities);
+  for (const ecs::Entity entity : candidateEntities)
   {
-    node->Draw(glm::mat4 {1.f}, mainDrawContext);
+    const auto* renderMesh = registry.try_get<RenderMesh>(entity);
+    if (renderMesh == nullptr || renderMesh->objects.IsValid() == false)
+    {
+      continue;
+    }
+    for (u32 i = 0; i < renderMesh->objects.count; i++)
+    {
+      candidates.push_back(renderMesh->objects.first + i);
+    }
   }
-  loadedNodes["Suzanne"]->Draw(glm::mat4 {1.f}, mainDrawContext);
+  HM_ZONE_VALUE(static_cast<int64_t>(candidates.size()));
+}
+
+void internal::update_scene(Camera& mainCamera, FrameSnapshot& snapshot)
+{
+  auto start = std::chrono::system_clock::now();
+  GPUSceneData& sceneData = snapshot.sceneData;
+
+  // only what changed since the snapshot was filled last is copied into it
+  sync_render_meshes();
+  renderObjects.Sync(snapshot.renderObjects);
+  renderObjects.EndFrame();
 
   glm::mat4 view = mainCamera.getViewMatrix();
 
@@ -1163,7 +1941,7 @@ void internal::update_scene(Camera& mainCamera)
   glm::mat4 projection = glm::perspective(
       glm::radians(70.f),
       static_cast<float>(windowExtent.x) / static_cast<float>(windowExtent.y),
-      10000.f, 0.1f);
+      farPlane, nearPlane);
 
   // invert the Y direction on projection matrix so that we are more similar
   // to opengl and gltf axis
@@ -1172,20 +1950,14 @@ void internal::update_scene(Camera& mainCamera)
   sceneData.view = view;
   sceneData.proj = projection;
   sceneData.viewproj = projection * view;
+  collect_cull_candidates(culling::ExtractFrustum(sceneData.viewproj),
+                          snapshot.cullCandidates);
 
   // some default lighting parameters
   sceneData.ambientColor = glm::vec4(.1f);
   sceneData.sunlightColor = glm::vec4(1.f);
   sceneData.sunlightDirection = glm::vec4(0, 1, 0.5, 1.f);
 
-  for (int x = -3; x < 3; x++)
-  {
-    glm::mat4 scale = glm::scale(glm::identity<glm::mat4>(), glm::vec3 {0.2});
-    glm::mat4 translation =
-        glm::translate(glm::identity<glm::mat4>(), glm::vec3 {x, 1, 0});
-
-    loadedNodes["Cube"]->Draw(translation * scale, mainDrawContext);
-  }
   auto end = std::chrono::system_clock::now();
 
   // convert to microseconds (integer), and then come back to miliseconds
@@ -0,0 +1,153 @@
+// needs GL_EXT_buffer_reference and object_data.glsl
+
+//matches GPUCulling::Pass
+const uint PASS_ALL = 0;
+const uint PASS_EARLY = 1;
+const uint PASS_LATE = 2;
+
+//matches GPUCulling::MeshletMode
+const uint MESHLETS_OFF = 0;
+const uint MESHLETS_INDEXED = 1;
+const uint MESHLETS_MESH_SHADER = 2;
+
+//farthest depth of every texel, reversed
+layout(set = 0, binding = 0) uniform sampler2D depthPyramid;
+
+// matches VkDrawIndexedIndirectCommand
+struct DrawCommand {
+
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+// matches VkDrawMeshTasksIndirectCommandEXT
+struct MeshTasksCommand {
+
+	uint groupCountX;
+	uint groupCountY;
+	uint groupCountZ;
+};
+
+// matches GPUCulling::CullData
+layout(buffer_reference, std430) readonly buffer CullData{ 
+	vec4 planes[6];
+	mat4 viewProj;
+	vec4 cameraPosition;
+	vec2 pyramidSize;
+	uint candidateCount;
+	uint pyramidLevels;
+	uint bucketCount;
+	uint meshletMode;
+	float pixelsPerUnit; //0 when the levels of detail are off
+	float lodErrorPixels;
+	float minPixelSize;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+	//first command of every bucket, then its first meshlet draw, then the
+	//ids of the candidates
+	uint firstDraws[];
+};
+
+layout(buffer_reference, std430) writeonly buffer CommandBuffer{ 
+	DrawCommand commands[];
+};
+
+layout(buffer_reference, std430) buffer CountBuffer{ 
+	uint counts[];
+};
+
+layout(buffer_reference, std430) writeonly buffer InstanceTarget{ 
+	uint objectIds[];
+};
+
+//1 for the objects the late pass kept last frame
+layout(buffer_reference, std430) buffer VisibilityBuffer{ 
+	uint flags[];
+};
+
+//dispatch of the meshlet cull, a workgroup per object
+layout(buffer_reference, std430) buffer TaskBuffer{ 
+	uint groupCountX;
+	uint groupCountY;
+	uint groupCountZ;
+	uint pad;
+	uint objectIds[];
+};
+
+//object id and meshlet index of every meshlet the mesh shaders draw
+layout(buffer_reference, std430) writeonly buffer MeshletDrawTarget{ 
+	uvec2 draws[];
+};
+
+layout(buffer_reference, std430) buffer MeshTasksBuffer{ 
+	MeshTasksCommand commands[];
+};
+
+layout( push_constant ) uniform constants
+{
+	ObjectBuffer objects;
+	CullData cull;
+	CommandBuffer commands;
+	CountBuffer counts;
+	InstanceTarget instances;
+	VisibilityBuffer visibility;
+	TaskBuffer tasks;
+	MeshletDrawTarget meshletDraws;
+	MeshTasksBuffer meshTasks;
+	uint pass;
+} PushConstants;
+
+//the screen rectangle of the box against the level of the pyramid it fits
+//in, hidden when its nearest point is farther than all the texels under it
+bool is_occluded(vec3 center, vec3 extents)
+{
+	vec2 minUV = vec2(1.0);
+	vec2 maxUV = vec2(0.0);
+	float nearest = 0.0;
+	for(int i = 0; i < 8; i++)
+	{
+		vec3 corner = vec3((i & 1) == 0 ? -1.0 : 1.0,
+			(i & 2) == 0 ? -1.0 : 1.0, (i & 4) == 0 ? -1.0 : 1.0);
+		vec4 clip = PushConstants.cull.viewProj *
+			vec4(center + corner * extents, 1.0);
+		//reaches past the near plane, nothing can be in front of it
+		if(clip.w <= 0.0 || clip.z > clip.w)
+		{
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+		maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+		nearest = max(nearest, ndc.z);
+	}
+	minUV = clamp(minUV, 0.0, 1.0);
+	maxUV = clamp(maxUV, 0.0, 1.0);
+
+	//at this level the rectangle covers at most 2x2 texels
+	vec2 size = (maxUV - minUV) * PushConstants.cull.pyramidSize;
+	int level = int(ceil(log2(max(max(size.x, size.y), 1.0))));
+	level = min(level, int(PushConstants.cull.pyramidLevels) - 1);
+	ivec2 levelSize = textureSize(depthPyramid, level);
+	ivec2 low = clamp(ivec2(minUV * vec2(levelSize)), ivec2(0), levelSize - 1);
+	ivec2 high = clamp(ivec2(maxUV * vec2(levelSize)), ivec2(0), levelSize - 1);
+	float depth = min(
+		min(texelFetch(depthPyramid, low, level).r,
+			texelFetch(depthPyramid, ivec2(high.x, low.y), level).r),
+		min(texelFetch(depthPyramid, ivec2(low.x, high.y), level).r,
+			texelFetch(depthPyramid, high, level).r));
+	return nearest < depth;
+}
+
+//visible draws of a bucket are packed at the front of its range
+void add_command(uint bucket, uint objectId, uint indexCount, uint firstIndex)
+{
+	uint slot = PushConstants.cull.firstDraws[bucket] +
+		atomicAdd(PushConstants.counts.counts[bucket], 1);
+	PushConstants.commands.commands[slot] =
+		DrawCommand(indexCount, 1, firstIndex, 0, slot);
+	PushConstants.instances.objectIds[slot] = objectId;
+}
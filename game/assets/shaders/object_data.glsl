@@ -0,0 +1,77 @@
+// needs GL_EXT_buffer_reference
+
+struct Vertex {
+
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+}; 
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
+	Vertex vertices[];
+};
+
+// matches GPUMeshlet, the offsets count words from the start of the buffer
+struct Meshlet {
+
+	vec4 sphere; //mesh space center and radius
+	vec4 cone; //normal cone axis and cutoff
+	uint firstIndex;
+	uint triangleCount;
+	uint vertexOffset;
+	uint vertexCount;
+	uint triangleOffset;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletBuffer{ 
+	Meshlet meshlets[];
+};
+
+// matches GPUMeshLod, read as words at ObjectData.firstLod
+struct MeshLod {
+
+	uint firstIndex;
+	uint indexCount;
+	float error; //mesh space
+	uint pad;
+};
+
+// the same buffer as words, for the vertices and triangles of the meshlets
+// and the levels of detail
+layout(buffer_reference, std430) readonly buffer MeshletWords{ 
+	uint words[];
+};
+
+// matches GPUObjectData
+struct ObjectData {
+
+	mat4 transform;
+	vec4 sphere; //world center and radius
+	vec4 extents; //world half extents around the sphere center
+	VertexBuffer vertexBuffer;
+	uint materialIndex;
+	uint firstIndex;
+	uint indexCount;
+	uint drawBucket; //NO_DRAW_BUCKET once the object is removed
+	MeshletBuffer meshletBuffer;
+	uint firstMeshlet;
+	uint meshletCount; //0 when the mesh has no meshlets
+	uint firstLod; //word of the meshlet buffer
+	uint lodCount; //the full surface first, 0 without levels
+};
+
+const uint NO_DRAW_BUCKET = 0xffffffffu;
+
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{ 
+	ObjectData objects[];
+};
+
+// object id of every instance drawn this frame
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{ 
+	uint objectIds[];
+};